@@ -0,0 +1,97 @@
+// ns/op and resident bytes per entry: LruCache (EntryTable core) against the
+// previous std::list + unordered_map core (legacy_lru_cache.hpp).
+//
+// Bytes per entry are live heap bytes (malloc_usable_size of every block the
+// cache holds) after a fill, excluding values: every entry shares one value
+// buffer so only the index, nodes and keys are measured.
+//
+//   ./cache_core_bench [entries]
+
+#include <malloc.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../cache/lru_cache.hpp"
+#include "legacy_lru_cache.hpp"
+
+static std::atomic<int64_t> g_live{0};
+
+// malloc/free behind new/delete is consistent, but GCC flags the pairing
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t n) {
+  void* p = std::malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  g_live.fetch_add(static_cast<int64_t>(malloc_usable_size(p)), std::memory_order_relaxed);
+  return p;
+}
+void operator delete(void* p) noexcept {
+  if (p) g_live.fetch_sub(static_cast<int64_t>(malloc_usable_size(p)), std::memory_order_relaxed);
+  std::free(p);
+}
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+namespace {
+
+std::vector<std::string> make_keys(size_t n, size_t len, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<std::string> keys(n);
+  for (auto& k : keys) {
+    k = "doc:" + std::to_string(rng());
+    k.resize(len, 'x');
+  }
+  return keys;
+}
+
+template <typename Fn>
+double ns_per_op(size_t ops, Fn&& fn) {
+  const auto t0 = std::chrono::steady_clock::now();
+  fn();
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - t0).count()) / double(ops);
+}
+
+template <typename Cache>
+void run(const char* name, size_t n, size_t key_len) {
+  const auto keys = make_keys(n, key_len, 1);
+  const auto absent = make_keys(n, key_len, 2);
+  const auto churn = make_keys(2 * n, key_len, 3);
+  std::vector<uint32_t> order(n);
+  std::mt19937 rng(7);
+  for (auto& i : order) i = static_cast<uint32_t>(rng() % n);
+  const ValueRef value = ValueRef::copy_of("v");
+
+  volatile size_t sink = 0;
+  const int64_t before = g_live.load();
+  auto* cache = new Cache(n);
+  const double fill = ns_per_op(n, [&] { for (const auto& k : keys) cache->put(k, value); });
+  const double bytes = double(g_live.load() - before) / double(n);
+  const double hit = ns_per_op(n, [&] { for (uint32_t i : order) sink += cache->get_ref(keys[i]).size(); });
+  const double miss = ns_per_op(n, [&] { for (const auto& k : absent) sink += cache->get_ref(k).size(); });
+  // cache is full and churn keys are new: every put evicts
+  const double evict = ns_per_op(2 * n, [&] {
+    for (size_t i = 0; i < 2 * n; ++i) cache->put(churn[(i * 7919) % churn.size()], value);
+  });
+  delete cache;
+  std::printf("%-8s %7zu %10.1f %10.1f %10.1f %10.1f %12.1f\n", name, key_len, fill, hit, miss, evict, bytes);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  std::printf("%zu entries; ns/op except bytes/entry (index + nodes + keys, values shared)\n", n);
+  std::printf("%-8s %7s %10s %10s %10s %10s %12s\n", "core", "key_len", "put_new", "get_hit", "get_miss", "put_evict", "bytes/entry");
+  for (size_t len : {16, 40}) {
+    run<LegacyLruCache>("legacy", n, len);
+    run<LruCache>("flat", n, len);
+  }
+  return 0;
+}
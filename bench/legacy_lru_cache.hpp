@@ -0,0 +1,53 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "../cache/value_buffer.hpp"
+
+// The cache core as it was before EntryTable: a std::list for recency plus
+// an unordered_map from key to list iterator, so each entry stores its key
+// twice and costs two node allocations. Kept only as a baseline for
+// cache_core_bench; LRU tail eviction by item count, same locking.
+class LegacyLruCache {
+public:
+    explicit LegacyLruCache(size_t capacity) : capacity_(capacity) {}
+
+    ValueRef get_ref(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = map_.find(key);
+        if (it == map_.end()) return ValueRef();
+        items_.splice(items_.begin(), items_, it->second);
+        return it->second->second;
+    }
+
+    bool put(const std::string& key, ValueRef value) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = map_.find(key);
+        if (it != map_.end()) {
+            it->second->second = std::move(value);
+            items_.splice(items_.begin(), items_, it->second);
+        } else {
+            items_.emplace_front(key, std::move(value));
+            map_.emplace(key, items_.begin());
+        }
+        while (map_.size() > capacity_) {
+            map_.erase(items_.back().first);
+            items_.pop_back();
+        }
+        return true;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return map_.size();
+    }
+
+private:
+    mutable std::mutex mu_;
+    size_t capacity_;
+    std::list<std::pair<std::string, ValueRef>> items_;
+    std::unordered_map<std::string, std::list<std::pair<std::string, ValueRef>>::iterator> map_;
+};
@@ -0,0 +1,388 @@
+// Load generator for the HTTP and binary transports on one machine. Each
+// connection runs on its own thread and keeps up to --pipeline requests in
+// flight (binary only; HTTP/1.1 via httplib is one at a time). Keys are
+// preloaded, then requests are GETs with --put-ratio PUTs mixed in, keys
+// drawn from --dist: uniform, zipf (--zipf-s, rank 0 hottest) or scan (each
+// connection walks the key space in order from its own offset).
+//
+// Closed loop (default) sends the next request when a slot frees up. Open
+// loop (--rate R, requests/s over all connections) sends on a fixed
+// schedule; latency is then measured from each request's scheduled send
+// time, so a stalled server is charged for the requests it kept the client
+// from sending (coordinated omission). Time from the actual send is
+// reported separately as service latency. --json writes the run as JSON.
+//
+//   ./load_client --proto binary --port 8081 --conns 4 --pipeline 16 --requests 200000
+//   ./load_client --proto http --dist zipf --rate 20000 --requests 200000 --json run.json
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "../cache/latency_histogram.hpp"
+#include "../server/binary_protocol.hpp"
+
+namespace {
+
+struct Options {
+  std::string proto = "binary";
+  std::string host = "127.0.0.1";
+  int port = 0;
+  size_t conns = 4;
+  size_t pipeline = 16;
+  size_t requests = 100000;    // total, split over connections
+  size_t keys = 10000;
+  size_t value_size = 512;
+  double put_ratio = 0.0;
+  std::string dist = "uniform";
+  double zipf_s = 0.99;
+  double rate = 0;             // requests/s over all connections; 0 = closed loop
+  std::string json_path;
+};
+
+void usage() {
+  std::fprintf(stderr,
+    "usage: load_client [--proto binary|http] [--host H] [--port P] [--conns N]\n"
+    "                   [--pipeline N] [--requests N] [--keys N] [--value-size B] [--put-ratio F]\n"
+    "                   [--dist uniform|zipf|scan] [--zipf-s S] [--rate R] [--json PATH]\n");
+}
+
+std::string key_of(size_t i) { return "lesson:" + std::to_string(i); }
+
+// Key indices for one connection
+class KeyGen {
+public:
+  KeyGen(const Options& o, const std::vector<double>* zipf_cdf, size_t conn, uint64_t seed)
+    : o_(o), cdf_(zipf_cdf), rng_(seed),
+      next_(o.keys / std::max<size_t>(1, o.conns) * conn) {}
+
+  size_t next() {
+    if (o_.dist == "scan") return next_++ % o_.keys;
+    if (o_.dist == "zipf") {
+      const double u = std::uniform_real_distribution<double>(0, 1)(rng_);
+      return std::min<size_t>(std::lower_bound(cdf_->begin(), cdf_->end(), u) - cdf_->begin(), o_.keys - 1);
+    }
+    return rng_() % o_.keys;
+  }
+
+  bool put() { return std::uniform_real_distribution<double>(0, 1)(rng_) < o_.put_ratio; }
+
+private:
+  const Options& o_;
+  const std::vector<double>* cdf_;
+  std::mt19937_64 rng_;
+  size_t next_;
+};
+
+// P(rank <= i) for ranks weighted 1 / (i + 1)^s
+std::vector<double> zipf_cdf(size_t n, double s) {
+  std::vector<double> cdf(n);
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) cdf[i] = sum += 1.0 / std::pow(double(i + 1), s);
+  for (auto& c : cdf) c /= sum;
+  return cdf;
+}
+
+struct Totals {
+  std::atomic<uint64_t> ok{0}, miss{0}, errors{0};
+};
+
+// response: from the scheduled send (open loop) or actual send (closed loop);
+// service: from the actual send
+struct Latencies {
+  LatencyHistogram response, service;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Scheduled send time of a connection's i-th request; closed loop has none
+struct Schedule {
+  Clock::time_point start;
+  double interval_ns = 0;      // per connection
+  bool open() const { return interval_ns > 0; }
+  Clock::time_point at(size_t i) const {
+    return start + std::chrono::nanoseconds(static_cast<int64_t>(interval_ns * double(i)));
+  }
+};
+
+void record(Latencies& lat, Clock::time_point scheduled, Clock::time_point sent) {
+  const auto now = Clock::now();
+  auto ns = [&](Clock::time_point t0) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - t0).count());
+  };
+  lat.response.record_ns(ns(scheduled));
+  lat.service.record_ns(ns(sent));
+}
+
+int connect_to(const Options& o) {
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(o.port));
+  if (::inet_pton(AF_INET, o.host.c_str(), &addr.sin_addr) != 1 ||
+      ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+bool send_all(int fd, const std::string& buf) {
+  size_t off = 0;
+  while (off < buf.size()) {
+    const ssize_t n = ::send(fd, buf.data() + off, buf.size() - off, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    off += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Sends `count` requests keeping up to --pipeline in flight, on schedule
+// when the run is open loop
+void run_binary(const Options& o, size_t count, KeyGen& gen, const Schedule& sched,
+                Latencies& lat, Totals& t) {
+  const int fd = connect_to(o);
+  if (fd < 0) { t.errors.fetch_add(count); return; }
+  const std::string value(o.value_size, 'v');
+  struct InFlight { Clock::time_point scheduled, sent; };
+  std::deque<InFlight> sent;
+  std::string out, in;
+  size_t issued = 0, done = 0;
+  char buf[64 * 1024];
+
+  while (done < count) {
+    out.clear();
+    const auto now = Clock::now();
+    while (issued < count && sent.size() < o.pipeline && (!sched.open() || sched.at(issued) <= now)) {
+      const std::string key = key_of(gen.next());
+      if (gen.put())
+        binproto::append_request(out, binproto::kPut, key, value);
+      else
+        binproto::append_request(out, binproto::kGet, key);
+      sent.push_back({sched.open() ? sched.at(issued) : now, now});
+      ++issued;
+    }
+    if (!out.empty() && !send_all(fd, out)) break;
+
+    if (sched.open()) {
+      // wait for a response or the next send, whichever comes first
+      int timeout_ms = -1;
+      if (issued < count && sent.size() < o.pipeline) {
+        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(sched.at(issued) - Clock::now());
+        timeout_ms = static_cast<int>(std::max<int64_t>(0, wait.count()));
+      }
+      if (sent.empty() && timeout_ms > 0) { std::this_thread::sleep_until(sched.at(issued)); continue; }
+      pollfd p{fd, POLLIN, 0};
+      if (::poll(&p, 1, timeout_ms) == 0) continue;
+    }
+    const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) break;
+    in.append(buf, static_cast<size_t>(n));
+    size_t off = 0;
+    while (in.size() - off >= binproto::kResponseHeader) {
+      const uint32_t len = binproto::get_u32(in.data() + off + 4);
+      if (in.size() - off < binproto::kResponseHeader + len) break;
+      const uint8_t status = static_cast<uint8_t>(in[off + 2]);
+      if (status == binproto::kOk || status == binproto::kNotAdmitted) t.ok.fetch_add(1, std::memory_order_relaxed);
+      else if (status == binproto::kMiss) t.miss.fetch_add(1, std::memory_order_relaxed);
+      else t.errors.fetch_add(1, std::memory_order_relaxed);
+      record(lat, sent.front().scheduled, sent.front().sent);
+      sent.pop_front();
+      ++done;
+      off += binproto::kResponseHeader + len;
+    }
+    in.erase(0, off);
+  }
+  if (done < count) t.errors.fetch_add(count - done);
+  ::close(fd);
+}
+
+void run_http(const Options& o, size_t count, KeyGen& gen, const Schedule& sched,
+              Latencies& lat, Totals& t) {
+  httplib::Client cli(o.host, o.port);
+  cli.set_keep_alive(true);
+  cli.set_tcp_nodelay(true);
+  const std::string body_prefix = "{\"key\":\"";
+  const std::string value(o.value_size, 'v');
+  for (size_t i = 0; i < count; ++i) {
+    const std::string key = key_of(gen.next());
+    // late requests go out at once; their wait counts against the server
+    if (sched.open()) std::this_thread::sleep_until(sched.at(i));
+    const auto t0 = Clock::now();
+    httplib::Result res;
+    if (gen.put())
+      res = cli.Put("/put", body_prefix + key + "\",\"value\":\"" + value + "\"}", "application/json");
+    else
+      res = cli.Get("/get/raw?key=" + key);
+    record(lat, sched.open() ? sched.at(i) : t0, t0);
+    if (!res) t.errors.fetch_add(1, std::memory_order_relaxed);
+    else if (res->status == 200) t.ok.fetch_add(1, std::memory_order_relaxed);
+    else if (res->status == 404) t.miss.fetch_add(1, std::memory_order_relaxed);
+    else t.errors.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Stores every key once so GETs hit
+bool preload(const Options& o) {
+  const std::string value(o.value_size, 'v');
+  if (o.proto == "http") {
+    httplib::Client cli(o.host, o.port);
+    cli.set_keep_alive(true);
+    cli.set_tcp_nodelay(true);
+    for (size_t i = 0; i < o.keys; ++i) {
+      auto r = cli.Put("/put", "{\"key\":\"" + key_of(i) + "\",\"value\":\"" + value + "\"}", "application/json");
+      if (!r) return false;
+    }
+    return true;
+  }
+  const int fd = connect_to(o);
+  if (fd < 0) return false;
+  std::string out;
+  for (size_t i = 0; i < o.keys; ++i) binproto::append_request(out, binproto::kPut, key_of(i), value);
+  bool ok = send_all(fd, out);
+  size_t got = 0;
+  std::string in;
+  char buf[64 * 1024];
+  while (ok && got < o.keys) {
+    const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) { ok = false; break; }
+    in.append(buf, static_cast<size_t>(n));
+    size_t off = 0;
+    while (in.size() - off >= binproto::kResponseHeader) {
+      const uint32_t len = binproto::get_u32(in.data() + off + 4);
+      if (in.size() - off < binproto::kResponseHeader + len) break;
+      off += binproto::kResponseHeader + len;
+      ++got;
+    }
+    in.erase(0, off);
+  }
+  ::close(fd);
+  return ok;
+}
+
+void print_latency(const char* label, const LatencyHistogram::Snapshot& s) {
+  std::printf("%s us: p50 %.1f  p90 %.1f  p99 %.1f  p999 %.1f  max %.1f\n", label,
+              s.quantile_ns(0.5) / 1e3, s.quantile_ns(0.9) / 1e3, s.quantile_ns(0.99) / 1e3,
+              s.quantile_ns(0.999) / 1e3, s.max_ns / 1e3);
+}
+
+bool write_json(const Options& o, double secs, const Totals& t,
+                const LatencyHistogram::Snapshot& response, const LatencyHistogram::Snapshot& service) {
+  std::ofstream f(o.json_path);
+  f << "{\"tool\":\"load_client\",\"config\":{\"proto\":\"" << o.proto << "\",\"host\":\"" << o.host
+    << "\",\"port\":" << o.port << ",\"conns\":" << o.conns << ",\"pipeline\":" << o.pipeline
+    << ",\"requests\":" << o.requests << ",\"keys\":" << o.keys << ",\"value_size\":" << o.value_size
+    << ",\"put_ratio\":" << o.put_ratio << ",\"dist\":\"" << o.dist << "\",\"zipf_s\":" << o.zipf_s
+    << ",\"mode\":\"" << (o.rate > 0 ? "open" : "closed") << "\",\"rate\":" << o.rate << "}"
+    << ",\"seconds\":" << secs << ",\"throughput\":" << (secs > 0 ? double(response.count) / secs : 0.0)
+    << ",\"ok\":" << t.ok.load() << ",\"miss\":" << t.miss.load() << ",\"errors\":" << t.errors.load()
+    << ",\"latency_us\":";
+  LatencyHistogram::write_json(f, response);
+  f << ",\"service_latency_us\":";
+  LatencyHistogram::write_json(f, service);
+  f << "}\n";
+  return bool(f);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    auto next = [&]() -> const char* {
+      if (i + 1 >= argc) { usage(); std::exit(2); }
+      return argv[++i];
+    };
+    if (a == "--proto") o.proto = next();
+    else if (a == "--host") o.host = next();
+    else if (a == "--port") o.port = std::atoi(next());
+    else if (a == "--conns") o.conns = std::strtoul(next(), nullptr, 10);
+    else if (a == "--pipeline") o.pipeline = std::strtoul(next(), nullptr, 10);
+    else if (a == "--requests") o.requests = std::strtoul(next(), nullptr, 10);
+    else if (a == "--keys") o.keys = std::strtoul(next(), nullptr, 10);
+    else if (a == "--value-size") o.value_size = std::strtoul(next(), nullptr, 10);
+    else if (a == "--put-ratio") o.put_ratio = std::atof(next());
+    else if (a == "--dist") o.dist = next();
+    else if (a == "--zipf-s") o.zipf_s = std::atof(next());
+    else if (a == "--rate") o.rate = std::atof(next());
+    else if (a == "--json") o.json_path = next();
+    else { usage(); return 2; }
+  }
+  if (o.proto != "binary" && o.proto != "http") { usage(); return 2; }
+  if (o.dist != "uniform" && o.dist != "zipf" && o.dist != "scan") { usage(); return 2; }
+  if (o.port == 0) o.port = o.proto == "http" ? 8080 : 8081;
+  if (o.conns == 0) o.conns = 1;
+  if (o.keys == 0) o.keys = 1;
+  if (o.pipeline == 0 || o.proto == "http") o.pipeline = 1;
+
+  if (!preload(o)) { std::fprintf(stderr, "cannot reach %s:%d\n", o.host.c_str(), o.port); return 1; }
+
+  std::vector<double> cdf;
+  if (o.dist == "zipf") cdf = zipf_cdf(o.keys, o.zipf_s);
+  auto lat = std::make_unique<Latencies>();
+  Totals t;
+  Schedule sched;
+  if (o.rate > 0) sched.interval_ns = 1e9 * double(o.conns) / o.rate;
+  std::vector<std::thread> threads;
+  const auto t0 = Clock::now();
+  sched.start = t0;
+  for (size_t c = 0; c < o.conns; ++c) {
+    const size_t count = o.requests / o.conns + (c < o.requests % o.conns ? 1 : 0);
+    threads.emplace_back([&, c, count] {
+      KeyGen gen(o, &cdf, c, c + 1);
+      // connections are staggered evenly within one interval
+      Schedule own = sched;
+      own.start += std::chrono::nanoseconds(static_cast<int64_t>(sched.interval_ns * double(c) / double(o.conns)));
+      if (o.proto == "binary") run_binary(o, count, gen, own, *lat, t);
+      else run_http(o, count, gen, own, *lat, t);
+    });
+  }
+  for (auto& th : threads) th.join();
+  const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  const auto response = lat->response.snapshot();
+  const auto service = lat->service.snapshot();
+  std::printf("%s %s:%d conns=%zu pipeline=%zu value=%zuB put_ratio=%.2f dist=%s", o.proto.c_str(),
+              o.host.c_str(), o.port, o.conns, o.pipeline, o.value_size, o.put_ratio, o.dist.c_str());
+  if (o.rate > 0) std::printf(" open loop at %.0f req/s\n", o.rate);
+  else std::printf(" closed loop\n");
+  std::printf("requests %llu in %.2f s: %.0f req/s (ok %llu, miss %llu, errors %llu)\n",
+              static_cast<unsigned long long>(response.count), secs, double(response.count) / secs,
+              static_cast<unsigned long long>(t.ok.load()), static_cast<unsigned long long>(t.miss.load()),
+              static_cast<unsigned long long>(t.errors.load()));
+  if (o.rate > 0) {
+    print_latency("latency (from schedule)", response);
+    print_latency("service (from send)    ", service);
+  } else {
+    print_latency("latency", response);
+  }
+  if (!o.json_path.empty() && !write_json(o, secs, t, response, service)) {
+    std::fprintf(stderr, "cannot write %s\n", o.json_path.c_str());
+    return 1;
+  }
+  return t.errors.load() ? 1 : 0;
+}
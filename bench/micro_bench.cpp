@@ -0,0 +1,167 @@
+// Google Benchmark micro-benchmarks of the hot-path building blocks:
+// LruCache / ShardedLruCache get and put across thread counts, each eviction
+// strategy under a full cache, KeyStatsStore::touch, CsvLogger::write and
+// Metrics updates.
+//
+//   ./micro_bench --benchmark_out=micro.json --benchmark_out_format=json
+//   ./micro_bench --benchmark_filter='Get'
+//
+// Two JSON files from different builds compare with Google Benchmark's
+// tools/compare.py.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../cache/key_stats.hpp"
+#include "../cache/logger.hpp"
+#include "../cache/lru_cache.hpp"
+#include "../cache/metrics.hpp"
+#include "../cache/native_scorer.hpp"
+#include "../cache/policies.hpp"
+#include "../cache/sharded_cache.hpp"
+
+namespace {
+
+constexpr size_t kKeys = 1 << 16;      // working set; power of two for masking
+constexpr size_t kValueBytes = 256;
+
+const std::vector<std::string>& keys() {
+  static const std::vector<std::string> k = [] {
+    std::vector<std::string> out(kKeys);
+    for (size_t i = 0; i < kKeys; ++i) out[i] = "lesson:" + std::to_string(i);
+    return out;
+  }();
+  return k;
+}
+
+int max_threads() { return static_cast<int>(std::max(2u, std::thread::hardware_concurrency())); }
+
+// One cache shared by all threads of a run, filled by thread 0
+template <typename Cache>
+struct Shared {
+  static std::unique_ptr<Cache>& cache() { static std::unique_ptr<Cache> c; return c; }
+};
+
+std::unique_ptr<LruCache> make_cache(LruCache*) { return std::make_unique<LruCache>(kKeys); }
+std::unique_ptr<ShardedLruCache> make_cache(ShardedLruCache*) { return std::make_unique<ShardedLruCache>(kKeys, 16); }
+
+template <typename Cache>
+void setup_filled(const benchmark::State& state) {
+  if (state.thread_index() != 0) return;
+  auto& c = Shared<Cache>::cache();
+  c = make_cache(static_cast<Cache*>(nullptr));
+  const auto value = ValueRef::copy_of(std::string(kValueBytes, 'v'));
+  for (const auto& k : keys()) c->put(k, value);
+}
+
+template <typename Cache>
+void teardown(const benchmark::State& state) {
+  if (state.thread_index() == 0) Shared<Cache>::cache().reset();
+}
+
+template <typename Cache>
+void BM_Get(benchmark::State& state) {
+  auto& c = *Shared<Cache>::cache();
+  std::mt19937_64 rng(state.thread_index() + 1);
+  for (auto _ : state) benchmark::DoNotOptimize(c.get_ref(keys()[rng() & (kKeys - 1)]));
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Cache>
+void BM_Put(benchmark::State& state) {
+  auto& c = *Shared<Cache>::cache();
+  std::mt19937_64 rng(state.thread_index() + 1);
+  const auto value = ValueRef::copy_of(std::string(kValueBytes, 'v'));
+  for (auto _ : state) c.put(keys()[rng() & (kKeys - 1)], value);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_Get, LruCache)->Setup(setup_filled<LruCache>)->Teardown(teardown<LruCache>)
+  ->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Put, LruCache)->Setup(setup_filled<LruCache>)->Teardown(teardown<LruCache>)
+  ->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Get, ShardedLruCache)->Setup(setup_filled<ShardedLruCache>)->Teardown(teardown<ShardedLruCache>)
+  ->ThreadRange(1, max_threads())->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Put, ShardedLruCache)->Setup(setup_filled<ShardedLruCache>)->Teardown(teardown<ShardedLruCache>)
+  ->ThreadRange(1, max_threads())->UseRealTime();
+
+// Puts of a 4x larger key space into a full cache, so nearly every put
+// evicts; arg 0 indexes kStrategies
+const char* const kStrategies[] = {"LRU", "TINYLFU", "S3FIFO", "ARC", "NATIVE"};
+
+std::shared_ptr<EvictionStrategy> make_strategy(const std::string& name) {
+  if (name != "NATIVE") return make_builtin_policy(name);
+  // fixed coefficients, no model file
+  auto s = std::make_shared<NativeModelStrategy>("/nonexistent/model.txt");
+  NativeModel m;
+  m.log1p = true;
+  m.w = {-0.5f, 0.8f, -0.1f, 0.2f};
+  s->set_model(m);
+  return s;
+}
+
+void BM_Evict(benchmark::State& state) {
+  const std::string name = kStrategies[state.range(0)];
+  state.SetLabel(name);
+  const size_t capacity = kKeys / 4;
+  LruCache c(capacity);
+  c.set_strategy(make_strategy(name));
+  const auto value = ValueRef::copy_of(std::string(kValueBytes, 'v'));
+  for (size_t i = 0; i < capacity; ++i) c.put(keys()[i], value);
+  std::mt19937_64 rng(1);
+  for (auto _ : state) c.put(keys()[rng() & (kKeys - 1)], value);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Evict)->DenseRange(0, std::size(kStrategies) - 1);
+
+void BM_KeyStatsTouch(benchmark::State& state) {
+  std::mt19937_64 rng(state.thread_index() + 1);
+  auto& ks = KeyStatsStore::instance();
+  for (auto _ : state) ks.touch(keys()[rng() & (kKeys - 1)], kValueBytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_KeyStatsTouch)->ThreadRange(1, max_threads())->UseRealTime();
+
+void BM_LoggerWrite(benchmark::State& state) {
+  static const bool ready = [] {
+    LoggerConfig cfg;
+    cfg.format = LogFormat::Binary;
+    CsvLogger::instance().init("/tmp/geocache_micro_bench/access_log.bin", cfg);
+    return true;
+  }();
+  benchmark::DoNotOptimize(ready);
+  std::mt19937_64 rng(state.thread_index() + 1);
+  for (auto _ : state) CsvLogger::instance().write("GET", keys()[rng() & (kKeys - 1)], true, 42, kValueBytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LoggerWrite)->ThreadRange(1, max_threads())->UseRealTime();
+
+// The counter and histogram updates a GET hit makes
+void BM_MetricsHit(benchmark::State& state) {
+  auto& m = Metrics::instance();
+  uint64_t ns = 1000;
+  for (auto _ : state) {
+    m.inc_get_requests();
+    m.inc_hits();
+    m.get_latency().record_ns(ns);
+    ns = ns * 33 % 100003 + 500;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MetricsHit)->ThreadRange(1, max_threads())->UseRealTime();
+
+void BM_MetricsScrape(benchmark::State& state) {
+  for (auto _ : state) benchmark::DoNotOptimize(Metrics::instance().to_prom());
+}
+BENCHMARK(BM_MetricsScrape);
+
+}  // namespace
+
+BENCHMARK_MAIN();
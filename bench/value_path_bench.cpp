@@ -0,0 +1,108 @@
+// Bytes copied per cache hit on the GET path.
+//
+//   copy:  cache.get() + nlohmann::json{...}.dump()   (the previous /get)
+//   json:  cache.get_ref() + streamed JSON body        (/get)
+//   raw:   cache.get_ref() + streamed raw body         (/get/raw)
+//
+// Every copy of a value needs a buffer, so heap bytes allocated per hit
+// (counted by replacing global operator new) track bytes copied. The socket
+// write is simulated by a sink that only counts bytes.
+//
+//   ./value_path_bench [iterations]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "../third_party/json.hpp"
+#include "../cache/lru_cache.hpp"
+#include "../server/value_response.hpp"
+
+static std::atomic<uint64_t> g_alloc_bytes{0};
+
+// malloc/free behind new/delete is consistent, but GCC flags the pairing
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t n) {
+  g_alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+  if (void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Result { double alloc_per_hit, ns_per_hit; uint64_t body_bytes; };
+
+// Drains a response the way httplib's write_content does
+uint64_t drain(httplib::Response& res) {
+  uint64_t written = 0;
+  if (!res.content_provider_) return res.body.size();
+  httplib::DataSink sink;
+  sink.write = [&](const char*, size_t n) { written += n; return true; };
+  sink.is_writable = [] { return true; };
+  size_t offset = 0;
+  while (offset < res.content_length_) {
+    const uint64_t before = written;
+    if (!res.content_provider_(offset, res.content_length_ - offset, sink)) break;
+    offset += written - before;
+  }
+  return written;
+}
+
+template <typename Fn>
+Result run(int iters, Fn&& serve_one) {
+  uint64_t body = serve_one();   // warm up slab classes and caches
+  const uint64_t a0 = g_alloc_bytes.load();
+  const auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; ++i) body = serve_one();
+  const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - t0).count();
+  return {double(g_alloc_bytes.load() - a0) / iters, double(ns) / iters, body};
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int iters = argc > 1 ? std::atoi(argv[1]) : 200;
+  const std::vector<size_t> sizes = {1024, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024};
+  const std::string key = "doc:lecture-notes.pdf";
+
+  std::printf("%-10s %-5s %16s %12s %12s\n", "value", "path", "alloc_B/hit", "copies/hit", "us/hit");
+  for (size_t sz : sizes) {
+    LruCache cache(CacheLimits{0, 0, 1.0});
+    std::string value(sz, 'x');
+    for (size_t i = 0; i < sz; i += 97) value[i] = static_cast<char>('a' + i % 26);
+    cache.put(key, value);
+
+    auto copy = run(iters, [&] {
+      auto v = cache.get(key);
+      httplib::Response res;
+      nlohmann::json out = {{"key", key}, {"value", *v}};
+      res.set_content(out.dump(), "application/json");
+      return drain(res);
+    });
+    auto js = run(iters, [&] {
+      httplib::Response res;
+      value_response::set_json(res, key, cache.get_ref(key));
+      return drain(res);
+    });
+    auto raw = run(iters, [&] {
+      httplib::Response res;
+      value_response::set_raw(res, cache.get_ref(key));
+      return drain(res);
+    });
+
+    const struct { const char* name; Result r; } rows[] = {{"copy", copy}, {"json", js}, {"raw", raw}};
+    for (const auto& row : rows)
+      std::printf("%-10zu %-5s %16.0f %12.2f %12.2f\n", sz, row.name, row.r.alloc_per_hit,
+                  row.r.alloc_per_hit / double(sz), row.r.ns_per_hit / 1000.0);
+  }
+  return 0;
+}
@@ -0,0 +1,275 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "metrics.hpp"
+#include "policies.hpp"
+#include "value_buffer.hpp"
+
+struct ClusterConfig {
+  std::vector<std::string> nodes;          // "host:port" of every node, this one included
+  std::string self;                        // this node's entry in nodes
+  size_t vnodes = 128;                     // ring points per node
+  size_t max_idle = 16;                    // keep-alive connections kept per peer
+  std::chrono::milliseconds timeout{500};  // per forwarded request
+  size_t near_items = 0;                   // near-cache of remote hot keys; 0 = off
+  std::chrono::milliseconds near_ttl{1000};
+  uint8_t near_min_hits = 4;               // requests before a remote key is kept locally
+};
+
+// Consistent-hash ring with virtual nodes. Points come from a fixed hash
+// of "node#i", so every node built from any compiler agrees on ownership.
+class HashRing {
+public:
+  HashRing(const std::vector<std::string>& nodes, size_t vnodes) {
+    vnodes = std::max<size_t>(1, vnodes);
+    points_.reserve(nodes.size() * vnodes);
+    for (uint32_t n = 0; n < nodes.size(); ++n)
+      for (size_t v = 0; v < vnodes; ++v)
+        points_.emplace_back(hash(nodes[n] + "#" + std::to_string(v)), n);
+    std::sort(points_.begin(), points_.end());
+  }
+
+  // Index into nodes of the key's owner
+  size_t owner(std::string_view key) const {
+    if (points_.empty()) return 0;
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(hash(key), uint32_t{0}));
+    return (it == points_.end() ? points_.front() : *it).second;
+  }
+
+  // FNV-1a, then a murmur3 finalizer to spread short keys over the ring
+  static uint64_t hash(std::string_view s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : s) { h ^= c; h *= 0x100000001b3ULL; }
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+private:
+  std::vector<std::pair<uint64_t, uint32_t>> points_;
+};
+
+// Short-lived local copies of values owned by other nodes. A remote key is
+// admitted only after near_min_hits requests (count-min estimate), and
+// copies expire after near_ttl: there is no cross-node invalidation, so the
+// ttl bounds how stale a near hit can be. Writes through this node erase
+// their key.
+class NearCache {
+public:
+  NearCache(size_t capacity, std::chrono::milliseconds ttl, uint8_t min_hits)
+    : capacity_(capacity), ttl_(ttl), min_hits_(min_hits) {
+    sketch_.ensure_capacity(capacity * 8);
+  }
+
+  bool enabled() const { return capacity_ > 0; }
+
+  ValueRef get(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = map_.find(key);
+    if (it == map_.end()) return ValueRef();
+    if (Clock::now() >= it->second.expires) {
+      map_.erase(it);
+      return ValueRef();
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return it->second.value;
+  }
+
+  // Counts a request for a remote key; true once it is hot enough to keep
+  bool note(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mu_);
+    sketch_.increment(key);
+    return sketch_.estimate(key) >= min_hits_;
+  }
+
+  void put(const std::string& key, ValueRef value) {
+    std::lock_guard<std::mutex> lock(mu_);
+    const uint64_t seq = ++seq_;
+    map_[key] = Entry{std::move(value), Clock::now() + ttl_, seq};
+    order_.emplace_back(key, seq);
+    // oldest copies go first; order entries of replaced copies are skipped
+    while (map_.size() > capacity_ && !order_.empty()) {
+      auto it = map_.find(order_.front().first);
+      if (it != map_.end() && it->second.seq == order_.front().second) map_.erase(it);
+      order_.pop_front();
+    }
+    if (order_.size() > 2 * capacity_ + 16) {
+      std::deque<std::pair<std::string, uint64_t>> kept;
+      for (auto& o : order_) {
+        auto it = map_.find(o.first);
+        if (it != map_.end() && it->second.seq == o.second) kept.push_back(std::move(o));
+      }
+      order_.swap(kept);
+    }
+  }
+
+  void erase(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mu_);
+    map_.erase(key);
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return map_.size();
+  }
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+private:
+  using Clock = std::chrono::steady_clock;
+  struct Entry {
+    ValueRef value;
+    Clock::time_point expires;
+    uint64_t seq;
+  };
+
+  size_t capacity_;
+  std::chrono::milliseconds ttl_;
+  uint8_t min_hits_;
+  mutable std::mutex mu_;
+  std::unordered_map<std::string, Entry> map_;
+  std::deque<std::pair<std::string, uint64_t>> order_;   // FIFO of (key, seq)
+  uint64_t seq_ = 0;
+  policy_detail::FrequencySketch sketch_;
+  std::atomic<uint64_t> hits_{0};
+};
+
+// Cluster membership and forwarding. Every node is given the same static
+// node list, so all of them compute the same owner for a key; requests for
+// keys owned elsewhere are proxied to the owner over pooled keep-alive
+// connections. Forwarded requests carry kForwardedHeader and are always
+// served where they land, so nodes with different lists cannot loop.
+class Cluster {
+public:
+  static constexpr const char* kForwardedHeader = "X-Geocache-Forwarded";
+
+  explicit Cluster(ClusterConfig cfg)
+    : cfg_(std::move(cfg)), ring_(cfg_.nodes, cfg_.vnodes),
+      near_(cfg_.near_items, cfg_.near_ttl, cfg_.near_min_hits) {
+    auto it = std::find(cfg_.nodes.begin(), cfg_.nodes.end(), cfg_.self);
+    self_ = it == cfg_.nodes.end() ? SIZE_MAX : size_t(it - cfg_.nodes.begin());
+    for (size_t i = 0; i < cfg_.nodes.size(); ++i) peers_.push_back(std::make_unique<Peer>());
+    auto& m = Metrics::instance();
+    m.register_gauge("cache_cluster_nodes", "Nodes on the consistent-hash ring",
+                     [this] { return double(cfg_.nodes.size()); });
+    m.register_gauge("cache_cluster_forwarded_total", "Requests proxied to the owning node",
+                     [this] { return double(forwarded_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_cluster_forward_errors_total", "Forwarded requests that got no answer from the owner",
+                     [this] { return double(errors_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_cluster_near_entries", "Remote values held in the near-cache",
+                     [this] { return double(near_.size()); });
+    m.register_gauge("cache_cluster_near_hits_total", "Requests for remote keys served from the near-cache",
+                     [this] { return double(near_.hits()); }, "counter");
+  }
+
+  // False if self is not one of the nodes
+  bool ok() const { return self_ != SIZE_MAX; }
+  size_t size() const { return cfg_.nodes.size(); }
+  const std::string& node(size_t i) const { return cfg_.nodes[i]; }
+  size_t self() const { return self_; }
+
+  size_t owner(std::string_view key) const { return ring_.owner(key); }
+
+  // True if req should be served here: this node owns key, or another node
+  // already forwarded it
+  bool serves(const httplib::Request& req, std::string_view key) const {
+    return owner(key) == self_ || req.has_header(kForwardedHeader);
+  }
+
+  // Indices of keys owned by other nodes, grouped by owner
+  std::unordered_map<size_t, std::vector<size_t>> remote_groups(const std::vector<std::string>& keys) const {
+    std::unordered_map<size_t, std::vector<size_t>> out;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      const size_t o = owner(keys[i]);
+      if (o != self_) out[o].push_back(i);
+    }
+    return out;
+  }
+
+  NearCache& near() { return near_; }
+
+  // One request to node i; an empty Result if it could not be reached
+  httplib::Result send(size_t i, const std::string& method, const std::string& target,
+                       const std::string& body = {}, const std::string& content_type = {},
+                       httplib::Headers headers = {}) {
+    headers.emplace(kForwardedHeader, cfg_.self);
+    auto cli = acquire(i);
+    const auto t0 = std::chrono::steady_clock::now();
+    httplib::Result res;
+    if (method == "GET") res = cli->Get(target, headers);
+    else if (method == "PUT") res = cli->Put(target, headers, body, content_type);
+    else res = cli->Post(target, headers, body, content_type);
+    Metrics::instance().peer_rtt().record_since(t0);
+    forwarded_.fetch_add(1, std::memory_order_relaxed);
+    if (!res) errors_.fetch_add(1, std::memory_order_relaxed);
+    release(i, std::move(cli), bool(res));
+    return res;
+  }
+
+  // Forwards req as received to node i and copies the answer into res;
+  // false (res untouched) if the node could not be reached
+  bool proxy(size_t i, const httplib::Request& req, httplib::Response& res) {
+    httplib::Headers headers;
+    if (req.has_header("Accept-Encoding")) headers.emplace("Accept-Encoding", req.get_header_value("Accept-Encoding"));
+    auto r = send(i, req.method, httplib::append_query_params(req.path, req.params), req.body,
+                  req.get_header_value("Content-Type"), std::move(headers));
+    if (!r) return false;
+    res.status = r->status;
+    for (const char* h : {"X-Cache", "Content-Encoding", "Vary"})
+      if (r->has_header(h)) res.set_header(h, r->get_header_value(h));
+    res.set_header("X-Cache-Node", cfg_.nodes[i]);
+    res.set_content(std::move(r->body), r->get_header_value("Content-Type"));
+    return true;
+  }
+
+private:
+  struct Peer {
+    std::mutex mu;
+    std::vector<std::unique_ptr<httplib::Client>> idle;
+  };
+
+  std::unique_ptr<httplib::Client> acquire(size_t i) {
+    Peer& p = *peers_[i];
+    {
+      std::lock_guard<std::mutex> lock(p.mu);
+      if (!p.idle.empty()) {
+        auto c = std::move(p.idle.back());
+        p.idle.pop_back();
+        return c;
+      }
+    }
+    auto c = std::make_unique<httplib::Client>("http://" + cfg_.nodes[i]);
+    c->set_keep_alive(true);
+    c->set_tcp_nodelay(true);
+    c->set_decompress(false);   // bodies are relayed with their Content-Encoding
+    c->set_connection_timeout(cfg_.timeout);
+    c->set_read_timeout(cfg_.timeout);
+    c->set_write_timeout(cfg_.timeout);
+    return c;
+  }
+
+  void release(size_t i, std::unique_ptr<httplib::Client> c, bool healthy) {
+    Peer& p = *peers_[i];
+    std::lock_guard<std::mutex> lock(p.mu);
+    if (healthy && p.idle.size() < cfg_.max_idle) p.idle.push_back(std::move(c));
+  }
+
+  ClusterConfig cfg_;
+  HashRing ring_;
+  NearCache near_;
+  size_t self_ = SIZE_MAX;
+  std::vector<std::unique_ptr<Peer>> peers_;
+  std::atomic<uint64_t> forwarded_{0}, errors_{0};
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+
+#include "metrics.hpp"
+#include "value_buffer.hpp"
+
+// Optional compression of large values. A value at or above min_bytes is
+// gzipped (zlib, fast level) before it is stored, and kept compressed only
+// if that saves enough: stored <= raw * max_ratio. The compressed bytes are
+// what the byte budget charges. Values that already look compressed (gzip,
+// zip, PNG, JPEG) are not tried.
+struct CompressionConfig {
+  size_t min_bytes = 0;     // 0 = off
+  double max_ratio = 0.8;
+  int level = 1;
+
+  bool enabled() const { return min_bytes > 0; }
+};
+
+namespace compression {
+
+namespace detail {
+
+// One deflate and one inflate stream per thread, reset between values, so
+// zlib's window and hash tables are allocated once rather than per value
+struct Deflater {
+  z_stream zs{};
+  int level = -2;
+  bool ok = false;
+  ~Deflater() { if (ok) deflateEnd(&zs); }
+
+  bool reset(int lvl) {
+    if (ok && lvl == level) return deflateReset(&zs) == Z_OK;
+    if (ok) deflateEnd(&zs);
+    zs = z_stream{};
+    // 15 + 16: gzip wrapper, so the output is a valid HTTP gzip body
+    ok = deflateInit2(&zs, lvl, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    level = lvl;
+    return ok;
+  }
+};
+
+struct Inflater {
+  z_stream zs{};
+  bool ok = false;
+  ~Inflater() { if (ok) inflateEnd(&zs); }
+
+  bool reset() {
+    if (ok) return inflateReset(&zs) == Z_OK;
+    ok = inflateInit2(&zs, 15 + 16) == Z_OK;
+    return ok;
+  }
+};
+
+inline bool looks_compressed(std::string_view v) {
+  if (v.size() < 4) return false;
+  const auto* b = reinterpret_cast<const unsigned char*>(v.data());
+  return (b[0] == 0x1f && b[1] == 0x8b) ||                            // gzip
+         (b[0] == 'P' && b[1] == 'K' && b[2] == 3 && b[3] == 4) ||    // zip, docx, pptx
+         (b[0] == 0x89 && b[1] == 'P' && b[2] == 'N' && b[3] == 'G') ||
+         (b[0] == 0xff && b[1] == 0xd8 && b[2] == 0xff);              // JPEG
+}
+
+}  // namespace detail
+
+// Uncompressed length of a stored value (the gzip trailer's ISIZE)
+inline size_t decoded_size(const ValueRef& v) {
+  if (v.encoding() != ValueEncoding::Gzip || v.size() < 18) return v.size();
+  uint32_t n;
+  std::memcpy(&n, v.data() + v.size() - 4, 4);
+  return n;
+}
+
+// The value as stored in the cache: gzipped when enabled and worthwhile,
+// otherwise v itself
+inline ValueRef compress(ValueRef v, const CompressionConfig& cfg) {
+  if (!cfg.enabled() || v.size() < cfg.min_bytes || v.encoding() != ValueEncoding::Identity ||
+      v.size() > UINT32_MAX || detail::looks_compressed(v.view()))
+    return v;
+  const auto t0 = std::chrono::steady_clock::now();
+  thread_local detail::Deflater d;
+  // deflate into a value block capped at the break-even size; running out
+  // of room means the value is not worth keeping compressed. The block is
+  // freed after the exact-size copy, so no thread keeps a scratch buffer
+  // as large as the largest value it compressed.
+  const size_t limit = static_cast<size_t>(static_cast<double>(v.size()) * cfg.max_ratio);
+  bool kept = false;
+  ValueRef scratch;
+  if (limit > 0 && d.reset(cfg.level)) {
+    char* dst = nullptr;
+    scratch = ValueRef::allocate(limit, &dst, ValueEncoding::Gzip);
+    d.zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(v.data()));
+    d.zs.avail_in = static_cast<uInt>(v.size());
+    d.zs.next_out = reinterpret_cast<Bytef*>(dst);
+    d.zs.avail_out = static_cast<uInt>(limit);
+    kept = deflate(&d.zs, Z_FINISH) == Z_STREAM_END;
+  }
+  ValueRef stored = kept ? ValueRef::copy_of(scratch.view().substr(0, d.zs.total_out), ValueEncoding::Gzip)
+                         : std::move(v);
+  auto& m = Metrics::instance();
+  m.compress_latency().record_since(t0);
+  m.observe_compression(kept, kept ? decoded_size(stored) : stored.size(), stored.size());
+  return stored;
+}
+
+// Identity bytes of a stored value; empty if a gzip value is corrupt
+inline ValueRef decode(ValueRef v) {
+  if (v.encoding() != ValueEncoding::Gzip) return v;
+  const auto t0 = std::chrono::steady_clock::now();
+  thread_local detail::Inflater in;
+  const size_t n = decoded_size(v);
+  char* dst = nullptr;
+  ValueRef out = ValueRef::allocate(n, &dst);
+  bool ok = in.reset();
+  if (ok) {
+    in.zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(v.data()));
+    in.zs.avail_in = static_cast<uInt>(v.size());
+    in.zs.next_out = reinterpret_cast<Bytef*>(dst);
+    in.zs.avail_out = static_cast<uInt>(n);
+    ok = inflate(&in.zs, Z_FINISH) == Z_STREAM_END && in.zs.total_out == n;
+  }
+  Metrics::instance().decompress_latency().record_since(t0);
+  return ok ? out : ValueRef();
+}
+
+}  // namespace compression
@@ -0,0 +1,265 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "value_buffer.hpp"
+
+// Key bytes stored in place when short (the common case for cache keys),
+// otherwise in one exact-size heap block. 32 bytes, no SSO capacity slack.
+class CompactKey {
+public:
+  static constexpr size_t kInline = 28;
+
+  CompactKey() = default;
+  CompactKey(const CompactKey&) = delete;
+  CompactKey& operator=(const CompactKey&) = delete;
+  ~CompactKey() { clear(); }
+
+  void assign(std::string_view k) {
+    clear();
+    len_ = static_cast<uint32_t>(k.size());
+    if (k.size() <= kInline) {
+      std::memcpy(buf_, k.data(), k.size());
+    } else {
+      char* p = static_cast<char*>(::operator new(k.size()));
+      std::memcpy(p, k.data(), k.size());
+      std::memcpy(buf_, &p, sizeof(p));
+    }
+  }
+
+  void clear() {
+    if (len_ > kInline) ::operator delete(heap());
+    len_ = 0;
+  }
+
+  std::string_view view() const { return {len_ > kInline ? heap() : buf_, len_}; }
+
+  // bytes held outside the node
+  static size_t heap_bytes(size_t len) { return len > kInline ? len : 0; }
+
+private:
+  char* heap() const { char* p; std::memcpy(&p, buf_, sizeof(p)); return p; }
+
+  char buf_[kInline];
+  uint32_t len_ = 0;
+};
+static_assert(sizeof(CompactKey) == 32, "CompactKey should stay half a cache line");
+
+// Cache entries in pooled, intrusively linked nodes plus a flat
+// open-addressing index (SwissTable-style): a control byte per slot holds 7
+// bits of the key hash, and a lookup compares 16 control bytes at once before
+// touching any node. Each node caches its full hash, so rehashing and most
+// mismatches never read key bytes. Nodes live in fixed chunks and are never
+// moved, and recency is a doubly linked list threaded through them, so an
+// entry costs no allocation beyond its pool slot (and long keys).
+class EntryTable {
+public:
+  static constexpr uint32_t kNil = UINT32_MAX;
+
+  struct Node {
+    uint64_t   hash = 0;
+    uint32_t   prev = kNil, next = kNil;   // recency: head = most recent; next also links free nodes
+    uint32_t   slot = kNil;                // index slot pointing here
+    uint32_t   expires = 0;                // fresh-until tick for the owner (0 = never)
+    CompactKey key;
+    ValueRef   value;
+  };
+
+  // Per-entry cost outside the value: node plus its index slot and control
+  // byte at the minimum load factor after a resize (7/16)
+  static constexpr size_t kEntryOverhead = sizeof(Node) + (sizeof(uint32_t) + 1) * 16 / 7;
+
+  static uint64_t hash_key(std::string_view k) {
+    uint64_t h = std::hash<std::string_view>{}(k);
+    // std::hash may be weak in the low/high bits the index uses
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // The fingerprint comes from the top bits and the group from the bottom
+  // ones, so neither repeats the other (or a shard choice made from h)
+  static uint8_t h2(uint64_t hash) { return static_cast<uint8_t>(hash >> 57); }
+
+  EntryTable() { reset_index(kGroup); }
+
+  size_t size() const { return size_; }
+
+  Node& node(uint32_t id) { return chunks_[id >> kChunkShift][id & kChunkMask]; }
+  const Node& node(uint32_t id) const { return chunks_[id >> kChunkShift][id & kChunkMask]; }
+
+  uint32_t head() const { return head_; }
+  uint32_t tail() const { return tail_; }
+
+  uint32_t find(std::string_view key, uint64_t hash) const {
+    const uint8_t fp = h2(hash);
+    size_t g = hash & group_mask_;
+    for (size_t step = 1;; ++step) {
+      const uint8_t* ctrl = &ctrl_[g * kGroup];
+      for (uint32_t bits = match(ctrl, fp); bits; bits &= bits - 1) {
+        const uint32_t id = slots_[g * kGroup + static_cast<size_t>(__builtin_ctz(bits))];
+        const Node& n = node(id);
+        if (n.hash == hash && n.key.view() == key) return id;
+      }
+      if (match(ctrl, kEmpty)) return kNil;
+      g = (g + step) & group_mask_;   // triangular probing visits every group
+    }
+  }
+
+  // Key must be absent. The new entry becomes the most recent.
+  uint32_t insert(std::string_view key, uint64_t hash, ValueRef value) {
+    if (growth_left_ == 0) rehash(size_ * 2 >= capacity() * 7 / 16 ? capacity() * 2 : capacity());
+    const uint32_t id = alloc_node();
+    Node& n = node(id);
+    n.hash = hash;
+    n.expires = 0;
+    n.key.assign(key);
+    n.value = std::move(value);
+    place(id);
+    link_front(id);
+    ++size_;
+    return id;
+  }
+
+  void erase(uint32_t id) {
+    Node& n = node(id);
+    const size_t g = n.slot / kGroup;
+    // a slot may become empty only if probes could not have continued past
+    // its group, i.e. the group already has an empty slot
+    if (match(&ctrl_[g * kGroup], kEmpty)) { ctrl_[n.slot] = kEmpty; ++growth_left_; }
+    else ctrl_[n.slot] = kDeleted;
+    unlink(id);
+    n.key.clear();
+    n.value.reset();
+    n.slot = kNil;
+    n.next = free_;
+    free_ = id;
+    --size_;
+  }
+
+  void move_to_front(uint32_t id) {
+    if (head_ == id) return;
+    unlink(id);
+    link_front(id);
+  }
+
+  // nodes, index and control bytes currently allocated (not counting values
+  // or long keys)
+  size_t table_bytes() const {
+    return chunks_.size() * kChunk * sizeof(Node) + slots_.size() * sizeof(uint32_t) + ctrl_.size();
+  }
+
+private:
+  static constexpr size_t kGroup = 16;
+  static constexpr uint32_t kChunkShift = 10;
+  static constexpr size_t kChunk = size_t{1} << kChunkShift;
+  static constexpr uint32_t kChunkMask = kChunk - 1;
+  static constexpr uint8_t kEmpty = 0x80;
+  static constexpr uint8_t kDeleted = 0xfe;
+
+  size_t capacity() const { return ctrl_.size(); }
+
+  // bit i set if ctrl[i] == b
+  static uint32_t match(const uint8_t* ctrl, uint8_t b) {
+#if defined(__SSE2__)
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(static_cast<char>(b)))));
+#else
+    uint32_t bits = 0;
+    for (size_t i = 0; i < kGroup; ++i) bits |= uint32_t(ctrl[i] == b) << i;
+    return bits;
+#endif
+  }
+
+  // bit i set if slot i is empty or deleted (control byte has its top bit)
+  static uint32_t match_free(const uint8_t* ctrl) {
+#if defined(__SSE2__)
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))));
+#else
+    uint32_t bits = 0;
+    for (size_t i = 0; i < kGroup; ++i) bits |= uint32_t(ctrl[i] >> 7) << i;
+    return bits;
+#endif
+  }
+
+  void place(uint32_t id) {
+    Node& n = node(id);
+    size_t g = n.hash & group_mask_;
+    for (size_t step = 1;; ++step) {
+      if (uint32_t bits = match_free(&ctrl_[g * kGroup])) {
+        const size_t slot = g * kGroup + static_cast<size_t>(__builtin_ctz(bits));
+        if (ctrl_[slot] == kEmpty) --growth_left_;
+        ctrl_[slot] = h2(n.hash);
+        slots_[slot] = id;
+        n.slot = static_cast<uint32_t>(slot);
+        return;
+      }
+      g = (g + step) & group_mask_;
+    }
+  }
+
+  void reset_index(size_t cap) {
+    ctrl_.assign(cap, kEmpty);
+    slots_.assign(cap, kNil);
+    group_mask_ = cap / kGroup - 1;
+    growth_left_ = cap * 7 / 8 - size_;
+  }
+
+  // grow (or just drop tombstones) and re-place every node by its cached hash
+  void rehash(size_t cap) {
+    const size_t n = size_;
+    size_ = 0;
+    reset_index(cap);
+    for (uint32_t id = head_; id != kNil; id = node(id).next) place(id);
+    size_ = n;
+    growth_left_ = cap * 7 / 8 - n;
+  }
+
+  uint32_t alloc_node() {
+    if (free_ != kNil) {
+      const uint32_t id = free_;
+      free_ = node(id).next;
+      return id;
+    }
+    if (next_fresh_ == chunks_.size() * kChunk) chunks_.push_back(std::make_unique<Node[]>(kChunk));
+    return static_cast<uint32_t>(next_fresh_++);
+  }
+
+  void link_front(uint32_t id) {
+    Node& n = node(id);
+    n.prev = kNil;
+    n.next = head_;
+    if (head_ != kNil) node(head_).prev = id;
+    head_ = id;
+    if (tail_ == kNil) tail_ = id;
+  }
+
+  void unlink(uint32_t id) {
+    Node& n = node(id);
+    if (n.prev != kNil) node(n.prev).next = n.next; else head_ = n.next;
+    if (n.next != kNil) node(n.next).prev = n.prev; else tail_ = n.prev;
+    n.prev = n.next = kNil;
+  }
+
+  std::vector<std::unique_ptr<Node[]>> chunks_;
+  size_t next_fresh_ = 0;
+  uint32_t free_ = kNil;
+  uint32_t head_ = kNil, tail_ = kNil;
+  size_t size_ = 0;
+
+  std::vector<uint8_t>  ctrl_;
+  std::vector<uint32_t> slots_;
+  size_t group_mask_ = 0;
+  size_t growth_left_ = 0;
+};
@@ -7,8 +7,10 @@
 #include <memory>
 #include <utility>
 #include <cstdint>
+#include <mutex>
 
 #include "key_stats.hpp"
+#include "metrics.hpp"
 #include "../third_party/httplib.h"
 #include "../third_party/json.hpp"
 
@@ -19,15 +21,84 @@ struct EvictionStrategy {
   virtual ~EvictionStrategy() = default;
   virtual std::optional<std::string>
   choose_victim(const std::vector<std::string>& candidates) = 0;
+
+  // Batch scoring for the async eviction engine: one reuse probability per
+  // candidate (same order), or nullopt if scoring is unavailable.
+  virtual bool supports_batch_scoring() const { return false; }
+  virtual std::optional<std::vector<double>>
+  score_batch(const std::vector<std::string>& /*candidates*/) { return std::nullopt; }
+
+  // Policies that keep their own per-key metadata and order (see
+  // policies.hpp). The cache reports every lookup, insert and removal under
+  // its lock and asks victim() instead of choose_victim(). victim() may
+  // reorder internally but must leave the returned key tracked until
+  // on_remove(); returning the key just inserted rejects its admission.
+  virtual bool tracks_entries() const { return false; }
+  virtual void on_access(const std::string& /*key*/, bool /*hit*/) {}
+  // new key, or an existing key rewritten with a new weight
+  virtual void on_insert(const std::string& /*key*/, size_t /*weight*/) {}
+  virtual void on_remove(const std::string& /*key*/, bool /*evicted*/) {}
+  virtual std::optional<std::string> victim() { return std::nullopt; }
+
+  virtual const char* name() const { return "custom"; }
+};
+
+// Model inputs for one eviction candidate (same columns as the sidecar's /score)
+struct CandidateFeatures {
+  std::uint64_t recency_us    = 0;
+  std::uint64_t access_count  = 0;
+  std::uint64_t size_bytes    = 0;
+  std::uint64_t fetch_cost_ms = 50;
 };
 
+// Features of a key with stats st (nullptr if it has none) at time now_us
+inline CandidateFeatures features_of(const KeyStats* st, std::uint64_t now_us) {
+  CandidateFeatures f;
+  std::uint64_t last = 0;
+  if (st) {
+    f.access_count  = st->access_count;
+    f.size_bytes    = st->size_bytes;
+    f.fetch_cost_ms = st->fetch_cost_ms;
+    last = st->last_access_us;
+  }
+  f.recency_us = (last == 0) ? static_cast<std::uint64_t>(1000000000000ULL) : (now_us - last);
+  return f;
+}
+
+inline std::vector<CandidateFeatures>
+collect_features(const std::vector<std::string>& candidates) {
+  using namespace std::chrono;
+  auto snap = KeyStatsStore::instance().snapshot_of(candidates);
+  const std::uint64_t now_us =
+    duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+
+  std::vector<CandidateFeatures> out(candidates.size());
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    auto it = snap.find(candidates[i]);
+    out[i] = features_of(it != snap.end() ? &it->second : nullptr, now_us);
+  }
+  return out;
+}
+
+// Lowest score wins; shared by strategies that rank by reuse probability
+inline std::optional<std::string>
+lowest_scored(const std::vector<std::string>& candidates, const std::vector<double>& probs) {
+  double best = 1e9;
+  std::optional<std::string> victim;
+  for (size_t i = 0; i < candidates.size() && i < probs.size(); ++i) {
+    if (probs[i] < best) { best = probs[i]; victim = candidates[i]; }
+  }
+  return victim;
+}
+
 // Pure LRU fallback
 struct LRUStrategy : EvictionStrategy {
   std::optional<std::string>
   choose_victim(const std::vector<std::string>& candidates) override {
     if (candidates.empty()) return std::nullopt;
-    return candidates.back();
+    return candidates.front();   // candidates run oldest first
   }
+  const char* name() const override { return "LRU"; }
 };
 
 // ML-driven eviction (calls FastAPI sidecar /score)
@@ -39,73 +110,86 @@ struct MLEvictionStrategy : EvictionStrategy {
   explicit MLEvictionStrategy(std::string h = "127.0.0.1", int p = 5000)
   : host(std::move(h)), port(p) {}
 
+  bool supports_batch_scoring() const override { return true; }
+  const char* name() const override { return "ML"; }
+
   std::optional<std::string>
   choose_victim(const std::vector<std::string>& candidates) override {
+    auto probs = score_batch(candidates);
+    if (!probs) return std::nullopt; // caller falls back to LRU
+    return lowest_scored(candidates, *probs);
+  }
+
+  std::optional<std::vector<double>>
+  score_batch(const std::vector<std::string>& candidates) override {
     if (candidates.empty()) return std::nullopt;
 
     // Build feature payload
-    auto snap = KeyStatsStore::instance().snapshot_of(candidates);
+    auto feats = collect_features(candidates);
     json payload = json::array();
-    const std::uint64_t now_us = nowMicros();
-
-    for (const auto& k : candidates) {
-      auto it = snap.find(k);
-      std::uint64_t access = 0, last = 0, size = 0, cost = 50;
-      if (it != snap.end()) {
-        access = it->second.access_count;
-        last   = it->second.last_access_us;
-        size   = it->second.size_bytes;
-        cost   = it->second.fetch_cost_ms;
-      }
-      const std::uint64_t recency =
-          (last == 0) ? static_cast<std::uint64_t>(1000000000000ULL) : (now_us - last);
-
+    for (size_t i = 0; i < candidates.size(); ++i) {
       payload.push_back({
-        {"key", k},
-        {"recency_us",    recency},
-        {"access_count",  access},
-        {"size_bytes",    size},
-        {"fetch_cost_ms", cost}
+        {"key", candidates[i]},
+        {"recency_us",    feats[i].recency_us},
+        {"access_count",  feats[i].access_count},
+        {"size_bytes",    feats[i].size_bytes},
+        {"fetch_cost_ms", feats[i].fetch_cost_ms}
       });
     }
 
     try {
-      httplib::Client cli(host, port);
-
-      // Use chrono-based overloads to avoid overload ambiguity in some setups
-      using namespace std::chrono;
-      const auto to = milliseconds(timeout_ms);
-      cli.set_connection_timeout(to);
-      cli.set_read_timeout(to);
-      cli.set_write_timeout(to);
-
+      std::lock_guard<std::mutex> lock(cli_mu_);
+      auto& cli = client_unlocked();
+      const auto t0 = std::chrono::steady_clock::now();
       auto res = cli.Post("/score", payload.dump(), "application/json");
+      Metrics::instance().sidecar_rtt().record_since(t0);
       if (!res || res->status != 200) {
-        // Sidecar unreachable or error → decline so caller falls back to LRU
+        // Sidecar unreachable or error → drop the connection and decline
+        cli_.reset();
+        Metrics::instance().inc_sidecar_fallbacks();
         return std::nullopt;
       }
 
       auto resp = json::parse(res->body);
-      double best = 1e9;
-      std::optional<std::string> victim;
-
+      std::unordered_map<std::string, double> by_key;
       for (const auto& row : resp) {
-        const std::string key   = row.value("key", "");
-        const double      reuse = row.value("reuse_prob", 0.0);
-        if (key.empty()) continue;
-        if (reuse < best) { best = reuse; victim = key; }
+        const std::string key = row.value("key", "");
+        if (!key.empty()) by_key[key] = row.value("reuse_prob", 0.0);
+      }
+      if (by_key.empty()) { Metrics::instance().inc_sidecar_fallbacks(); return std::nullopt; }
+
+      // Unscored keys rank as likely reused so they are never preferred
+      std::vector<double> out;
+      out.reserve(candidates.size());
+      for (const auto& k : candidates) {
+        auto it = by_key.find(k);
+        out.push_back(it == by_key.end() ? 1.0 : it->second);
       }
-      return victim; // may still be nullopt if response empty
+      return out;
     } catch (...) {
+      Metrics::instance().inc_sidecar_fallbacks();
       return std::nullopt; // any exception → safe fallback to LRU
     }
   }
 
 private:
-  static std::uint64_t nowMicros() {
-    using namespace std::chrono;
-    return duration_cast<microseconds>(
-      steady_clock::now().time_since_epoch()).count();
+  // One keep-alive connection reused across scoring calls
+  httplib::Client& client_unlocked() {
+    if (!cli_) {
+      cli_ = std::make_unique<httplib::Client>(host, port);
+
+      // Use chrono-based overloads to avoid overload ambiguity in some setups
+      using namespace std::chrono;
+      const auto to = milliseconds(timeout_ms);
+      cli_->set_connection_timeout(to);
+      cli_->set_read_timeout(to);
+      cli_->set_write_timeout(to);
+      cli_->set_keep_alive(true);
+    }
+    return *cli_;
   }
+
+  std::mutex cli_mu_;
+  std::unique_ptr<httplib::Client> cli_;
 };
 
@@ -0,0 +1,168 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <vector>
+
+#include "eviction.hpp"
+#include "metrics.hpp"
+
+struct EvictionEngineConfig {
+  size_t batch_size    = 32;  // tail candidates scored per refill
+  size_t pool_target   = 16;  // pre-scored victims kept ready
+  size_t low_watermark = 4;   // refill once the pool drops below this
+  std::chrono::milliseconds refresh{250};         // rescore cadence while evicting
+  std::chrono::milliseconds max_victim_age{2000}; // older scores are discarded
+};
+
+// Keeps a small pool of victims scored off the cache lock. The cache pops
+// from the pool in O(1) during put; a background thread refills it in
+// batches through the strategy's score_batch().
+class AsyncEvictionEngine {
+public:
+  // Returns up to n keys from the LRU tail (oldest first). Takes the cache lock.
+  using CandidateSource = std::function<std::vector<std::string>(size_t)>;
+
+  AsyncEvictionEngine(std::shared_ptr<EvictionStrategy> strategy,
+                      CandidateSource source,
+                      EvictionEngineConfig cfg = {})
+    : strategy_(std::move(strategy)), source_(std::move(source)), cfg_(cfg) {
+    worker_ = std::thread([this] { run(); });
+  }
+
+  ~AsyncEvictionEngine() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mu_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    if (worker_.joinable()) worker_.join();
+  }
+
+  AsyncEvictionEngine(const AsyncEvictionEngine&) = delete;
+  AsyncEvictionEngine& operator=(const AsyncEvictionEngine&) = delete;
+
+  struct PooledVictim {
+    std::string key;
+    uint64_t age_us; // time since the victim was scored
+  };
+
+  // Never blocks on scoring; nullopt means the caller should fall back to LRU.
+  std::optional<PooledVictim> pop_victim() {
+    std::optional<PooledVictim> out;
+    bool low = false;
+    {
+      std::lock_guard<std::mutex> lock(pool_mu_);
+      const auto now = Clock::now();
+      while (!pool_.empty()) {
+        Victim v = std::move(pool_.front());
+        pool_.pop_front();
+        if (now - v.scored_at > cfg_.max_victim_age) continue;
+        out = PooledVictim{std::move(v.key), static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(now - v.scored_at).count())};
+        break;
+      }
+      consumed_ = true;
+      low = pool_.size() < cfg_.low_watermark;
+    }
+    if (low) wake();
+    return out;
+  }
+
+  size_t pool_size() const {
+    std::lock_guard<std::mutex> lock(pool_mu_);
+    return pool_.size();
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Victim {
+    std::string key;
+    Clock::time_point scored_at;
+  };
+
+  void wake() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mu_);
+      wake_ = true;
+    }
+    cv_.notify_one();
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(wake_mu_);
+    while (!stop_) {
+      cv_.wait_for(lock, cfg_.refresh, [this] { return stop_ || wake_; });
+      if (stop_) break;
+      const bool woken = wake_;
+      wake_ = false;
+
+      bool consumed;
+      {
+        std::lock_guard<std::mutex> pl(pool_mu_);
+        consumed = consumed_;
+      }
+      // Idle caches are left alone; only refresh while evictions happen
+      if (!woken && !consumed) continue;
+
+      lock.unlock();
+      refill();
+      lock.lock();
+    }
+  }
+
+  void refill() {
+    const auto t0 = Clock::now();
+    auto candidates = source_(cfg_.batch_size);
+    if (candidates.empty()) return;
+
+    auto probs = strategy_->score_batch(candidates);
+    if (!probs || probs->size() != candidates.size()) {
+      Metrics::instance().inc_scoring_failures();
+      return;
+    }
+
+    // Lowest reuse probability first
+    std::vector<size_t> order(candidates.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return (*probs)[a] < (*probs)[b]; });
+
+    const auto now = Clock::now();
+    std::deque<Victim> fresh;
+    for (size_t i = 0; i < order.size() && fresh.size() < cfg_.pool_target; ++i) {
+      fresh.push_back({std::move(candidates[order[i]]), now});
+    }
+    {
+      std::lock_guard<std::mutex> lock(pool_mu_);
+      pool_.swap(fresh);
+      consumed_ = false;
+    }
+    Metrics::instance().observe_scoring_batch_us(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(now - t0).count()));
+  }
+
+  std::shared_ptr<EvictionStrategy> strategy_;
+  CandidateSource source_;
+  EvictionEngineConfig cfg_;
+
+  mutable std::mutex pool_mu_;
+  std::deque<Victim> pool_;
+  bool consumed_ = false;
+
+  std::mutex wake_mu_;
+  std::condition_variable cv_;
+  bool wake_ = false;
+  bool stop_ = false;
+
+  std::thread worker_;
+};
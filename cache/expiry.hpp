@@ -0,0 +1,199 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Per-entry lifetime. A zero ttl never expires. For `stale` past the ttl the
+// entry is still served, marked stale, and one reader is told to refresh it.
+struct Expiry {
+  std::chrono::milliseconds ttl{0};
+  std::chrono::milliseconds stale{0};
+
+  bool enabled() const { return ttl.count() > 0; }
+};
+
+enum class Freshness : uint8_t {
+  Fresh,
+  Stale,        // past its ttl, inside the stale window
+  Revalidate,   // stale, and this caller claimed its refresh (once per entry)
+};
+
+// Expiry time in 100 ms ticks since first use. Tick 0 is never a deadline,
+// so 0 can mean "no expiry".
+struct ExpiryClock {
+  static constexpr std::chrono::milliseconds kTick{100};
+
+  static uint32_t now() {
+    static const auto epoch = std::chrono::steady_clock::now() - kTick;
+    return static_cast<uint32_t>((std::chrono::steady_clock::now() - epoch) / kTick);
+  }
+  // first tick at or after now + d
+  static uint32_t after(std::chrono::milliseconds d) {
+    return now() + static_cast<uint32_t>((d + kTick - std::chrono::milliseconds(1)) / kTick);
+  }
+};
+
+// Hierarchical timer wheel over cache node ids (Varghese & Lauck): four
+// levels of 64 slots cover 2^24 ticks (~19 days); a timer sits on the level
+// of the highest bit in which its deadline differs from the current tick and
+// cascades down as the wheel turns, so scheduling, cancelling and expiring
+// are O(1) amortized and nothing ever scans the cache. Timers further out
+// are parked on the top level and re-placed when it cascades. Not
+// thread-safe; LruCache drives it under its lock.
+class TimerWheel {
+public:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  explicit TimerWheel(uint32_t now = ExpiryClock::now()) : now_(now) {
+    heads_.fill(kNone);
+  }
+
+  size_t size() const { return size_; }
+  uint32_t now() const { return now_; }
+
+  bool scheduled(uint32_t id) const { return id < timers_.size() && timers_[id].slot != kNoSlot; }
+  uint32_t deadline(uint32_t id) const { return timers_[id].deadline; }
+
+  // per-timer flag for the caller (stale-while-revalidate claim)
+  bool flag(uint32_t id) const { return timers_[id].flag; }
+  void set_flag(uint32_t id) { timers_[id].flag = true; }
+
+  void schedule(uint32_t id, uint32_t deadline) {
+    if (id >= timers_.size()) timers_.resize(std::max<size_t>(id + 1, timers_.size() * 2));
+    cancel(id);
+    timers_[id].deadline = deadline;
+    timers_[id].flag = false;
+    place(id, now_ + 1);
+    ++size_;
+  }
+
+  void cancel(uint32_t id) {
+    if (!scheduled(id)) return;
+    unlink(id);
+    --size_;
+  }
+
+  // Turns the wheel to `now`, calling expire(id) for every timer whose
+  // deadline has passed (the timer is already removed). Returns the count.
+  template <typename Fn>
+  size_t advance(uint32_t now, Fn&& expire) {
+    size_t expired = 0;
+    if (size_ == 0) { if (now > now_) now_ = now; return 0; }
+    while (now_ < now) {
+      ++now_;
+      // cascade from the top so timers can fall through several levels
+      for (int level = kLevels - 1; level >= 1; --level) {
+        if (now_ & ((uint32_t{1} << (kBits * level)) - 1)) continue;
+        drain(level * kSlots + ((now_ >> (kBits * level)) & kMask), [&](uint32_t id) { place(id, now_); });
+      }
+      drain(now_ & kMask, [&](uint32_t id) {
+        if (timers_[id].deadline > now_) { place(id, now_ + 1); return; }   // parked far timer
+        --size_;
+        ++expired;
+        expire(id);
+      });
+      if (size_ == 0) { now_ = now; break; }
+    }
+    return expired;
+  }
+
+private:
+  static constexpr int kBits = 6;
+  static constexpr uint32_t kSlots = 1u << kBits;
+  static constexpr uint32_t kMask = kSlots - 1;
+  static constexpr int kLevels = 4;
+  static constexpr uint16_t kNoSlot = UINT16_MAX;
+
+  struct Timer {
+    uint32_t prev = kNone, next = kNone;
+    uint32_t deadline = 0;
+    uint16_t slot = kNoSlot;
+    bool flag = false;
+  };
+  static_assert(sizeof(Timer) == 16, "Timer should stay 16 bytes");
+
+  // earliest is now_ + 1 for new timers (the current tick is done) and
+  // now_ while cascading (the current level-0 slot is drained next)
+  void place(uint32_t id, uint32_t earliest) {
+    Timer& t = timers_[id];
+    // far deadlines park at the top level
+    uint32_t d = std::max(t.deadline, earliest);
+    const uint32_t span = (uint32_t{1} << (kBits * kLevels)) - 1;
+    if ((d ^ now_) > span) d = now_ | span;
+    int level = 0;
+    while (level + 1 < kLevels && (d ^ now_) >= (uint32_t{1} << (kBits * (level + 1)))) ++level;
+    const uint32_t slot = level * kSlots + ((d >> (kBits * level)) & kMask);
+    t.slot = static_cast<uint16_t>(slot);
+    t.prev = kNone;
+    t.next = heads_[slot];
+    if (t.next != kNone) timers_[t.next].prev = id;
+    heads_[slot] = id;
+  }
+
+  void unlink(uint32_t id) {
+    Timer& t = timers_[id];
+    if (t.prev != kNone) timers_[t.prev].next = t.next; else heads_[t.slot] = t.next;
+    if (t.next != kNone) timers_[t.next].prev = t.prev;
+    t.prev = t.next = kNone;
+    t.slot = kNoSlot;
+  }
+
+  // detaches a slot's list, then hands each timer (already unlinked) to fn
+  template <typename Fn>
+  void drain(uint32_t slot, Fn&& fn) {
+    uint32_t id = heads_[slot];
+    heads_[slot] = kNone;
+    while (id != kNone) {
+      Timer& t = timers_[id];
+      const uint32_t next = t.next;
+      t.prev = t.next = kNone;
+      t.slot = kNoSlot;
+      fn(id);
+      id = next;
+    }
+  }
+
+  uint32_t now_;
+  size_t size_ = 0;
+  std::array<uint32_t, kLevels * kSlots> heads_;
+  std::vector<Timer> timers_;
+};
+
+// Calls reap() every ExpiryClock tick on a background thread, so expired
+// entries leave idle caches too
+class ExpiryReaper {
+public:
+  explicit ExpiryReaper(std::function<void()> reap) : reap_(std::move(reap)) {
+    thread_ = std::thread([this] { run(); });
+  }
+  ~ExpiryReaper() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!cv_.wait_for(lock, ExpiryClock::kTick, [this] { return stop_; })) {
+      lock.unlock();
+      reap_();
+      lock.lock();
+    }
+  }
+
+  std::function<void()> reap_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread thread_;
+};
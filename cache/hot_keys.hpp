@@ -0,0 +1,316 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "expiry.hpp"
+#include "metrics.hpp"
+#include "value_buffer.hpp"
+
+struct HotKeyConfig {
+  size_t top_k = 0;                   // keys replicated at most; 0 = off
+  double min_share = 0.01;            // share of sampled lookups a key needs to be replicated
+  uint32_t sample_every = 16;         // 1 in N lookups feeds the detector
+  uint32_t touch_every = 64;          // 1 in N replica hits also refreshes the key in its shard
+  std::chrono::milliseconds refresh{100};      // replica rebuild period
+  std::chrono::milliseconds half_life{2000};   // detector counts halve this often
+
+  bool enabled() const { return top_k > 0; }
+};
+
+// Space-Saving heavy hitters (Metwally et al.) over a fixed number of
+// counters. An untracked key takes over the smallest counter and inherits
+// its count as error, so count - error never overstates a key.
+class SpaceSaving {
+public:
+  struct Counter {
+    std::string key;
+    uint64_t count = 0;
+    uint64_t error = 0;
+  };
+
+  explicit SpaceSaving(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {
+    counters_.reserve(capacity_);
+  }
+
+  void add(const std::string& key) {
+    ++total_;
+    auto it = index_.find(key);
+    if (it != index_.end()) { ++counters_[it->second].count; return; }
+    if (counters_.size() < capacity_) {
+      index_.emplace(key, counters_.size());
+      counters_.push_back(Counter{key, 1, 0});
+      return;
+    }
+    size_t m = 0;
+    for (size_t i = 1; i < counters_.size(); ++i)
+      if (counters_[i].count < counters_[m].count) m = i;
+    Counter& c = counters_[m];
+    index_.erase(c.key);
+    c.key = key;
+    c.error = c.count;
+    ++c.count;
+    index_.emplace(key, m);
+  }
+
+  // Exponential decay, so keys that cooled off fall out
+  void halve() {
+    for (auto& c : counters_) { c.count /= 2; c.error /= 2; }
+    total_ /= 2;
+  }
+
+  // Up to k counters, largest count first
+  std::vector<Counter> top(size_t k) const {
+    std::vector<Counter> out(counters_);
+    k = std::min(k, out.size());
+    std::partial_sort(out.begin(), out.begin() + k, out.end(),
+                      [](const Counter& a, const Counter& b) { return a.count > b.count; });
+    out.resize(k);
+    return out;
+  }
+
+  uint64_t total() const { return total_; }
+
+private:
+  size_t capacity_;
+  std::vector<Counter> counters_;
+  std::unordered_map<std::string, size_t> index_;
+  uint64_t total_ = 0;
+};
+
+// Read-only replica of the hottest keys. GETs look here before the shard:
+// the snapshot is immutable and published RCU-style, and every thread keeps
+// its own reference, reloaded only when the version changes, so a replica
+// hit takes no lock and writes no shared line except the value's refcount.
+// Old snapshots are freed when the last thread moves past them. Shard
+// recency is refreshed for 1 in touch_every replica hits only.
+//
+// A background thread rebuilds the replica from the detector and the
+// shards. Writers call on_write() after storing, which republishes the key
+// with its new value, also if a rebuild is in progress.
+class HotKeys {
+public:
+  // Value and expiry tick (0 = none) of a resident key, without touching it
+  using Peek = std::function<ValueRef(const std::string& key, uint32_t* expires)>;
+
+  HotKeys(HotKeyConfig cfg, Peek peek)
+    : cfg_(cfg), peek_(std::move(peek)), detector_(cfg_.top_k * 4),
+      set_(std::make_shared<const Set>()) {
+    cfg_.sample_every = std::max<uint32_t>(1, cfg_.sample_every);
+    cfg_.touch_every = std::max<uint32_t>(1, cfg_.touch_every);
+    auto& m = Metrics::instance();
+    m.register_gauge("cache_hot_keys", "Keys held in the lock-free hot-key replica",
+                     [this] { return double(replicated_.load(std::memory_order_relaxed)); });
+    m.register_gauge("cache_hot_hits_total", "GETs served from the hot-key replica (counted in batches)",
+                     [this] { return double(hits_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_hot_updates_total", "Writes that republished a key held in the hot-key replica",
+                     [this] { return double(updates_.load(std::memory_order_relaxed)); }, "counter");
+    worker_ = std::thread([this] { run(); });
+  }
+
+  ~HotKeys() {
+    {
+      std::lock_guard<std::mutex> lock(stop_mu_);
+      stop_ = true;
+    }
+    stop_cv_.notify_all();
+    worker_.join();
+  }
+
+  HotKeys(const HotKeys&) = delete;
+  HotKeys& operator=(const HotKeys&) = delete;
+
+  // Feeds 1 in sample_every lookups to the detector. A sample that finds
+  // the detector busy is dropped rather than waited for.
+  void record(const std::string& key) {
+    thread_local uint32_t tick = 0;
+    if (++tick % cfg_.sample_every) return;
+    std::unique_lock<std::mutex> lock(detector_mu_, std::try_to_lock);
+    if (lock) detector_.add(key);
+  }
+
+  // Replica value, empty if key is not hot or its ttl has passed. touch is
+  // set when this hit should also refresh the key in its shard.
+  ValueRef find(const std::string& key, bool* touch) {
+    View& v = view();
+    if (v.set->empty()) return ValueRef();
+    auto it = v.set->find(key);
+    if (it == v.set->end()) return ValueRef();
+    if (it->second.expires && ExpiryClock::now() >= it->second.expires) return ValueRef();
+    if (++v.hits == cfg_.touch_every) {
+      hits_.fetch_add(v.hits, std::memory_order_relaxed);
+      v.hits = 0;
+      *touch = true;
+    }
+    return it->second.value;
+  }
+
+  // Call after key was stored. A replicated key is re-read from its shard
+  // under mu_, so of racing writers the last one through leaves the final
+  // value; a key that is no longer resident leaves the replica.
+  void on_write(const std::string& key) {
+    // rebuilding_ is seq_cst on both sides: either the rebuild's peek sees
+    // this write, or this sees the rebuild and marks the key dirty
+    if (!rebuilding_.load() && !view().set->count(key)) return;
+    std::lock_guard<std::mutex> lock(mu_);
+    if (rebuilding_.load()) dirty_.insert(key);
+    if (!set_->count(key)) return;
+    auto next = std::make_shared<Set>(*set_);
+    reread(*next, key);
+    publish_locked(std::move(next));
+    updates_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Detector's current top keys, for /stats
+  std::vector<HotKeyStat> top() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return top_;
+  }
+
+private:
+  struct Entry {
+    ValueRef value;
+    uint32_t expires = 0;
+  };
+  using Set = std::unordered_map<std::string, Entry>;
+
+  struct View {
+    uint64_t owner = 0;
+    uint64_t version = 0;
+    std::shared_ptr<const Set> set;
+    uint32_t hits = 0;
+  };
+
+  // This thread's snapshot; the version check is the only shared read
+  View& view() {
+    thread_local View v;
+    const uint64_t version = version_.load(std::memory_order_acquire);
+    if (v.owner != id_ || v.version != version || !v.set) {
+      v.set = std::atomic_load_explicit(&set_, std::memory_order_acquire);
+      v.owner = id_;
+      v.version = version;
+    }
+    return v;
+  }
+
+  void publish_locked(std::shared_ptr<const Set> next) {
+    replicated_.store(next->size(), std::memory_order_relaxed);
+    std::atomic_store_explicit(&set_, std::move(next), std::memory_order_release);
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  void run() {
+    auto decayed = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(stop_mu_);
+    while (!stop_cv_.wait_for(lock, cfg_.refresh, [this] { return stop_; })) {
+      lock.unlock();
+      const auto now = std::chrono::steady_clock::now();
+      const bool decay = now - decayed >= cfg_.half_life;
+      if (decay) decayed = now;
+      rebuild(decay);
+      lock.lock();
+    }
+  }
+
+  void rebuild(bool decay) {
+    std::vector<SpaceSaving::Counter> top;
+    uint64_t total;
+    {
+      std::lock_guard<std::mutex> lock(detector_mu_);
+      top = detector_.top(cfg_.top_k);
+      total = detector_.total();
+      if (decay) detector_.halve();
+    }
+    // a few samples are noise, whatever their share
+    const double need = std::max(8.0, cfg_.min_share * double(total));
+
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      dirty_.clear();
+      rebuilding_.store(true);
+    }
+    auto next = std::make_shared<Set>();
+    std::vector<HotKeyStat> stats;
+    stats.reserve(top.size());
+    for (const auto& c : top) {
+      bool replicated = false;
+      if (double(c.count - c.error) >= need) {
+        uint32_t expires = 0;
+        if (auto v = peek_(c.key, &expires)) {
+          next->emplace(c.key, Entry{std::move(v), expires});
+          replicated = true;
+        }
+      }
+      stats.push_back(HotKeyStat{c.key, c.count * cfg_.sample_every, c.error * cfg_.sample_every,
+                                 total ? double(c.count) / double(total) : 0.0, replicated});
+    }
+
+    // keys written since their peek are read again
+    std::lock_guard<std::mutex> lock(mu_);
+    for (const auto& k : dirty_)
+      if (next->count(k) && !reread(*next, k))
+        for (auto& s : stats) if (s.key == k) s.replicated = false;
+    dirty_.clear();
+    if (!same(*next, *set_)) publish_locked(std::move(next));
+    rebuilding_.store(false);
+    top_ = std::move(stats);
+  }
+
+  // Replaces key's entry with the shard's current value, or drops it;
+  // false if dropped
+  bool reread(Set& set, const std::string& key) {
+    uint32_t expires = 0;
+    auto v = peek_(key, &expires);
+    if (!v) { set.erase(key); return false; }
+    set[key] = Entry{std::move(v), expires};
+    return true;
+  }
+
+  // Unchanged rebuilds are not published, so readers keep their snapshot
+  static bool same(const Set& a, const Set& b) {
+    if (a.size() != b.size()) return false;
+    for (const auto& [key, e] : a) {
+      auto it = b.find(key);
+      if (it == b.end() || it->second.value.data() != e.value.data() || it->second.expires != e.expires)
+        return false;
+    }
+    return true;
+  }
+
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> n{0};
+    return ++n;
+  }
+
+  HotKeyConfig cfg_;
+  Peek peek_;
+  const uint64_t id_ = next_id();   // tells apart instances in thread-local views
+
+  std::mutex detector_mu_;
+  SpaceSaving detector_;
+
+  mutable std::mutex mu_;   // publishing, dirty_, top_
+  std::shared_ptr<const Set> set_;
+  std::atomic<uint64_t> version_{1};
+  std::atomic<bool> rebuilding_{false};
+  std::unordered_set<std::string> dirty_;
+  std::vector<HotKeyStat> top_;
+
+  std::atomic<uint64_t> replicated_{0}, hits_{0}, updates_{0};
+
+  std::mutex stop_mu_;
+  std::condition_variable stop_cv_;
+  bool stop_ = false;
+  std::thread worker_;
+};
@@ -1,8 +1,17 @@
 #pragma once
-#include <unordered_map>
-#include <string>
-#include <mutex>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 struct KeyStats {
   uint64_t access_count = 0;
@@ -11,41 +20,185 @@ struct KeyStats {
   uint64_t fetch_cost_ms = 50;   // simulate origin cost (tunable)
 };
 
+// Per-key features for eviction scoring. Entries live only while the key is
+// cached: the cache calls forget() on removal. Keys are spread over
+// independently locked shards so touch() never takes a global lock.
+// Optionally, forgotten keys leave a bounded "ghost" whose access count
+// decays with age and is restored if the key is re-admitted.
 class KeyStatsStore {
 public:
   static KeyStatsStore& instance() { static KeyStatsStore s; return s; }
 
+  // max_keys bounds live entries (safety net if forget() is never called);
+  // ghost_capacity = 0 disables ghost history. The half-life is at least
+  // one second; zero would make the decay 0/0.
+  void configure(size_t max_keys, size_t ghost_capacity,
+                 std::chrono::seconds ghost_half_life = std::chrono::seconds(600)) {
+    ghost_half_life = std::max(ghost_half_life, std::chrono::seconds(1));
+    max_per_shard_.store(std::max<size_t>(1, max_keys / kShards), std::memory_order_relaxed);
+    ghosts_per_shard_.store(ghost_capacity / kShards + (ghost_capacity % kShards ? 1 : 0),
+                            std::memory_order_relaxed);
+    half_life_us_.store(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(ghost_half_life).count()),
+      std::memory_order_relaxed);
+  }
+
+  // Called after every touch() with the stats as that access found them
+  // (size_bytes is the accessed value's); set before serving starts
+  using AccessHook = std::function<void(const std::string& key, const KeyStats& seen, uint64_t now_us)>;
+  void set_access_hook(AccessHook hook) { access_hook_ = std::move(hook); }
+
   void touch(const std::string& key, size_t size_bytes) {
     auto now_us = nowMicros();
-    std::lock_guard<std::mutex> lock(mu_);
-    auto &st = map_[key];
-    st.access_count++;
-    st.last_access_us = now_us;
-    st.size_bytes = size_bytes;
+    KeyStats seen;
+    {
+      Shard& sh = shard(key);
+      std::lock_guard<std::mutex> lock(sh.mu);
+      auto &st = entry_unlocked(sh, key, now_us);
+      seen = st;
+      st.access_count++;
+      st.last_access_us = now_us;
+      st.size_bytes = size_bytes;
+    }
+    if (access_hook_) {
+      seen.size_bytes = size_bytes;
+      access_hook_(key, seen, now_us);
+    }
   }
 
   void set_fetch_cost_ms(const std::string& key, uint64_t cost) {
-    std::lock_guard<std::mutex> lock(mu_);
-    map_[key].fetch_cost_ms = cost;
+    Shard& sh = shard(key);
+    std::lock_guard<std::mutex> lock(sh.mu);
+    entry_unlocked(sh, key, nowMicros()).fetch_cost_ms = cost;
+  }
+
+  // Reinstate stats carried over from a snapshot (key already re-cached)
+  void restore(const std::string& key, const KeyStats& st) {
+    Shard& sh = shard(key);
+    std::lock_guard<std::mutex> lock(sh.mu);
+    entry_unlocked(sh, key, nowMicros()) = st;
+  }
+
+  // Key left the cache: drop its live stats, keeping a ghost if enabled.
+  // Returns the stats it had, if any.
+  std::optional<KeyStats> forget(const std::string& key) {
+    Shard& sh = shard(key);
+    std::lock_guard<std::mutex> lock(sh.mu);
+    auto it = sh.live.find(key);
+    if (it == sh.live.end()) return std::nullopt;
+    KeyStats st = it->second;
+    bury_unlocked(sh, it->first, it->second, nowMicros());
+    sh.live.erase(it);
+    live_.fetch_sub(1, std::memory_order_relaxed);
+    return st;
   }
 
   // snapshot a subset of keys (you’ll pass the eviction candidates here)
   std::unordered_map<std::string, KeyStats>
   snapshot_of(const std::vector<std::string>& keys) {
     std::unordered_map<std::string, KeyStats> out;
-    std::lock_guard<std::mutex> lock(mu_);
     for (auto &k : keys) {
-      auto it = map_.find(k);
-      if (it != map_.end()) out.emplace(k, it->second);
+      Shard& sh = shard(k);
+      std::lock_guard<std::mutex> lock(sh.mu);
+      auto it = sh.live.find(k);
+      if (it != sh.live.end()) out.emplace(k, it->second);
     }
     return out;
   }
 
-private:
+  size_t size() const { return live_.load(std::memory_order_relaxed); }
+  size_t ghost_size() const { return ghosts_.load(std::memory_order_relaxed); }
+  uint64_t ghost_hits() const { return ghost_hits_.load(std::memory_order_relaxed); }
+
   static uint64_t nowMicros() {
     using namespace std::chrono;
     return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
   }
-  std::mutex mu_;
-  std::unordered_map<std::string, KeyStats> map_;
+
+private:
+  static constexpr size_t kShards = 64;
+
+  struct Ghost {
+    KeyStats stats;
+    uint64_t buried_us = 0;
+    uint64_t seq = 0;        // matches the newest ghost_order entry for this key
+  };
+
+  struct alignas(64) Shard {
+    std::mutex mu;
+    std::unordered_map<std::string, KeyStats> live;
+    std::unordered_map<std::string, Ghost> ghosts;
+    std::deque<std::pair<std::string, uint64_t>> ghost_order;  // FIFO of (key, seq)
+    uint64_t next_seq = 0;
+  };
+
+  KeyStatsStore() = default;
+
+  Shard& shard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % kShards];
+  }
+
+  KeyStats& entry_unlocked(Shard& sh, const std::string& key, uint64_t now_us) {
+    auto it = sh.live.find(key);
+    if (it != sh.live.end()) return it->second;
+
+    if (sh.live.size() >= max_per_shard_.load(std::memory_order_relaxed)) {
+      // cache never told us about this one; retire an arbitrary entry
+      auto victim = sh.live.begin();
+      bury_unlocked(sh, victim->first, victim->second, now_us);
+      sh.live.erase(victim);
+      live_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    KeyStats st;
+    auto g = sh.ghosts.find(key);
+    if (g != sh.ghosts.end()) {
+      // re-admitted: keep the frequency, decayed by time spent out of cache
+      st = g->second.stats;
+      const double half_life = static_cast<double>(half_life_us_.load(std::memory_order_relaxed));
+      const double age = static_cast<double>(now_us - g->second.buried_us);
+      st.access_count = static_cast<uint64_t>(
+        static_cast<double>(st.access_count) * std::exp2(-age / half_life));
+      sh.ghosts.erase(g);
+      ghosts_.fetch_sub(1, std::memory_order_relaxed);
+      ghost_hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    live_.fetch_add(1, std::memory_order_relaxed);
+    return sh.live.emplace(key, st).first->second;
+  }
+
+  void bury_unlocked(Shard& sh, const std::string& key, const KeyStats& st, uint64_t now_us) {
+    const size_t cap = ghosts_per_shard_.load(std::memory_order_relaxed);
+    if (cap == 0) return;
+    const uint64_t seq = ++sh.next_seq;
+    auto ins = sh.ghosts.insert_or_assign(key, Ghost{st, now_us, seq});
+    if (ins.second) ghosts_.fetch_add(1, std::memory_order_relaxed);
+    sh.ghost_order.emplace_back(key, seq);
+    while (sh.ghosts.size() > cap && !sh.ghost_order.empty()) {
+      auto [k, s] = std::move(sh.ghost_order.front());
+      sh.ghost_order.pop_front();
+      auto g = sh.ghosts.find(k);
+      if (g != sh.ghosts.end() && g->second.seq == s) {
+        sh.ghosts.erase(g);
+        ghosts_.fetch_sub(1, std::memory_order_relaxed);
+      }
+    }
+    // compact order entries of ghosts that were revived or re-buried
+    if (sh.ghost_order.size() > 2 * cap + 16) {
+      std::deque<std::pair<std::string, uint64_t>> kept;
+      for (auto& e : sh.ghost_order) {
+        auto g = sh.ghosts.find(e.first);
+        if (g != sh.ghosts.end() && g->second.seq == e.second) kept.push_back(std::move(e));
+      }
+      sh.ghost_order.swap(kept);
+    }
+  }
+
+  std::array<Shard, kShards> shards_;
+  std::atomic<size_t> max_per_shard_{SIZE_MAX / kShards};
+  std::atomic<size_t> ghosts_per_shard_{0};
+  std::atomic<uint64_t> half_life_us_{600ull * 1000 * 1000};
+  std::atomic<size_t> live_{0}, ghosts_{0};
+  std::atomic<uint64_t> ghost_hits_{0};
+  AccessHook access_hook_;
 };
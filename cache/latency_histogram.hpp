@@ -0,0 +1,153 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+// Log-linear (HDR-style) latency histogram in nanoseconds: each power of two
+// is split into 16 linear sub-buckets, so any recorded value is known to
+// within 1/16 (6.25%) from 1 ns up to ~18 minutes. Writers bump relaxed
+// counters in one of kStripes cache-line-aligned stripes picked per thread,
+// so threads do not share lines; stripes are merged only at scrape time.
+class LatencyHistogram {
+public:
+  static constexpr int kSubBits = 4;
+  static constexpr uint64_t kSub = uint64_t{1} << kSubBits;
+  static constexpr int kMaxBit = 40;    // values clamp at 2^40 ns
+  static constexpr size_t kBuckets = (kMaxBit - kSubBits + 1) * kSub;
+  static constexpr size_t kStripes = 16;
+
+  static size_t bucket_of(uint64_t ns) {
+    if (ns < kSub) return static_cast<size_t>(ns);
+    const int msb = std::min(63 - __builtin_clzll(ns), kMaxBit);
+    if (msb == kMaxBit) return kBuckets - 1;
+    const int shift = msb - kSubBits;
+    return static_cast<size_t>(msb - kSubBits + 1) * kSub + ((ns >> shift) & (kSub - 1));
+  }
+  // smallest value in bucket i
+  static uint64_t lower_bound(size_t i) {
+    if (i < kSub) return i;
+    const int shift = static_cast<int>(i / kSub) - 1;
+    return (kSub + i % kSub) << shift;
+  }
+  static uint64_t upper_bound(size_t i) {
+    if (i < kSub) return i;
+    return lower_bound(i) + (uint64_t{1} << (i / kSub - 1)) - 1;
+  }
+
+  void record_ns(uint64_t ns) {
+    Stripe& s = stripes_[stripe_index()];
+    s.counts[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    s.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t m = s.max_ns.load(std::memory_order_relaxed);
+    while (ns > m && !s.max_ns.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+  }
+
+  void record_since(std::chrono::steady_clock::time_point t0) {
+    record_ns(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - t0).count()));
+  }
+
+  // Merged view of all stripes
+  struct Snapshot {
+    std::array<uint64_t, kBuckets> counts{};
+    uint64_t count = 0, sum_ns = 0, max_ns = 0;
+
+    // value at quantile q (0..1), reported as the bucket midpoint
+    uint64_t quantile_ns(double q) const {
+      if (count == 0) return 0;
+      const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(count) + 0.5));
+      uint64_t seen = 0;
+      for (size_t i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(max_ns, (lower_bound(i) + upper_bound(i)) / 2);
+      }
+      return max_ns;
+    }
+    // values <= bound_ns (bound_ns must be a bucket edge, e.g. a power of two)
+    uint64_t count_below(uint64_t bound_ns) const {
+      uint64_t n = 0;
+      for (size_t i = 0; i < kBuckets && upper_bound(i) <= bound_ns; ++i) n += counts[i];
+      return n;
+    }
+  };
+
+  Snapshot snapshot() const {
+    Snapshot out;
+    for (const auto& s : stripes_) {
+      for (size_t i = 0; i < kBuckets; ++i) {
+        const uint64_t c = s.counts[i].load(std::memory_order_relaxed);
+        out.counts[i] += c;
+        out.count += c;
+      }
+      out.sum_ns += s.sum_ns.load(std::memory_order_relaxed);
+      out.max_ns = std::max(out.max_ns, s.max_ns.load(std::memory_order_relaxed));
+    }
+    return out;
+  }
+
+  // {"count":..,"mean":..,"p50":..,...} in microseconds
+  static void write_json(std::ostream& os, const Snapshot& s) {
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    os << "{\"count\":" << s.count
+       << ",\"mean\":" << (s.count ? us(s.sum_ns) / static_cast<double>(s.count) : 0.0)
+       << ",\"p50\":" << us(s.quantile_ns(0.50))
+       << ",\"p90\":" << us(s.quantile_ns(0.90))
+       << ",\"p99\":" << us(s.quantile_ns(0.99))
+       << ",\"p999\":" << us(s.quantile_ns(0.999))
+       << ",\"max\":" << us(s.max_ns) << "}";
+  }
+
+  // Prometheus histogram in microseconds; `le` bounds are powers of two in
+  // ns (0.128 us .. ~69 s), which are exact bucket edges
+  static void write_prom(std::ostream& os, const std::string& name, const std::string& help,
+                         const Snapshot& s) {
+    char num[32];
+    auto us = [&num](uint64_t ns) {
+      std::snprintf(num, sizeof(num), "%llu.%03llu", static_cast<unsigned long long>(ns / 1000),
+                    static_cast<unsigned long long>(ns % 1000));
+      return num;
+    };
+    os << "# HELP " << name << " " << help << "\n"
+       << "# TYPE " << name << " histogram\n";
+    for (int b = 7; b <= 36; ++b) {
+      const uint64_t edge = uint64_t{1} << b;
+      os << name << "_bucket{le=\"" << us(edge) << "\"} " << s.count_below(edge - 1) << "\n";
+    }
+    os << name << "_bucket{le=\"+Inf\"} " << s.count << "\n";
+    os << name << "_sum " << us(s.sum_ns) << "\n";
+    os << name << "_count " << s.count << "\n";
+  }
+
+private:
+  struct alignas(64) Stripe {
+    std::array<std::atomic<uint64_t>, kBuckets> counts{};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+  };
+
+  static size_t stripe_index() {
+    static std::atomic<size_t> next{0};
+    thread_local const size_t idx = next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return idx;
+  }
+
+  std::array<Stripe, kStripes> stripes_{};
+};
+
+// Records the lifetime of the scope into a histogram
+class ScopedLatency {
+public:
+  explicit ScopedLatency(LatencyHistogram& h) : h_(h), t0_(std::chrono::steady_clock::now()) {}
+  ~ScopedLatency() { h_.record_since(t0_); }
+  ScopedLatency(const ScopedLatency&) = delete;
+  ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+  LatencyHistogram& h_;
+  std::chrono::steady_clock::time_point t0_;
+};
@@ -1,44 +1,331 @@
 #pragma once
-#include <fstream>
-#include <mutex>
-#include <string>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "metrics.hpp"
+
+enum class LogFormat { Csv, Binary };
+
+struct LoggerConfig {
+  LogFormat format = LogFormat::Csv;
+  size_t   rotate_bytes = 0;               // 0 = never rotate on size
+  std::chrono::seconds rotate_age{0};      // 0 = never rotate on age
+  std::chrono::milliseconds flush_every{50};
+  size_t   ring_records = 4096;            // per request thread, power of two
+};
+
+// Fixed-size access record copied into a per-thread ring on the hot path
+struct LogRecord {
+  static constexpr size_t kMaxKey = 230;
+
+  uint64_t ts_ms;
+  uint64_t lat_us;
+  uint64_t size_bytes;
+  uint8_t  op;
+  uint8_t  hit;
+  uint8_t  key_len;
+  uint8_t  reserved;
+  char     key[kMaxKey];
+};
+static_assert(sizeof(LogRecord) % 8 == 0, "LogRecord should stay 8-byte aligned");
 
+// Access log. Request threads push fixed-size records into their own
+// single-producer rings without locks or syscalls; one writer thread drains
+// all rings and appends them to the log file in large batched writes.
+//
+// Binary format (little-endian), a sequence of column blocks:
+//   "GCLB" u16 version=1 u16 reserved u32 rows u32 key_bytes
+//   u64 ts_ms[rows] u64 lat_us[rows] u64 size_bytes[rows]
+//   u8 op[rows] u8 hit[rows] u16 key_len[rows] char keys[key_bytes]
+// op codes index kOpNames. Ops added later are appended, so codes stay
+// stable; unknown names log as OTHER. ml_sidecar/make_labels.py reads
+// both formats.
 class CsvLogger {
 public:
+  static constexpr std::array<const char*, 6> kOpNames{"GET", "PUT", "OTHER", "FETCH", "MGET", "MPUT"};
+  static constexpr uint8_t kOther = 2;
+
   static CsvLogger& instance() { static CsvLogger L; return L; }
 
-  void init(const std::string& path = "../data/access_log.csv") {
+  void init(const std::string& path = "../data/access_log.csv", LoggerConfig cfg = {}) {
     std::lock_guard<std::mutex> lock(mu_);
     path_ = path;
+    cfg_ = cfg;
+    if (cfg_.ring_records & (cfg_.ring_records - 1)) cfg_.ring_records = 4096;
     std::filesystem::create_directories(std::filesystem::path(path_).parent_path());
-    // create file with header if new
-    if (!std::filesystem::exists(path_)) {
-      std::ofstream f(path_, std::ios::out);
-      f << "ts_ms,op,key,hit,lat_us,size_bytes\n";
-    }
+    open_unlocked();
+    if (!writer_.joinable()) writer_ = std::thread([this] { run(); });
   }
 
   void write(const std::string& op, const std::string& key,
              bool hit, uint64_t lat_us, size_t size_bytes) {
-    std::lock_guard<std::mutex> lock(mu_);
-    std::ofstream f(path_, std::ios::app);
-    f << now_ms() << ',' << op << ',' << escape(key) << ','
-      << (hit ? 1 : 0) << ',' << lat_us << ',' << size_bytes << '\n';
+    Ring* r = ring();
+    const uint64_t head = r->head.load(std::memory_order_relaxed);
+    if (head - r->tail.load(std::memory_order_acquire) >= r->slots.size()) {
+      r->dropped.fetch_add(1, std::memory_order_relaxed);  // writer is behind
+      return;
+    }
+    LogRecord& rec = r->slots[head & (r->slots.size() - 1)];
+    rec.ts_ms = now_ms();
+    rec.lat_us = lat_us;
+    rec.size_bytes = size_bytes;
+    rec.op = op_code(op);
+    rec.hit = hit ? 1 : 0;
+    // keys longer than kMaxKey are truncated in the log
+    const size_t n = key.size() < LogRecord::kMaxKey ? key.size() : LogRecord::kMaxKey;
+    rec.key_len = static_cast<uint8_t>(n);
+    rec.reserved = 0;
+    std::memcpy(rec.key, key.data(), n);
+    r->head.store(head + 1, std::memory_order_release);
+  }
+
+  // One record per key of a batch request, published with a single ring
+  // update; hits[i] and sizes[i] describe keys[i]
+  void write_many(const std::string& op, const std::vector<std::string>& keys,
+                  const std::vector<uint8_t>& hits, const std::vector<size_t>& sizes, uint64_t lat_us) {
+    Ring* r = ring();
+    const uint64_t head = r->head.load(std::memory_order_relaxed);
+    const uint64_t room = r->slots.size() - (head - r->tail.load(std::memory_order_acquire));
+    const size_t n = keys.size() < room ? keys.size() : static_cast<size_t>(room);
+    if (n < keys.size()) r->dropped.fetch_add(keys.size() - n, std::memory_order_relaxed);
+    const uint64_t ts = now_ms();
+    const uint8_t code = op_code(op);
+    for (size_t i = 0; i < n; ++i) {
+      LogRecord& rec = r->slots[(head + i) & (r->slots.size() - 1)];
+      rec.ts_ms = ts;
+      rec.lat_us = lat_us;
+      rec.size_bytes = sizes[i];
+      rec.op = code;
+      rec.hit = hits[i] ? 1 : 0;
+      const size_t len = keys[i].size() < LogRecord::kMaxKey ? keys[i].size() : LogRecord::kMaxKey;
+      rec.key_len = static_cast<uint8_t>(len);
+      rec.reserved = 0;
+      std::memcpy(rec.key, keys[i].data(), len);
+    }
+    r->head.store(head + n, std::memory_order_release);
+  }
+
+  // Blocks until everything pushed so far is on disk (shutdown, tests)
+  void flush() {
+    std::unique_lock<std::mutex> lock(mu_);
+    const uint64_t target = ++flush_requested_;
+    wake_ = true;
+    cv_.notify_all();
+    flushed_cv_.wait(lock, [&] { return flushed_ >= target || !writer_.joinable(); });
+  }
+
+  ~CsvLogger() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    if (writer_.joinable()) writer_.join();
+    if (fd_ >= 0) ::close(fd_);
   }
 
 private:
-  std::mutex mu_;
-  std::string path_ = "../data/access_log.csv";
+  struct Ring {
+    explicit Ring(size_t n) : slots(n) {}
+    std::vector<LogRecord> slots;
+    alignas(64) std::atomic<uint64_t> head{0};   // producer
+    alignas(64) std::atomic<uint64_t> tail{0};   // writer
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> orphaned{false};           // owning thread exited
+  };
+
+  // Marks the ring orphaned when its thread exits; the writer frees it once drained
+  struct RingHandle {
+    std::shared_ptr<Ring> ring;
+    ~RingHandle() { if (ring) ring->orphaned.store(true, std::memory_order_release); }
+  };
+
+  CsvLogger() = default;
+
+  Ring* ring() {
+    thread_local RingHandle h;
+    if (!h.ring) {
+      std::lock_guard<std::mutex> lock(mu_);
+      h.ring = std::make_shared<Ring>(cfg_.ring_records);
+      rings_.push_back(h.ring);
+    }
+    return h.ring.get();
+  }
+
+  void run() {
+    std::string buf;
+    std::vector<LogRecord> batch;
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+      cv_.wait_for(lock, cfg_.flush_every, [this] { return stop_ || wake_; });
+      wake_ = false;
+      const bool stopping = stop_;
+      const uint64_t flush_target = flush_requested_;
+      auto rings = rings_;
+      lock.unlock();
+
+      batch.clear();
+      uint64_t dropped = 0;
+      for (auto& r : rings) {
+        const uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        for (; tail < head; ++tail) batch.push_back(r->slots[tail & (r->slots.size() - 1)]);
+        r->tail.store(tail, std::memory_order_release);
+        dropped += r->dropped.exchange(0, std::memory_order_relaxed);
+      }
+      if (dropped) Metrics::instance().add_log_dropped(dropped);
+      if (!batch.empty()) write_batch(batch, buf);
+
+      lock.lock();
+      // forget rings whose threads are gone and that are fully drained
+      rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<Ring>& r) {
+        return r->orphaned.load(std::memory_order_acquire) &&
+               r->tail.load(std::memory_order_relaxed) == r->head.load(std::memory_order_acquire);
+      }), rings_.end());
+      flushed_ = flush_target;
+      flushed_cv_.notify_all();
+      if (stopping) break;
+    }
+  }
+
+  void write_batch(const std::vector<LogRecord>& batch, std::string& buf) {
+    ScopedLatency timer(Metrics::instance().log_write_latency());
+    buf.clear();
+    if (cfg_.format == LogFormat::Csv) encode_csv(batch, buf);
+    else encode_binary(batch, buf);
+
+    std::lock_guard<std::mutex> lock(file_mu_);
+    maybe_rotate_unlocked(buf.size());
+    if (fd_ < 0) return;
+    size_t off = 0;
+    while (off < buf.size()) {
+      ssize_t n = ::write(fd_, buf.data() + off, buf.size() - off);
+      if (n < 0) { if (errno == EINTR) continue; break; }
+      off += static_cast<size_t>(n);
+    }
+    file_bytes_ += off;
+    Metrics::instance().observe_log_batch(batch.size(), off);
+  }
+
+  static void encode_csv(const std::vector<LogRecord>& batch, std::string& out) {
+    out.reserve(batch.size() * 64);
+    char num[32];
+    for (const auto& r : batch) {
+      append_u64(out, num, r.ts_ms); out += ',';
+      out += kOpNames[r.op]; out += ',';
+      out.append(r.key, r.key_len); out += ',';   // keep simple for now (no commas in keys)
+      out += r.hit ? '1' : '0'; out += ',';
+      append_u64(out, num, r.lat_us); out += ',';
+      append_u64(out, num, r.size_bytes); out += '\n';
+    }
+  }
+
+  static void encode_binary(const std::vector<LogRecord>& batch, std::string& out) {
+    const uint32_t rows = static_cast<uint32_t>(batch.size());
+    uint32_t key_bytes = 0;
+    for (const auto& r : batch) key_bytes += r.key_len;
+
+    out.append("GCLB", 4);
+    put(out, uint16_t{1}); put(out, uint16_t{0});
+    put(out, rows); put(out, key_bytes);
+    for (const auto& r : batch) put(out, r.ts_ms);
+    for (const auto& r : batch) put(out, r.lat_us);
+    for (const auto& r : batch) put(out, r.size_bytes);
+    for (const auto& r : batch) put(out, r.op);
+    for (const auto& r : batch) put(out, r.hit);
+    for (const auto& r : batch) put(out, static_cast<uint16_t>(r.key_len));
+    for (const auto& r : batch) out.append(r.key, r.key_len);
+  }
+
+  template <typename T>
+  static void put(std::string& out, T v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  static void append_u64(std::string& out, char* tmp, uint64_t v) {
+    char* p = tmp + 20;
+    do { *--p = static_cast<char>('0' + v % 10); v /= 10; } while (v);
+    out.append(p, tmp + 20 - p);
+  }
+
+  void open_unlocked() {
+    std::lock_guard<std::mutex> lock(file_mu_);
+    if (fd_ >= 0) ::close(fd_);
+    reopen_file_unlocked();
+  }
+
+  // file_mu_ held; creates the file with a header if new
+  void reopen_file_unlocked() {
+    const bool fresh = !std::filesystem::exists(path_);
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    std::error_code ec;
+    file_bytes_ = fresh ? 0 : std::filesystem::file_size(path_, ec);
+    opened_at_ = std::chrono::steady_clock::now();
+    if (fresh && fd_ >= 0 && cfg_.format == LogFormat::Csv) {
+      static const char header[] = "ts_ms,op,key,hit,lat_us,size_bytes\n";
+      if (::write(fd_, header, sizeof(header) - 1) > 0) file_bytes_ += sizeof(header) - 1;
+    }
+  }
+
+  void maybe_rotate_unlocked(size_t incoming) {
+    const bool by_size = cfg_.rotate_bytes && file_bytes_ > 0 &&
+                         file_bytes_ + incoming > cfg_.rotate_bytes;
+    const bool by_age = cfg_.rotate_age.count() &&
+                        std::chrono::steady_clock::now() - opened_at_ > cfg_.rotate_age;
+    if (!by_size && !by_age) return;
+
+    if (fd_ >= 0) ::close(fd_);
+    // access_log.csv → access_log.<unix_ms>.csv
+    std::filesystem::path p(path_);
+    const auto stamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+    std::filesystem::path rotated = p.parent_path() /
+      (p.stem().string() + "." + std::to_string(stamp) + p.extension().string());
+    std::error_code ec;
+    std::filesystem::rename(p, rotated, ec);
+    Metrics::instance().inc_log_rotations();
+    reopen_file_unlocked();
+  }
+
+  static uint8_t op_code(const std::string& op) {
+    for (size_t i = 0; i < kOpNames.size(); ++i)
+      if (op == kOpNames[i]) return static_cast<uint8_t>(i);
+    return kOther;
+  }
 
   static uint64_t now_ms() {
     using namespace std::chrono;
     return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
   }
 
-  static std::string escape(const std::string& s) {
-    // keep simple for now (no commas in keys)
-    return s;
-  }
+  // writer state / ring registry
+  std::mutex mu_;
+  std::condition_variable cv_, flushed_cv_;
+  std::vector<std::shared_ptr<Ring>> rings_;
+  bool stop_ = false, wake_ = false;
+  uint64_t flush_requested_ = 0, flushed_ = 0;
+  std::thread writer_;
+  LoggerConfig cfg_;
+  std::string path_ = "../data/access_log.csv";
+
+  // file state (writer thread, init)
+  std::mutex file_mu_;
+  int fd_ = -1;
+  size_t file_bytes_ = 0;
+  std::chrono::steady_clock::time_point opened_at_;
 };
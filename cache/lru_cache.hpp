@@ -1,86 +1,485 @@
 #pragma once
-#include <list>
+#include <algorithm>
 #include <string>
-#include <unordered_map>
 #include <mutex>
 #include <optional>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <string_view>
+#include <typeinfo>
+#include <chrono>
 
+#include "entry_table.hpp"
 #include "eviction.hpp"
+#include "eviction_engine.hpp"
+#include "expiry.hpp"
+#include "metrics.hpp"
+#include "spill_tier.hpp"
+#include "value_buffer.hpp"
+
+// Entry-count and/or byte budget for one cache (0 = unlimited)
+struct CacheLimits {
+    size_t max_items = 0;
+    size_t max_bytes = 0;
+    // values larger than this share of max_bytes are rejected outright
+    double max_object_fraction = 0.5;
+};
+
+// One entry as a snapshot saves it. expiry holds what is left of the ttl
+// and the full stale window; both are zero for an entry without a ttl.
+struct SavedEntry {
+    std::string key;
+    ValueRef value;
+    Expiry expiry;
+};
+
+enum class RemovalCause { Evicted, Rejected, Expired };
+
+// Outcome of a put: a value above the object size limit is TooLarge; one
+// the eviction policy chose not to keep (e.g. TinyLFU admission) is
+// NotAdmitted, a normal outcome rather than an error.
+enum class PutResult : uint8_t { Stored, TooLarge, NotAdmitted };
+
+// Called under the shard lock for every entry that leaves the cache; must be
+// cheap and must not call back into the cache.
+using RemovalListener =
+    std::function<void(const std::string& key, std::string_view value, RemovalCause)>;
 
 class LruCache {
 public:
     explicit LruCache(size_t capacity)
-      : cap_(capacity), strategy_(std::make_shared<LRUStrategy>()) {}
+      : LruCache(CacheLimits{capacity, 0, 1.0}) {}
+
+    explicit LruCache(CacheLimits limits)
+      : limits_(limits), strategy_(std::make_shared<LRUStrategy>()), plain_lru_(true) {}
+
+    // Shared handle to the cached bytes (empty on a miss); nothing is copied
+    // freshness, if given, reports whether a hit was stale (see Expiry).
+    // Only a caller that will refresh the entry passes claim_refresh; it may
+    // then get Revalidate, once per entry, and everyone else sees Stale.
+    ValueRef get_ref(const std::string& key, Freshness* freshness = nullptr, bool claim_refresh = false) {
+        const uint64_t h = EntryTable::hash_key(key);
+        auto lock = lock_timed();
+        return get_unlocked(key, h, freshness, claim_refresh);
+    }
 
     std::optional<std::string> get(const std::string& key) {
+        auto v = get_ref(key);
+        if (!v) return std::nullopt;
+        return std::string(v.view());
+    }
+
+    // Looks up keys[idx[0..n)] into out[idx[i]] under one lock acquisition
+    void get_batch(const std::string* keys, const uint32_t* idx, size_t n, ValueRef* out) {
+        std::vector<uint64_t> hashes(n);
+        for (size_t i = 0; i < n; ++i) hashes[i] = EntryTable::hash_key(keys[idx[i]]);
+        auto lock = lock_timed();
+        for (size_t i = 0; i < n; ++i) out[idx[i]] = get_unlocked(keys[idx[i]], hashes[i]);
+    }
+
+    // Returns false if the value was not stored; result, if given, says why
+    bool put(const std::string& key, const std::string& value) {
+        return put(key, ValueRef::copy_of(value));   // copy made outside the lock
+    }
+
+    bool put(const std::string& key, ValueRef value, Expiry expiry = {}, PutResult* result = nullptr) {
+        const uint64_t h = EntryTable::hash_key(key);
+        auto lock = lock_timed();
+        const PutResult r = put_unlocked(key, h, std::move(value), expiry);
+        if (result) *result = r;
+        return r == PutResult::Stored;
+    }
+
+    // Stores items[idx[0..n)] under one lock acquisition; results[idx[i]]
+    // is set to each item's outcome
+    void put_batch(const std::pair<std::string, ValueRef>* items, const uint32_t* idx, size_t n,
+                   PutResult* results) {
+        std::vector<uint64_t> hashes(n);
+        for (size_t i = 0; i < n; ++i) hashes[i] = EntryTable::hash_key(items[idx[i]].first);
+        auto lock = lock_timed();
+        for (size_t i = 0; i < n; ++i) {
+            const auto& [key, value] = items[idx[i]];
+            results[idx[i]] = put_unlocked(key, hashes[i], value, Expiry{});
+        }
+    }
+
+    // Moves a value read from the spill tier back to RAM. If the key was
+    // stored meanwhile, that newer value wins and is returned instead; if
+    // the spilled copy was replaced, it is returned without being cached.
+    ValueRef promote(const std::string& key, ValueRef value, uint64_t generation) {
+        const uint64_t h = EntryTable::hash_key(key);
+        auto lock = lock_timed();
+        const uint32_t id = table_.find(key, h);
+        if (id != EntryTable::kNil) return table_.node(id).value;
+        // the tier changes for this key only under this lock, so the claim
+        // cannot race a put or an eviction of the same key
+        if (spill_ && spill_->claim(key, generation)) put_unlocked(key, h, value, Expiry{});
+        return value;
+    }
+
+    // Value and expiry tick (0 = none) without counting a lookup or moving
+    // the entry in recency order; stale handling is left to the caller
+    ValueRef peek(const std::string& key, uint32_t* expires = nullptr) const {
+        const uint64_t h = EntryTable::hash_key(key);
         std::lock_guard<std::mutex> lock(mu_);
-        auto it = map_.find(key);
-        if (it == map_.end()) return std::nullopt;
-        items_.splice(items_.begin(), items_, it->second);
-        return it->second->second;
+        const uint32_t id = table_.find(key, h);
+        if (id == EntryTable::kNil) return ValueRef();
+        if (expires) *expires = table_.node(id).expires;
+        return table_.node(id).value;
     }
 
-    void put(const std::string& key, const std::string& value) {
+    // The ttl and stale window key was stored with, to tick precision, so a
+    // refresh can store the new value the same way; zero for a missing key
+    // or one without expiry
+    Expiry expiry_of(const std::string& key) const {
+        const uint64_t h = EntryTable::hash_key(key);
         std::lock_guard<std::mutex> lock(mu_);
-        auto it = map_.find(key);
-        if (it != map_.end()) {
-            it->second->second = value;
-            items_.splice(items_.begin(), items_, it->second);
-            return;
+        const uint32_t id = table_.find(key, h);
+        Expiry e;
+        if (id == EntryTable::kNil || !table_.node(id).expires) return e;
+        e.ttl = ExpiryClock::kTick * ttl_ticks_[id];
+        e.stale = ExpiryClock::kTick * (wheel_.deadline(id) - table_.node(id).expires);
+        return e;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return table_.size();
+    }
+
+    size_t resident_bytes() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        return bytes_;
+    }
+
+    const CacheLimits& limits() const { return limits_; }
+
+    // Contents oldest first, leaving out entries past their ttl; values are
+    // shared, not copied, so the lock is held only for the walk
+    std::vector<SavedEntry> entries() const {
+        const uint32_t now = ExpiryClock::now();
+        std::lock_guard<std::mutex> lock(mu_);
+        std::vector<SavedEntry> out;
+        out.reserve(table_.size());
+        for (uint32_t id = table_.tail(); id != EntryTable::kNil; id = table_.node(id).prev) {
+            const auto& n = table_.node(id);
+            Expiry e;
+            if (n.expires) {
+                if (now >= n.expires) continue;
+                e.ttl = ExpiryClock::kTick * (n.expires - now);
+                e.stale = ExpiryClock::kTick * (wheel_.deadline(id) - n.expires);
+            }
+            out.push_back(SavedEntry{std::string(n.key.view()), n.value, e});
         }
-        items_.emplace_front(key, value);
-        map_[key] = items_.begin();
+        return out;
+    }
 
-        if (map_.size() > cap_) evict_one_unlocked();
+    // Drops entries whose stale window has passed; cost is proportional to
+    // elapsed ticks and expired entries, never to cache size
+    size_t reap_expired() {
+        const uint32_t now = ExpiryClock::now();
+        std::lock_guard<std::mutex> lock(mu_);
+        return reap_unlocked(now);
     }
 
-    size_t size() const {
+    ShardStats stats() const {
         std::lock_guard<std::mutex> lock(mu_);
-        return map_.size();
+        return ShardStats{table_.size(), limits_.max_items, bytes_, limits_.max_bytes,
+                          hits_, misses_, evictions_, rejected_, not_admitted_, expired_};
+    }
+
+    // Resident cost of one entry: its pooled node and index slot, key bytes
+    // that do not fit inline, and the value's slab block.
+    static size_t charge(std::string_view key, const ValueRef& value) {
+        return EntryTable::kEntryOverhead + CompactKey::heap_bytes(key.size()) + value.footprint();
     }
 
     void set_strategy(std::shared_ptr<EvictionStrategy> s) {
+        auto engine = make_engine(s);
+        std::unique_ptr<AsyncEvictionEngine> old;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            strategy_ = std::move(s);
+            tracking_ = strategy_ && strategy_->tracks_entries();
+            plain_lru_ = !strategy_ || typeid(*strategy_) == typeid(LRUStrategy);
+            // a tracking policy learns the current contents, oldest first
+            if (tracking_)
+                for (uint32_t id = table_.tail(); id != EntryTable::kNil; id = table_.node(id).prev) {
+                    const auto& n = table_.node(id);
+                    strategy_->on_insert(std::string(n.key.view()), weight_unlocked(n.key.view(), n.value));
+                }
+            old = std::move(engine_);
+            engine_ = std::move(engine);
+        }
+        // old engine joins its worker, which may be waiting on mu_
+    }
+
+    // Applied to puts that do not carry their own ttl
+    void set_default_expiry(Expiry e) {
+        std::lock_guard<std::mutex> lock(mu_);
+        default_expiry_ = e;
+    }
+
+    // Evicted entries without a ttl are demoted here instead of dropped
+    void set_spill_tier(std::shared_ptr<SpillTier> spill) {
         std::lock_guard<std::mutex> lock(mu_);
-        strategy_ = std::move(s);
+        spill_ = std::move(spill);
+    }
+
+    void set_removal_listener(RemovalListener fn) {
+        std::lock_guard<std::mutex> lock(mu_);
+        on_remove_ = std::move(fn);
+    }
+
+    // Score victims in the background for strategies that support batch
+    // scoring, so put() never waits on the scorer. Applies to the current
+    // and any later strategy.
+    void set_async_eviction(bool on, EvictionEngineConfig cfg = {}) {
+        std::shared_ptr<EvictionStrategy> s;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            async_ = on;
+            engine_cfg_ = cfg;
+            s = strategy_;
+        }
+        set_strategy(std::move(s));
     }
 
 private:
-    void evict_one_unlocked() {
-        auto candidates = build_candidates_unlocked(8);
+    std::unique_ptr<AsyncEvictionEngine> make_engine(const std::shared_ptr<EvictionStrategy>& s) {
+        bool async;
+        EvictionEngineConfig cfg;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            async = async_;
+            cfg = engine_cfg_;
+        }
+        if (!async || !s || !s->supports_batch_scoring()) return nullptr;
+        return std::make_unique<AsyncEvictionEngine>(
+            s, [this](size_t n) {
+                std::lock_guard<std::mutex> lock(mu_);
+                if (!near_limits_unlocked()) return std::vector<std::string>{};
+                return build_candidates_unlocked(n);
+            }, cfg);
+    }
+
+    ValueRef get_unlocked(const std::string& key, uint64_t h, Freshness* freshness = nullptr,
+                          bool claim_refresh = false) {
+        uint32_t id = table_.find(key, h);
+        Freshness fr = Freshness::Fresh;
+        if (id != EntryTable::kNil && table_.node(id).expires) {
+            const uint32_t now = ExpiryClock::now();
+            if (now >= table_.node(id).expires) {
+                if (now >= wheel_.deadline(id)) {
+                    // past the stale window; the reaper has not got to it yet
+                    erase_unlocked(id, RemovalCause::Expired);
+                    ++expired_;
+                    Metrics::instance().add_expired(1);
+                    id = EntryTable::kNil;
+                } else if (claim_refresh && freshness && !wheel_.flag(id)) {
+                    wheel_.set_flag(id);
+                    fr = Freshness::Revalidate;
+                    Metrics::instance().inc_stale_served(true);
+                } else {
+                    fr = Freshness::Stale;
+                    Metrics::instance().inc_stale_served(false);
+                }
+            }
+        }
+        const bool hit = id != EntryTable::kNil;
+        if (tracking_) strategy_->on_access(key, hit);
+        if (!hit) { ++misses_; return ValueRef(); }
+        ++hits_;
+        if (freshness) *freshness = fr;
+        table_.move_to_front(id);
+        return table_.node(id).value;
+    }
+
+    PutResult put_unlocked(const std::string& key, uint64_t h, ValueRef value, Expiry expiry) {
+        if (!expiry.enabled()) expiry = default_expiry_;
+        if (wheel_.size()) reap_unlocked(ExpiryClock::now());
+        // any spilled copy is now out of date
+        if (spill_) spill_->erase(key);
+        uint32_t id = table_.find(key, h);
+        if (!admissible(key, value)) {
+            ++rejected_;
+            // never keep serving the previous version of a rejected update
+            if (id != EntryTable::kNil) erase_unlocked(id, RemovalCause::Rejected);
+            return PutResult::TooLarge;
+        }
+        if (id != EntryTable::kNil) {
+            auto& n = table_.node(id);
+            bytes_ -= charge(key, n.value);
+            n.value = std::move(value);
+            bytes_ += charge(key, n.value);
+            table_.move_to_front(id);
+        } else {
+            id = table_.insert(key, h, std::move(value));
+            bytes_ += charge(key, table_.node(id).value);
+        }
+        auto& node = table_.node(id);
+        if (expiry.enabled()) {
+            node.expires = ExpiryClock::after(expiry.ttl);
+            wheel_.schedule(id, ExpiryClock::after(expiry.ttl + expiry.stale));
+            if (id >= ttl_ticks_.size()) ttl_ticks_.resize(std::max<size_t>(id + 1, ttl_ticks_.size() * 2));
+            ttl_ticks_[id] = static_cast<uint32_t>((expiry.ttl + ExpiryClock::kTick - std::chrono::milliseconds(1)) /
+                                                   ExpiryClock::kTick);
+        } else if (node.expires) {
+            node.expires = 0;
+            wheel_.cancel(id);
+        }
+        if (tracking_) strategy_->on_insert(key, weight_unlocked(key, node.value));
+
+        // a large insert may need several victims
+        bool evicted = false;
+        while (over_limits_unlocked() && table_.size() > 1) { evict_one_unlocked(key); evicted = true; }
+        // a tracking policy may have declined the key itself
+        if (evicted && tracking_ && table_.find(key, h) == EntryTable::kNil) {
+            ++not_admitted_;
+            return PutResult::NotAdmitted;
+        }
+        return PutResult::Stored;
+    }
+
+    size_t reap_unlocked(uint32_t now) {
+        const size_t n = wheel_.advance(now, [this](uint32_t id) {
+            table_.node(id).expires = 0;   // timer already gone
+            erase_unlocked(id, RemovalCause::Expired);
+        });
+        expired_ += n;
+        if (n) Metrics::instance().add_expired(n);
+        return n;
+    }
+
+    // Request-path lock; only contended acquisitions pay for timing the wait
+    std::unique_lock<std::mutex> lock_timed() const {
+        std::unique_lock<std::mutex> lock(mu_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            const auto t0 = std::chrono::steady_clock::now();
+            lock.lock();
+            Metrics::instance().lock_wait().record_since(t0);
+        }
+        return lock;
+    }
+
+    void evict_one_unlocked(const std::string& protect) {
+        ScopedLatency timer(Metrics::instance().evict_latency());
+        ++evictions_;
+        if (plain_lru_) {
+            // the sampled LRU decision is always the tail; skip building candidates
+            evict_lru_unlocked();
+            return;
+        }
+        if (tracking_) {
+            // the policy owns order and admission; it may pick the new key itself
+            for (int tries = 0; tries < 4; ++tries) {
+                auto v = strategy_->victim();
+                if (!v) break;
+                const uint32_t id = table_.find(*v, EntryTable::hash_key(*v));
+                if (id != EntryTable::kNil) { erase_unlocked(id, RemovalCause::Evicted); return; }
+                strategy_->on_remove(*v, false);   // policy out of sync; drop it
+            }
+            evict_lru_unlocked();
+            return;
+        }
+        if (engine_) {
+            // O(1) pop of a pre-scored victim; stale entries are skipped
+            while (auto v = engine_->pop_victim()) {
+                if (v->key == protect) continue;
+                const uint32_t id = table_.find(v->key, EntryTable::hash_key(v->key));
+                if (id == EntryTable::kNil) continue;
+                erase_unlocked(id, RemovalCause::Evicted);
+                Metrics::instance().inc_victim_pool_hits();
+                Metrics::instance().observe_victim_age_us(v->age_us);
+                return;
+            }
+            Metrics::instance().inc_victim_pool_misses();
+            evict_lru_unlocked();
+            return;
+        }
+
+        auto candidates = build_candidates_unlocked(8, &protect);
         std::optional<std::string> victim;
         if (strategy_) victim = strategy_->choose_victim(candidates);
 
-        if (!victim.has_value()) {
-            auto &node = items_.back();
-            map_.erase(node.first);
-            items_.pop_back();
+        if (!victim.has_value() || *victim == protect) {
+            evict_lru_unlocked();
             return;
         }
-        auto m = map_.find(*victim);
-        if (m != map_.end()) {
-            items_.erase(m->second);
-            map_.erase(m);
-        } else {
-            auto &node = items_.back();
-            map_.erase(node.first);
-            items_.pop_back();
+        const uint32_t id = table_.find(*victim, EntryTable::hash_key(*victim));
+        if (id != EntryTable::kNil) erase_unlocked(id, RemovalCause::Evicted);
+        else evict_lru_unlocked();
+    }
+
+    void evict_lru_unlocked() {
+        erase_unlocked(table_.tail(), RemovalCause::Evicted);
+    }
+
+    void erase_unlocked(uint32_t id, RemovalCause cause) {
+        auto& n = table_.node(id);
+        if (on_remove_ || tracking_) {
+            const std::string key(n.key.view());
+            if (on_remove_) on_remove_(key, n.value.view(), cause);
+            if (tracking_) strategy_->on_remove(key, cause == RemovalCause::Evicted);
         }
+        if (n.expires) wheel_.cancel(id);
+        else if (spill_ && cause == RemovalCause::Evicted) spill_->demote(std::string(n.key.view()), n.value);
+        bytes_ -= charge(n.key.view(), n.value);
+        table_.erase(id);
+    }
+
+    // policy weight: bytes under a byte budget, otherwise one per entry
+    size_t weight_unlocked(std::string_view key, const ValueRef& value) const {
+        return limits_.max_bytes ? charge(key, value) : 1;
+    }
+
+    bool admissible(const std::string& key, const ValueRef& value) const {
+        if (limits_.max_bytes == 0) return true;
+        return static_cast<double>(charge(key, value)) <=
+               limits_.max_object_fraction * static_cast<double>(limits_.max_bytes);
     }
 
-    std::vector<std::string> build_candidates_unlocked(size_t max_n) const {
+    bool over_limits_unlocked() const {
+        return (limits_.max_items && table_.size() > limits_.max_items) ||
+               (limits_.max_bytes && bytes_ > limits_.max_bytes);
+    }
+
+    // close enough to a limit that the next insert will likely evict
+    bool near_limits_unlocked() const {
+        return (limits_.max_items && table_.size() >= limits_.max_items) ||
+               (limits_.max_bytes && bytes_ >= limits_.max_bytes - limits_.max_bytes / 10);
+    }
+
+    std::vector<std::string> build_candidates_unlocked(size_t max_n,
+                                                       const std::string* skip = nullptr) const {
         std::vector<std::string> cands; cands.reserve(max_n);
-        auto it = items_.rbegin();
-        for (size_t i=0; it != items_.rend() && i<max_n; ++it, ++i) cands.push_back(it->first);
+        // oldest first
+        for (uint32_t id = table_.tail(); id != EntryTable::kNil && cands.size() < max_n;
+             id = table_.node(id).prev) {
+            const auto k = table_.node(id).key.view();
+            if (skip && k == *skip) continue;
+            cands.emplace_back(k);
+        }
         return cands;
     }
 
 private:
     mutable std::mutex mu_;
-    size_t cap_;
-    std::list<std::pair<std::string, std::string>> items_;
-    std::unordered_map<std::string,
-      std::list<std::pair<std::string, std::string>>::iterator> map_;
+    CacheLimits limits_;
+    size_t bytes_ = 0;
+    EntryTable table_;
     std::shared_ptr<EvictionStrategy> strategy_;
+    bool tracking_ = false;   // strategy_->tracks_entries()
+    bool plain_lru_ = false;  // exactly LRUStrategy: evict the tail directly
+    RemovalListener on_remove_;
+    std::shared_ptr<SpillTier> spill_;
+    uint64_t hits_ = 0, misses_ = 0, evictions_ = 0, rejected_ = 0, not_admitted_ = 0, expired_ = 0;
+    TimerWheel wheel_;
+    std::vector<uint32_t> ttl_ticks_;   // by node id, set while the node has a ttl
+    Expiry default_expiry_;
+    bool async_ = false;
+    EvictionEngineConfig engine_cfg_;
+    // declared last: its worker is joined before mu_ and the maps go away
+    std::unique_ptr<AsyncEvictionEngine> engine_;
 };
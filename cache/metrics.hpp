@@ -3,7 +3,34 @@
 #include <array>
 #include <string>
 #include <sstream>
-// Removed unused: <chrono>, <mutex>, <iomanip>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "latency_histogram.hpp"
+
+// Point-in-time counters of one cache shard
+struct ShardStats {
+  size_t   size = 0;
+  size_t   capacity = 0;      // item cap, 0 = none
+  size_t   bytes = 0;         // resident bytes
+  size_t   max_bytes = 0;     // byte budget, 0 = none
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  uint64_t rejected = 0;      // puts refused as too large
+  uint64_t not_admitted = 0;  // new keys the eviction policy declined to keep
+  uint64_t expired = 0;       // removed after their ttl and stale window
+};
+
+// One heavy hitter of the hot-key detector; counts are scaled-up samples
+struct HotKeyStat {
+  std::string key;
+  uint64_t count = 0;
+  uint64_t error = 0;         // count may overstate the key by up to this
+  double   share = 0;         // of sampled lookups in the decay window
+  bool     replicated = false;
+};
 
 class Metrics {
 public:
@@ -18,16 +45,119 @@ public:
   void inc_hits()           { hits_.fetch_add(1, std::memory_order_relaxed); }
   void inc_misses()         { misses_.fetch_add(1, std::memory_order_relaxed); }
   void set_current_size(size_t s) { current_size_.store(s, std::memory_order_relaxed); }
+  void set_resident_bytes(size_t b) { resident_bytes_.store(b, std::memory_order_relaxed); }
+  void inc_put_rejected()   { put_rejected_.fetch_add(1, std::memory_order_relaxed); }
+  void inc_put_not_admitted() { put_not_admitted_.fetch_add(1, std::memory_order_relaxed); }
+  // batch endpoints count every key, one update per request
+  void add_get_requests(uint64_t n) { get_requests_.fetch_add(n, std::memory_order_relaxed); }
+  void add_put_requests(uint64_t n) { put_requests_.fetch_add(n, std::memory_order_relaxed); }
+  void add_hits(uint64_t n)         { hits_.fetch_add(n, std::memory_order_relaxed); }
+  void add_misses(uint64_t n)       { misses_.fetch_add(n, std::memory_order_relaxed); }
+  void add_put_rejected(uint64_t n) { put_rejected_.fetch_add(n, std::memory_order_relaxed); }
+  void add_put_not_admitted(uint64_t n) { put_not_admitted_.fetch_add(n, std::memory_order_relaxed); }
+
+  // per-shard stats are pulled from the cache at scrape time
+  void set_shard_stats_source(std::function<std::vector<ShardStats>()> fn) {
+    std::lock_guard<std::mutex> lock(source_mu_);
+    shard_source_ = std::move(fn);
+  }
+
+  // hot-key detector's top keys, listed on /stats only
+  void set_hot_keys_source(std::function<std::vector<HotKeyStat>()> fn) {
+    std::lock_guard<std::mutex> lock(source_mu_);
+    hot_source_ = std::move(fn);
+  }
+
+  // Extra series read at scrape time (values owned by other components)
+  void register_gauge(std::string name, std::string help, std::function<double()> fn,
+                      std::string type = "gauge") {
+    std::lock_guard<std::mutex> lock(source_mu_);
+    gauges_.push_back({std::move(name), std::move(help), std::move(type), std::move(fn)});
+  }
+
+  // read-through origin
+  void inc_origin_coalesced() { origin_coalesced_.fetch_add(1, std::memory_order_relaxed); }
+  void inc_origin_errors()    { origin_errors_.fetch_add(1, std::memory_order_relaxed); }
+  void observe_origin_fetch_ms(uint64_t ms) {
+    origin_fetches_.fetch_add(1, std::memory_order_relaxed);
+    origin_fetch_ms_sum_.fetch_add(ms, std::memory_order_relaxed);
+  }
+
+  // access log pipeline
+  void add_log_dropped(uint64_t n) { log_dropped_.fetch_add(n, std::memory_order_relaxed); }
+  void inc_log_rotations()         { log_rotations_.fetch_add(1, std::memory_order_relaxed); }
+  void observe_log_batch(uint64_t records, uint64_t bytes) {
+    log_batches_.fetch_add(1, std::memory_order_relaxed);
+    log_records_.fetch_add(records, std::memory_order_relaxed);
+    log_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  // ttl expiry
+  void add_expired(uint64_t n) { expired_.fetch_add(n, std::memory_order_relaxed); }
+  void inc_stale_served(bool revalidate) {
+    stale_served_.fetch_add(1, std::memory_order_relaxed);
+    if (revalidate) revalidations_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void inc_reaper_runs() { reaper_runs_.fetch_add(1, std::memory_order_relaxed); }
+
+  // value compression; raw and stored bytes count only values kept compressed
+  void observe_compression(bool kept, uint64_t raw_bytes, uint64_t stored_bytes) {
+    compress_attempts_.fetch_add(1, std::memory_order_relaxed);
+    if (!kept) return;
+    compressed_values_.fetch_add(1, std::memory_order_relaxed);
+    compress_raw_bytes_.fetch_add(raw_bytes, std::memory_order_relaxed);
+    compress_stored_bytes_.fetch_add(stored_bytes, std::memory_order_relaxed);
+  }
+  // hits sent to the client still compressed (Accept-Encoding: gzip)
+  void inc_served_encoded() { served_encoded_.fetch_add(1, std::memory_order_relaxed); }
+
+  // snapshot persistence
+  void inc_snapshot_failures() { snapshot_failures_.fetch_add(1, std::memory_order_relaxed); }
+  void observe_snapshot(uint64_t ms, uint64_t bytes, uint64_t entries) {
+    snapshots_.fetch_add(1, std::memory_order_relaxed);
+    snapshot_last_ms_.store(ms, std::memory_order_relaxed);
+    snapshot_last_bytes_.store(bytes, std::memory_order_relaxed);
+    snapshot_last_entries_.store(entries, std::memory_order_relaxed);
+  }
+  void observe_restore(uint64_t ms, uint64_t entries, uint64_t skipped_sections) {
+    restore_ms_.store(ms, std::memory_order_relaxed);
+    restore_entries_.store(entries, std::memory_order_relaxed);
+    restore_skipped_sections_.store(skipped_sections, std::memory_order_relaxed);
+  }
+
+  // native model scorer
+  void inc_model_reloads()         { model_reloads_.fetch_add(1, std::memory_order_relaxed); }
+  void inc_model_reload_failures() { model_reload_failures_.fetch_add(1, std::memory_order_relaxed); }
 
-  // latency histogram (microseconds)
-  // buckets (us): [100, 300, 1000, 3000, 10000, +inf]
-  void observe_get_latency_us(uint64_t us) {
-    // FIX 2: stop using buckets_.size(); use BUCKETS (or hist_.size()) instead.
-    size_t idx = 0;
-    while (idx + 1 < BUCKETS && us > bucket_bounds_us_[idx]) ++idx;
-    hist_[idx].fetch_add(1, std::memory_order_relaxed);
+  // async eviction engine
+  void inc_victim_pool_hits()   { pool_hits_.fetch_add(1, std::memory_order_relaxed); }
+  void inc_victim_pool_misses() { pool_misses_.fetch_add(1, std::memory_order_relaxed); }
+  void inc_scoring_failures()   { scoring_failures_.fetch_add(1, std::memory_order_relaxed); }
+  void observe_scoring_batch_us(uint64_t us) {
+    scoring_batches_.fetch_add(1, std::memory_order_relaxed);
+    scoring_batch_us_sum_.fetch_add(us, std::memory_order_relaxed);
+  }
+  // age of a pre-scored victim when it is actually evicted
+  void observe_victim_age_us(uint64_t us) {
+    victim_age_us_sum_.fetch_add(us, std::memory_order_relaxed);
+    victim_age_count_.fetch_add(1, std::memory_order_relaxed);
   }
 
+  // latency histograms, merged at scrape time
+  LatencyHistogram& get_latency()      { return get_latency_; }
+  LatencyHistogram& put_latency()      { return put_latency_; }
+  LatencyHistogram& evict_latency()    { return evict_latency_; }
+  LatencyHistogram& sidecar_rtt()      { return sidecar_rtt_; }
+  LatencyHistogram& lock_wait()        { return lock_wait_; }
+  LatencyHistogram& log_write_latency() { return log_write_latency_; }
+  LatencyHistogram& reap_latency()     { return reap_latency_; }
+  LatencyHistogram& compress_latency() { return compress_latency_; }
+  LatencyHistogram& decompress_latency() { return decompress_latency_; }
+  LatencyHistogram& spill_read_latency() { return spill_read_latency_; }
+  LatencyHistogram& peer_rtt()         { return peer_rtt_; }
+  // sidecar calls that failed, so the caller fell back (LRU or pool miss)
+  void inc_sidecar_fallbacks() { sidecar_fallbacks_.fetch_add(1, std::memory_order_relaxed); }
+
   // JSON summary for /stats
   std::string to_json() {
     std::ostringstream os;
@@ -37,13 +167,102 @@ public:
     os << "\"cache_hits\":"     << hits_.load(std::memory_order_relaxed)           << ",";
     os << "\"cache_misses\":"   << misses_.load(std::memory_order_relaxed)         << ",";
     os << "\"cache_current_size\":" << current_size_.load(std::memory_order_relaxed) << ",";
-    os << "\"get_latency_histogram_us\":{";
-    // Emit finite buckets + a label for the +Inf bucket
-    for (size_t i = 0; i < bucket_bounds_us_.size(); ++i) {
-      if (i) os << ",";
-      os << "\"" << bucket_label(i) << "\":" << hist_[i].load(std::memory_order_relaxed);
+    os << "\"cache_resident_bytes\":" << resident_bytes_.load(std::memory_order_relaxed) << ",";
+    os << "\"put_rejected\":"   << put_rejected_.load(std::memory_order_relaxed)   << ",";
+    os << "\"put_not_admitted\":" << put_not_admitted_.load(std::memory_order_relaxed) << ",";
+    {
+      const uint64_t ph = pool_hits_.load(std::memory_order_relaxed);
+      const uint64_t pm = pool_misses_.load(std::memory_order_relaxed);
+      const uint64_t batches = scoring_batches_.load(std::memory_order_relaxed);
+      const uint64_t ages = victim_age_count_.load(std::memory_order_relaxed);
+      os << "\"eviction_pool\":{";
+      os << "\"hits\":" << ph << ",\"misses\":" << pm << ",";
+      os << "\"hit_rate\":" << (ph + pm ? static_cast<double>(ph) / (ph + pm) : 0.0) << ",";
+      os << "\"scoring_batches\":" << batches << ",";
+      os << "\"scoring_failures\":" << scoring_failures_.load(std::memory_order_relaxed) << ",";
+      os << "\"avg_scoring_batch_us\":"
+         << (batches ? scoring_batch_us_sum_.load(std::memory_order_relaxed) / batches : 0) << ",";
+      os << "\"avg_victim_age_us\":"
+         << (ages ? victim_age_us_sum_.load(std::memory_order_relaxed) / ages : 0);
+      os << "},";
+    }
+    {
+      auto shards = shard_stats();
+      os << "\"shards\":[";
+      for (size_t i = 0; i < shards.size(); ++i) {
+        const auto& st = shards[i];
+        if (i) os << ",";
+        os << "{\"shard\":" << i << ",\"size\":" << st.size << ",\"capacity\":" << st.capacity
+           << ",\"bytes\":" << st.bytes << ",\"max_bytes\":" << st.max_bytes
+           << ",\"hits\":" << st.hits << ",\"misses\":" << st.misses
+           << ",\"evictions\":" << st.evictions << ",\"rejected\":" << st.rejected
+           << ",\"not_admitted\":" << st.not_admitted
+           << ",\"expired\":" << st.expired << "}";
+      }
+      os << "],";
+    }
+    {
+      std::lock_guard<std::mutex> lock(source_mu_);
+      if (hot_source_) {
+        auto hot = hot_source_();
+        os << "\"hot_keys\":[";
+        for (size_t i = 0; i < hot.size(); ++i) {
+          const auto& h = hot[i];
+          if (i) os << ",";
+          os << "{\"key\":";
+          write_json_string(os, h.key);
+          os << ",\"count\":" << h.count << ",\"error\":" << h.error << ",\"share\":" << h.share
+             << ",\"replicated\":" << (h.replicated ? "true" : "false") << "}";
+        }
+        os << "],";
+      }
+      for (const auto& g : gauges_) os << "\"" << g.name << "\":" << g.fn() << ",";
+    }
+    os << "\"origin\":{"
+       << "\"fetches\":" << origin_fetches_.load(std::memory_order_relaxed)
+       << ",\"coalesced\":" << origin_coalesced_.load(std::memory_order_relaxed)
+       << ",\"errors\":" << origin_errors_.load(std::memory_order_relaxed)
+       << ",\"fetch_ms_sum\":" << origin_fetch_ms_sum_.load(std::memory_order_relaxed) << "},";
+    os << "\"access_log\":{"
+       << "\"records\":" << log_records_.load(std::memory_order_relaxed)
+       << ",\"dropped\":" << log_dropped_.load(std::memory_order_relaxed)
+       << ",\"batches\":" << log_batches_.load(std::memory_order_relaxed)
+       << ",\"bytes\":" << log_bytes_.load(std::memory_order_relaxed)
+       << ",\"rotations\":" << log_rotations_.load(std::memory_order_relaxed) << "},";
+    os << "\"expiry\":{"
+       << "\"expired\":" << expired_.load(std::memory_order_relaxed)
+       << ",\"stale_served\":" << stale_served_.load(std::memory_order_relaxed)
+       << ",\"revalidations\":" << revalidations_.load(std::memory_order_relaxed)
+       << ",\"reaper_runs\":" << reaper_runs_.load(std::memory_order_relaxed) << "},";
+    {
+      const uint64_t raw = compress_raw_bytes_.load(std::memory_order_relaxed);
+      const uint64_t stored = compress_stored_bytes_.load(std::memory_order_relaxed);
+      os << "\"compression\":{"
+         << "\"attempts\":" << compress_attempts_.load(std::memory_order_relaxed)
+         << ",\"compressed\":" << compressed_values_.load(std::memory_order_relaxed)
+         << ",\"raw_bytes\":" << raw
+         << ",\"stored_bytes\":" << stored
+         << ",\"ratio\":" << (raw ? static_cast<double>(stored) / static_cast<double>(raw) : 0.0)
+         << ",\"served_encoded\":" << served_encoded_.load(std::memory_order_relaxed) << "},";
+    }
+    os << "\"snapshot\":{"
+       << "\"count\":" << snapshots_.load(std::memory_order_relaxed)
+       << ",\"failures\":" << snapshot_failures_.load(std::memory_order_relaxed)
+       << ",\"last_ms\":" << snapshot_last_ms_.load(std::memory_order_relaxed)
+       << ",\"last_bytes\":" << snapshot_last_bytes_.load(std::memory_order_relaxed)
+       << ",\"last_entries\":" << snapshot_last_entries_.load(std::memory_order_relaxed)
+       << ",\"restore_ms\":" << restore_ms_.load(std::memory_order_relaxed)
+       << ",\"restored_entries\":" << restore_entries_.load(std::memory_order_relaxed)
+       << ",\"restore_skipped_sections\":" << restore_skipped_sections_.load(std::memory_order_relaxed) << "},";
+    os << "\"model_reloads\":" << model_reloads_.load(std::memory_order_relaxed) << ",";
+    os << "\"model_reload_failures\":" << model_reload_failures_.load(std::memory_order_relaxed) << ",";
+    os << "\"sidecar_fallbacks\":" << sidecar_fallbacks_.load(std::memory_order_relaxed) << ",";
+    os << "\"latency_us\":{";
+    for (size_t i = 0; i < histograms().size(); ++i) {
+      const auto& h = histograms()[i];
+      os << (i ? ",\"" : "\"") << h.json_name << "\":";
+      LatencyHistogram::write_json(os, (this->*h.member).snapshot());
     }
-    os << ",\"gt_10000\":" << hist_[bucket_bounds_us_.size()].load(std::memory_order_relaxed);
     os << "}}";
     return os.str();
   }
@@ -66,41 +285,203 @@ public:
     os << "# HELP cache_current_size Current number of keys\n"
        << "# TYPE cache_current_size gauge\n"
        << "cache_current_size " << current_size_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_resident_bytes Resident bytes of keys, values and node overhead\n"
+       << "# TYPE cache_resident_bytes gauge\n"
+       << "cache_resident_bytes " << resident_bytes_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_put_rejected_total PUTs rejected as larger than the admission limit\n"
+       << "# TYPE cache_put_rejected_total counter\n"
+       << "cache_put_rejected_total " << put_rejected_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_put_not_admitted_total PUTs of new keys the eviction policy declined to keep\n"
+       << "# TYPE cache_put_not_admitted_total counter\n"
+       << "cache_put_not_admitted_total " << put_not_admitted_.load(std::memory_order_relaxed) << "\n";
 
-    os << "# HELP cache_get_latency_us Latency histogram for GET (us)\n"
-       << "# TYPE cache_get_latency_us histogram\n";
+    {
+      auto shards = shard_stats();
+      if (!shards.empty()) {
+        os << "# HELP cache_shard_size Current number of keys per shard\n"
+           << "# TYPE cache_shard_size gauge\n";
+        for (size_t i = 0; i < shards.size(); ++i)
+          os << "cache_shard_size{shard=\"" << i << "\"} " << shards[i].size << "\n";
+        os << "# HELP cache_shard_resident_bytes Resident bytes per shard\n"
+           << "# TYPE cache_shard_resident_bytes gauge\n";
+        for (size_t i = 0; i < shards.size(); ++i)
+          os << "cache_shard_resident_bytes{shard=\"" << i << "\"} " << shards[i].bytes << "\n";
+        os << "# HELP cache_shard_hits_total Cache hits per shard\n"
+           << "# TYPE cache_shard_hits_total counter\n";
+        for (size_t i = 0; i < shards.size(); ++i)
+          os << "cache_shard_hits_total{shard=\"" << i << "\"} " << shards[i].hits << "\n";
+        os << "# HELP cache_shard_misses_total Cache misses per shard\n"
+           << "# TYPE cache_shard_misses_total counter\n";
+        for (size_t i = 0; i < shards.size(); ++i)
+          os << "cache_shard_misses_total{shard=\"" << i << "\"} " << shards[i].misses << "\n";
+        os << "# HELP cache_shard_evictions_total Evictions per shard\n"
+           << "# TYPE cache_shard_evictions_total counter\n";
+        for (size_t i = 0; i < shards.size(); ++i)
+          os << "cache_shard_evictions_total{shard=\"" << i << "\"} " << shards[i].evictions << "\n";
+      }
+    }
 
-    // FIX 1: Correct Prometheus cumulative bucket math.
-    // Accumulate ONLY finite buckets first, then add +Inf as the total.
-    uint64_t cumulative = 0;
+    os << "# HELP cache_eviction_pool_hits_total Evictions served from the pre-scored victim pool\n"
+       << "# TYPE cache_eviction_pool_hits_total counter\n"
+       << "cache_eviction_pool_hits_total " << pool_hits_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_eviction_pool_misses_total Evictions that fell back to LRU (pool empty)\n"
+       << "# TYPE cache_eviction_pool_misses_total counter\n"
+       << "cache_eviction_pool_misses_total " << pool_misses_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_eviction_scoring_failures_total Batch scoring calls that failed\n"
+       << "# TYPE cache_eviction_scoring_failures_total counter\n"
+       << "cache_eviction_scoring_failures_total " << scoring_failures_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_eviction_scoring_batch_us Batch scoring round-trip (us)\n"
+       << "# TYPE cache_eviction_scoring_batch_us summary\n"
+       << "cache_eviction_scoring_batch_us_sum " << scoring_batch_us_sum_.load(std::memory_order_relaxed) << "\n"
+       << "cache_eviction_scoring_batch_us_count " << scoring_batches_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_eviction_victim_age_us Scoring lag: age of a pooled victim when evicted (us)\n"
+       << "# TYPE cache_eviction_victim_age_us summary\n"
+       << "cache_eviction_victim_age_us_sum " << victim_age_us_sum_.load(std::memory_order_relaxed) << "\n"
+       << "cache_eviction_victim_age_us_count " << victim_age_count_.load(std::memory_order_relaxed) << "\n";
 
-    // finite buckets (<= bound)
-    for (size_t i = 0; i < bucket_bounds_us_.size(); ++i) {
-      cumulative += hist_[i].load(std::memory_order_relaxed);
-      os << "cache_get_latency_us_bucket{le=\"" << bucket_le_label(i) << "\"} "
-         << cumulative << "\n";
+    {
+      std::lock_guard<std::mutex> lock(source_mu_);
+      for (const auto& g : gauges_) {
+        os << "# HELP " << g.name << " " << g.help << "\n"
+           << "# TYPE " << g.name << " " << g.type << "\n"
+           << g.name << " " << g.fn() << "\n";
+      }
     }
 
-    // +Inf bucket includes everything
-    cumulative += hist_[bucket_bounds_us_.size()].load(std::memory_order_relaxed);
-    os << "cache_get_latency_us_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    os << "# HELP cache_origin_fetch_ms Successful read-through origin fetches (ms)\n"
+       << "# TYPE cache_origin_fetch_ms summary\n"
+       << "cache_origin_fetch_ms_sum " << origin_fetch_ms_sum_.load(std::memory_order_relaxed) << "\n"
+       << "cache_origin_fetch_ms_count " << origin_fetches_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_origin_coalesced_total Misses that joined an in-flight origin fetch\n"
+       << "# TYPE cache_origin_coalesced_total counter\n"
+       << "cache_origin_coalesced_total " << origin_coalesced_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_origin_errors_total Origin fetches that failed or timed out\n"
+       << "# TYPE cache_origin_errors_total counter\n"
+       << "cache_origin_errors_total " << origin_errors_.load(std::memory_order_relaxed) << "\n";
 
-    // sum & count (sum is 0 in this MVP)
-    os << "cache_get_latency_us_sum 0\n";
-    os << "cache_get_latency_us_count " << cumulative << "\n";
+    os << "# HELP cache_log_records_total Access log records written\n"
+       << "# TYPE cache_log_records_total counter\n"
+       << "cache_log_records_total " << log_records_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_log_dropped_total Access log records dropped because the writer fell behind\n"
+       << "# TYPE cache_log_dropped_total counter\n"
+       << "cache_log_dropped_total " << log_dropped_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_log_batches_total Batched access log writes\n"
+       << "# TYPE cache_log_batches_total counter\n"
+       << "cache_log_batches_total " << log_batches_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_log_bytes_total Access log bytes written\n"
+       << "# TYPE cache_log_bytes_total counter\n"
+       << "cache_log_bytes_total " << log_bytes_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_log_rotations_total Access log file rotations\n"
+       << "# TYPE cache_log_rotations_total counter\n"
+       << "cache_log_rotations_total " << log_rotations_.load(std::memory_order_relaxed) << "\n";
+
+    os << "# HELP cache_expired_total Entries removed after their ttl and stale window\n"
+       << "# TYPE cache_expired_total counter\n"
+       << "cache_expired_total " << expired_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_stale_served_total Hits served from the stale-while-revalidate window\n"
+       << "# TYPE cache_stale_served_total counter\n"
+       << "cache_stale_served_total " << stale_served_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_revalidations_total Stale hits that triggered a refresh\n"
+       << "# TYPE cache_revalidations_total counter\n"
+       << "cache_revalidations_total " << revalidations_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_expiry_reaper_runs_total Timer wheel reaper passes\n"
+       << "# TYPE cache_expiry_reaper_runs_total counter\n"
+       << "cache_expiry_reaper_runs_total " << reaper_runs_.load(std::memory_order_relaxed) << "\n";
+
+    os << "# HELP cache_compress_attempts_total Values considered for compression\n"
+       << "# TYPE cache_compress_attempts_total counter\n"
+       << "cache_compress_attempts_total " << compress_attempts_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_compressed_values_total Values stored compressed\n"
+       << "# TYPE cache_compressed_values_total counter\n"
+       << "cache_compressed_values_total " << compressed_values_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_compress_raw_bytes_total Uncompressed bytes of values stored compressed\n"
+       << "# TYPE cache_compress_raw_bytes_total counter\n"
+       << "cache_compress_raw_bytes_total " << compress_raw_bytes_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_compress_stored_bytes_total Compressed bytes of values stored compressed\n"
+       << "# TYPE cache_compress_stored_bytes_total counter\n"
+       << "cache_compress_stored_bytes_total " << compress_stored_bytes_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_served_encoded_total Hits sent gzip-encoded without decompressing\n"
+       << "# TYPE cache_served_encoded_total counter\n"
+       << "cache_served_encoded_total " << served_encoded_.load(std::memory_order_relaxed) << "\n";
+
+    os << "# HELP cache_snapshots_total Snapshots written\n"
+       << "# TYPE cache_snapshots_total counter\n"
+       << "cache_snapshots_total " << snapshots_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_snapshot_failures_total Snapshots that failed to write\n"
+       << "# TYPE cache_snapshot_failures_total counter\n"
+       << "cache_snapshot_failures_total " << snapshot_failures_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_snapshot_last_ms Duration of the last snapshot (ms)\n"
+       << "# TYPE cache_snapshot_last_ms gauge\n"
+       << "cache_snapshot_last_ms " << snapshot_last_ms_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_snapshot_last_bytes Size of the last snapshot file\n"
+       << "# TYPE cache_snapshot_last_bytes gauge\n"
+       << "cache_snapshot_last_bytes " << snapshot_last_bytes_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_snapshot_restore_ms Startup restore duration (ms)\n"
+       << "# TYPE cache_snapshot_restore_ms gauge\n"
+       << "cache_snapshot_restore_ms " << restore_ms_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_snapshot_restored_entries Entries restored at startup\n"
+       << "# TYPE cache_snapshot_restored_entries gauge\n"
+       << "cache_snapshot_restored_entries " << restore_entries_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_snapshot_restore_skipped_sections Snapshot sections skipped for a bad checksum\n"
+       << "# TYPE cache_snapshot_restore_skipped_sections gauge\n"
+       << "cache_snapshot_restore_skipped_sections " << restore_skipped_sections_.load(std::memory_order_relaxed) << "\n";
+
+    os << "# HELP cache_model_reloads_total Native eviction model (re)loads\n"
+       << "# TYPE cache_model_reloads_total counter\n"
+       << "cache_model_reloads_total " << model_reloads_.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP cache_model_reload_failures_total Native model files that failed to parse\n"
+       << "# TYPE cache_model_reload_failures_total counter\n"
+       << "cache_model_reload_failures_total " << model_reload_failures_.load(std::memory_order_relaxed) << "\n";
+
+    os << "# HELP cache_sidecar_fallbacks_total Sidecar scoring calls that failed and fell back\n"
+       << "# TYPE cache_sidecar_fallbacks_total counter\n"
+       << "cache_sidecar_fallbacks_total " << sidecar_fallbacks_.load(std::memory_order_relaxed) << "\n";
+    for (const auto& h : histograms())
+      LatencyHistogram::write_prom(os, h.prom_name, h.help, (this->*h.member).snapshot());
     return os.str();
   }
 
 private:
   Metrics() = default;
 
-  std::string bucket_label(size_t i) const {
-    if (i + 1 == BUCKETS) return "gt_10000"; // >10ms
-    return std::string("le_") + std::to_string(bucket_bounds_us_[i]);
+  std::vector<ShardStats> shard_stats() {
+    std::lock_guard<std::mutex> lock(source_mu_);
+    if (!shard_source_) return {};
+    return shard_source_();
   }
-  std::string bucket_le_label(size_t i) const {
-    if (i + 1 == BUCKETS) return "10000";
-    return std::to_string(bucket_bounds_us_[i]);
+
+  static void write_json_string(std::ostream& os, const std::string& s) {
+    static const char* hex = "0123456789abcdef";
+    os << '"';
+    for (unsigned char c : s) {
+      if (c == '"' || c == '\\') os << '\\' << char(c);
+      else if (c < 0x20) os << "\\u00" << hex[c >> 4] << hex[c & 15];
+      else os << char(c);
+    }
+    os << '"';
+  }
+
+  struct HistogramInfo {
+    const char* json_name;
+    const char* prom_name;
+    const char* help;
+    LatencyHistogram Metrics::* member;
+  };
+  static const std::array<HistogramInfo, 11>& histograms() {
+    static const std::array<HistogramInfo, 11> list{{
+      {"get", "cache_get_latency_us", "GET request latency (us)", &Metrics::get_latency_},
+      {"put", "cache_put_latency_us", "PUT request latency (us)", &Metrics::put_latency_},
+      {"evict", "cache_evict_decision_us", "Time to choose and remove one eviction victim (us)", &Metrics::evict_latency_},
+      {"sidecar_rtt", "cache_sidecar_rtt_us", "ML sidecar /score round-trip (us)", &Metrics::sidecar_rtt_},
+      {"lock_wait", "cache_lock_wait_us", "Shard lock waits on GET/PUT when the lock was contended (us)", &Metrics::lock_wait_},
+      {"log_write", "cache_log_write_us", "Access log batch encode and write (us)", &Metrics::log_write_latency_},
+      {"expiry_reap", "cache_expiry_reap_us", "One timer wheel reaper pass over all shards (us)", &Metrics::reap_latency_},
+      {"compress", "cache_compress_us", "Compressing one value on put, kept or not (us)", &Metrics::compress_latency_},
+      {"decompress", "cache_decompress_us", "Decompressing one value for a reader (us)", &Metrics::decompress_latency_},
+      {"spill_read", "cache_spill_read_us", "Disk tier read after a RAM miss (us)", &Metrics::spill_read_latency_},
+      {"peer_rtt", "cache_peer_rtt_us", "Request forwarded to the owning cluster node, round trip (us)", &Metrics::peer_rtt_},
+    }};
+    return list;
   }
 
   // counters/gauges
@@ -109,15 +490,74 @@ private:
   std::atomic<uint64_t> hits_{0};
   std::atomic<uint64_t> misses_{0};
   std::atomic<uint64_t> current_size_{0};
+  std::atomic<uint64_t> resident_bytes_{0};
+  std::atomic<uint64_t> put_rejected_{0};
+  std::atomic<uint64_t> put_not_admitted_{0};
+
+  struct Gauge {
+    std::string name, help, type;
+    std::function<double()> fn;
+  };
+
+  std::mutex source_mu_;
+  std::function<std::vector<ShardStats>()> shard_source_;
+  std::function<std::vector<HotKeyStat>()> hot_source_;
+  std::vector<Gauge> gauges_;
+
+  std::atomic<uint64_t> origin_fetches_{0};
+  std::atomic<uint64_t> origin_fetch_ms_sum_{0};
+  std::atomic<uint64_t> origin_coalesced_{0};
+  std::atomic<uint64_t> origin_errors_{0};
+
+  std::atomic<uint64_t> log_records_{0};
+  std::atomic<uint64_t> log_dropped_{0};
+  std::atomic<uint64_t> log_batches_{0};
+  std::atomic<uint64_t> log_bytes_{0};
+  std::atomic<uint64_t> log_rotations_{0};
+
+  std::atomic<uint64_t> expired_{0};
+  std::atomic<uint64_t> stale_served_{0};
+  std::atomic<uint64_t> revalidations_{0};
+  std::atomic<uint64_t> reaper_runs_{0};
+
+  std::atomic<uint64_t> compress_attempts_{0};
+  std::atomic<uint64_t> compressed_values_{0};
+  std::atomic<uint64_t> compress_raw_bytes_{0};
+  std::atomic<uint64_t> compress_stored_bytes_{0};
+  std::atomic<uint64_t> served_encoded_{0};
+
+  std::atomic<uint64_t> snapshots_{0};
+  std::atomic<uint64_t> snapshot_failures_{0};
+  std::atomic<uint64_t> snapshot_last_ms_{0};
+  std::atomic<uint64_t> snapshot_last_bytes_{0};
+  std::atomic<uint64_t> snapshot_last_entries_{0};
+  std::atomic<uint64_t> restore_ms_{0};
+  std::atomic<uint64_t> restore_entries_{0};
+  std::atomic<uint64_t> restore_skipped_sections_{0};
+
+  std::atomic<uint64_t> model_reloads_{0};
+  std::atomic<uint64_t> model_reload_failures_{0};
 
-  // histogram buckets
-  static constexpr std::array<uint64_t,5> bucket_bounds_us_{100, 300, 1000, 3000, 10000};
-  static constexpr size_t BUCKETS = bucket_bounds_us_.size() + 1; // +Inf
-  std::array<std::atomic<uint64_t>, BUCKETS> hist_{}; // value-initialized to 0
+  // async eviction engine
+  std::atomic<uint64_t> pool_hits_{0};
+  std::atomic<uint64_t> pool_misses_{0};
+  std::atomic<uint64_t> scoring_failures_{0};
+  std::atomic<uint64_t> scoring_batches_{0};
+  std::atomic<uint64_t> scoring_batch_us_sum_{0};
+  std::atomic<uint64_t> victim_age_us_sum_{0};
+  std::atomic<uint64_t> victim_age_count_{0};
 
-  //Recent changes below: 
+  std::atomic<uint64_t> sidecar_fallbacks_{0};
 
-  // REMOVED: std::array<uint64_t, BUCKETS> buckets_{};
-  // This array was only used to query size in loops (non-optimal).
-  // Use BUCKETS or hist_.size() instead.
+  LatencyHistogram get_latency_;
+  LatencyHistogram put_latency_;
+  LatencyHistogram evict_latency_;
+  LatencyHistogram sidecar_rtt_;
+  LatencyHistogram lock_wait_;
+  LatencyHistogram log_write_latency_;
+  LatencyHistogram reap_latency_;
+  LatencyHistogram compress_latency_;
+  LatencyHistogram decompress_latency_;
+  LatencyHistogram spill_read_latency_;
+  LatencyHistogram peer_rtt_;
 };
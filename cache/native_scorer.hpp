@@ -0,0 +1,229 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+
+#include "eviction.hpp"
+#include "metrics.hpp"
+
+// Logistic model exported by ml_sidecar/train.py (models/model.txt):
+//
+//   geocache-model 1
+//   type logreg
+//   transform none            (or log1p, applied to every feature)
+//   mean  m0 m1 m2 m3         (optional, default 0)
+//   scale s0 s1 s2 s3         (optional, default 1)
+//   coef  w0 w1 w2 w3
+//   intercept b
+//
+// Feature order: recency_us, access_count, size_bytes, fetch_cost_ms.
+struct NativeModel {
+  static constexpr size_t kFeatures = 4;
+
+  bool log1p = false;
+  // standardization folded into the weights: z = bias + sum(w[i] * x[i])
+  std::array<float, kFeatures> w{};
+  float bias = 0.f;
+
+  static std::optional<NativeModel> parse(std::istream& in) {
+    std::string tag; int version = 0;
+    if (!(in >> tag >> version) || tag != "geocache-model" || version != 1) return std::nullopt;
+
+    std::array<double, kFeatures> mean{}, scale{1, 1, 1, 1}, coef{};
+    double intercept = 0;
+    bool have_coef = false;
+    NativeModel m;
+    std::string field;
+    while (in >> field) {
+      if (field == "type") {
+        std::string t; in >> t;
+        if (t != "logreg") return std::nullopt;
+      } else if (field == "transform") {
+        std::string t; in >> t;
+        if (t == "log1p") m.log1p = true;
+        else if (t != "none") return std::nullopt;
+      } else if (field == "mean") {
+        for (auto& v : mean) in >> v;
+      } else if (field == "scale") {
+        for (auto& v : scale) in >> v;
+      } else if (field == "coef") {
+        for (auto& v : coef) in >> v;
+        have_coef = true;
+      } else if (field == "intercept") {
+        in >> intercept;
+      } else {
+        return std::nullopt;
+      }
+      if (!in) return std::nullopt;
+    }
+    if (!have_coef) return std::nullopt;
+
+    double b = intercept;
+    for (size_t i = 0; i < kFeatures; ++i) {
+      if (scale[i] == 0) return std::nullopt;
+      m.w[i] = static_cast<float>(coef[i] / scale[i]);
+      b -= coef[i] * mean[i] / scale[i];
+    }
+    m.bias = static_cast<float>(b);
+    return m;
+  }
+};
+
+// Structure-of-arrays feature batch, padded to the SIMD width
+struct FeatureBatch {
+  static constexpr size_t kLanes = 8;
+
+  size_t n = 0;
+  std::array<std::vector<float>, NativeModel::kFeatures> col;
+
+  void fill(const std::vector<CandidateFeatures>& rows, bool log1p) {
+    n = rows.size();
+    const size_t padded = (n + kLanes - 1) / kLanes * kLanes;
+    for (auto& c : col) c.assign(padded, 0.f);
+    for (size_t i = 0; i < n; ++i) {
+      col[0][i] = static_cast<float>(rows[i].recency_us);
+      col[1][i] = static_cast<float>(rows[i].access_count);
+      col[2][i] = static_cast<float>(rows[i].size_bytes);
+      col[3][i] = static_cast<float>(rows[i].fetch_cost_ms);
+    }
+    if (log1p) {
+      for (auto& c : col)
+        for (size_t i = 0; i < n; ++i) c[i] = std::log1p(c[i]);
+    }
+  }
+};
+
+namespace native_kernel {
+
+inline void logits_scalar(const NativeModel& m, const FeatureBatch& b, float* out) {
+  const size_t padded = b.col[0].size();
+  for (size_t i = 0; i < padded; ++i) {
+    float z = m.bias;
+    for (size_t f = 0; f < NativeModel::kFeatures; ++f) z += m.w[f] * b.col[f][i];
+    out[i] = z;
+  }
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// 8 candidates per iteration; compiled for AVX2/FMA, picked at runtime
+__attribute__((target("avx2,fma")))
+inline void logits_avx2(const NativeModel& m, const FeatureBatch& b, float* out) {
+  const size_t padded = b.col[0].size();
+  const __m256 bias = _mm256_set1_ps(m.bias);
+  const __m256 w0 = _mm256_set1_ps(m.w[0]), w1 = _mm256_set1_ps(m.w[1]);
+  const __m256 w2 = _mm256_set1_ps(m.w[2]), w3 = _mm256_set1_ps(m.w[3]);
+  for (size_t i = 0; i < padded; i += FeatureBatch::kLanes) {
+    __m256 z = _mm256_fmadd_ps(w0, _mm256_loadu_ps(&b.col[0][i]), bias);
+    z = _mm256_fmadd_ps(w1, _mm256_loadu_ps(&b.col[1][i]), z);
+    z = _mm256_fmadd_ps(w2, _mm256_loadu_ps(&b.col[2][i]), z);
+    z = _mm256_fmadd_ps(w3, _mm256_loadu_ps(&b.col[3][i]), z);
+    _mm256_storeu_ps(out + i, z);
+  }
+}
+
+inline bool has_avx2() {
+  static const bool ok = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return ok;
+}
+#endif
+
+inline void logits(const NativeModel& m, const FeatureBatch& b, float* out) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  if (has_avx2()) { logits_avx2(m, b, out); return; }
+#endif
+  logits_scalar(m, b, out);
+}
+
+} // namespace native_kernel
+
+// In-process ML eviction: scores candidates with the exported model instead
+// of a sidecar round-trip. The model file is re-read when its mtime changes.
+struct NativeModelStrategy : EvictionStrategy {
+  explicit NativeModelStrategy(std::string path,
+                               std::chrono::milliseconds reload_check = std::chrono::milliseconds(1000))
+    : path_(std::move(path)), reload_check_(reload_check) {
+    maybe_reload(/*force=*/true);
+  }
+
+  bool supports_batch_scoring() const override { return true; }
+
+  std::optional<std::string>
+  choose_victim(const std::vector<std::string>& candidates) override {
+    auto probs = score_batch(candidates);
+    if (!probs) return std::nullopt; // no model loaded → LRU
+    return lowest_scored(candidates, *probs);
+  }
+
+  std::optional<std::vector<double>>
+  score_batch(const std::vector<std::string>& candidates) override {
+    if (candidates.empty()) return std::nullopt;
+    maybe_reload(false);
+    auto model = std::atomic_load(&model_);
+    if (!model) return std::nullopt;
+
+    thread_local FeatureBatch batch;
+    thread_local std::vector<float> z;
+    batch.fill(collect_features(candidates), model->log1p);
+    z.resize(batch.col[0].size());
+    native_kernel::logits(*model, batch, z.data());
+
+    std::vector<double> out(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) out[i] = 1.0 / (1.0 + std::exp(-double(z[i])));
+    return out;
+  }
+
+  // Swap in new coefficients without pausing scoring
+  void set_model(NativeModel m) {
+    std::atomic_store(&model_, std::make_shared<const NativeModel>(m));
+  }
+
+  std::shared_ptr<const NativeModel> model() const { return std::atomic_load(&model_); }
+
+private:
+  void maybe_reload(bool force) {
+    using Clock = std::chrono::steady_clock;
+    const auto now = Clock::now().time_since_epoch().count();
+    auto next = next_check_.load(std::memory_order_relaxed);
+    if (!force && now < next) return;
+    // one thread checks per interval
+    if (!force && !next_check_.compare_exchange_strong(
+          next, now + std::chrono::duration_cast<Clock::duration>(reload_check_).count()))
+      return;
+
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path_, ec);
+    if (ec) return;
+    std::lock_guard<std::mutex> lock(reload_mu_);
+    if (!force && loaded_mtime_ && *loaded_mtime_ == mtime) return;
+
+    std::ifstream in(path_);
+    auto m = NativeModel::parse(in);
+    loaded_mtime_ = mtime;  // a bad file is not retried until it changes
+    if (!m) {
+      Metrics::instance().inc_model_reload_failures();
+      return;  // keep serving the previous model
+    }
+    set_model(*m);
+    Metrics::instance().inc_model_reloads();
+  }
+
+  std::string path_;
+  std::chrono::milliseconds reload_check_;
+  std::atomic<std::chrono::steady_clock::rep> next_check_{0};
+  std::mutex reload_mu_;
+  std::optional<std::filesystem::file_time_type> loaded_mtime_;
+  std::shared_ptr<const NativeModel> model_;
+};
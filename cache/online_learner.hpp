@@ -0,0 +1,304 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "eviction.hpp"
+#include "key_stats.hpp"
+#include "metrics.hpp"
+#include "native_scorer.hpp"
+
+struct LearnerConfig {
+  std::chrono::milliseconds horizon{60000};   // reuse within this long is a positive label
+  double sample_rate = 0.1;                   // share of accesses that become observations
+  size_t shadow_keys = 100000;                // observations awaiting a label; oldest dropped past it
+  double learning_rate = 0.01;
+  double l2 = 1e-5;
+  size_t publish_every = 1000;                // labelled examples between model swaps
+  size_t min_examples = 1000;                 // before the first swap
+  size_t max_queued = size_t{1} << 16;        // events waiting for the trainer; more are dropped
+};
+
+// Trains the NATIVE scorer's logistic model online, in the same four
+// features and label as ml_sidecar/make_labels.py. Accesses and evictions
+// are queued as fixed-size events (key hash, time, features); a background
+// thread turns sampled accesses and every eviction into observations and
+// keeps them in a shadow window keyed by hash. The next access within the
+// horizon labels an observation 1; one that ages out of the horizon is
+// labelled 0. Evicted keys stay in the window, so premature evictions
+// become positive examples.
+//
+// Each example is scored before it is learned from (prequential accuracy),
+// then applied as one SGD step on log1p features standardized by
+// exponentially weighted mean and variance. Every publish_every examples the
+// standardization is folded into the weights and the NativeModel is handed
+// to the publish callback, e.g. NativeModelStrategy::set_model, which swaps
+// it in atomically. Drift compares fast and slow moving averages of the
+// features and the label.
+class OnlineLearner {
+public:
+  using Publish = std::function<void(const NativeModel&)>;
+
+  OnlineLearner(LearnerConfig cfg, Publish publish)
+    : cfg_(cfg), publish_(std::move(publish)) {
+    auto& m = Metrics::instance();
+    m.register_gauge("cache_learn_examples_total", "Labelled examples the online model trained on",
+                     [this] { return double(examples_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_learn_pending", "Observations in the shadow window awaiting a label",
+                     [this] { return double(pending_count_.load(std::memory_order_relaxed)); });
+    m.register_gauge("cache_learn_dropped_total", "Events or observations dropped (queue full or window overflow)",
+                     [this] { return double(dropped_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_learn_models_published_total", "Online models swapped into the scorer",
+                     [this] { return double(published_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_learn_accuracy", "Prequential accuracy of the online model, ~1000 examples",
+                     [this] { return accuracy_.load(std::memory_order_relaxed); });
+    m.register_gauge("cache_learn_recent_accuracy", "Prequential accuracy of the online model, ~50 examples",
+                     [this] { return recent_accuracy_.load(std::memory_order_relaxed); });
+    m.register_gauge("cache_learn_log_loss", "Prequential log loss of the online model",
+                     [this] { return log_loss_.load(std::memory_order_relaxed); });
+    m.register_gauge("cache_learn_positive_rate", "Share of examples reused within the horizon",
+                     [this] { return positive_rate_.load(std::memory_order_relaxed); });
+    m.register_gauge("cache_learn_feature_drift", "Largest fast-vs-slow feature mean shift, in std devs",
+                     [this] { return feature_drift_.load(std::memory_order_relaxed); });
+    m.register_gauge("cache_learn_label_drift", "Fast-vs-slow shift of the positive rate",
+                     [this] { return label_drift_.load(std::memory_order_relaxed); });
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~OnlineLearner() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  // Both are cheap enough for the request path and the shard lock
+  void on_access(const std::string& key, const CandidateFeatures& f, uint64_t now_us) {
+    push(Event{std::hash<std::string>{}(key), now_us, to_array(f), Event::Access});
+  }
+  void on_evict(const std::string& key, const CandidateFeatures& f, uint64_t now_us) {
+    push(Event{std::hash<std::string>{}(key), now_us, to_array(f), Event::Evict});
+  }
+
+  // Latest published model, or nullptr before the first
+  std::shared_ptr<const NativeModel> model() const { return std::atomic_load(&model_); }
+
+private:
+  static constexpr size_t kFeatures = NativeModel::kFeatures;
+  static constexpr size_t kStripes = 16;
+  static constexpr double kSlowAlpha = 1e-3, kFastAlpha = 0.02;
+  using Vec = std::array<float, kFeatures>;
+
+  struct Event {
+    enum Kind : uint8_t { Access, Evict };
+    uint64_t hash;
+    uint64_t ts_us;
+    Vec x;
+    Kind kind;
+  };
+
+  struct Observation {
+    Vec x;
+    uint64_t ts_us;
+    uint64_t seq;
+  };
+
+  struct alignas(64) Stripe {
+    std::mutex mu;
+    std::vector<Event> events;
+  };
+
+  static Vec to_array(const CandidateFeatures& f) {
+    return {float(f.recency_us), float(f.access_count), float(f.size_bytes), float(f.fetch_cost_ms)};
+  }
+
+  // events of one key always share a stripe, so they stay in order
+  void push(const Event& e) {
+    Stripe& s = stripes_[e.hash % kStripes];
+    std::lock_guard<std::mutex> lock(s.mu);
+    if (s.events.size() >= cfg_.max_queued / kStripes) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    s.events.push_back(e);
+  }
+
+  void run() {
+    std::vector<Event> batch, part;
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stop_) {
+      cv_.wait_for(lock, std::chrono::milliseconds(100), [this] { return stop_; });
+      if (stop_) break;
+      lock.unlock();
+      batch.clear();
+      for (auto& s : stripes_) {
+        {
+          std::lock_guard<std::mutex> sl(s.mu);
+          part.swap(s.events);
+        }
+        batch.insert(batch.end(), part.begin(), part.end());
+        part.clear();
+      }
+      std::stable_sort(batch.begin(), batch.end(),
+                       [](const Event& a, const Event& b) { return a.ts_us < b.ts_us; });
+      for (const auto& e : batch) process(e);
+      // events stamped just before the drain may still be queued; give them a second
+      age_out(KeyStatsStore::nowMicros() - 1000000);
+      publish_stats();
+      lock.lock();
+    }
+  }
+
+  void process(const Event& e) {
+    const uint64_t horizon_us = uint64_t(cfg_.horizon.count()) * 1000;
+    auto it = pending_.find(e.hash);
+    if (it != pending_.end()) {
+      // an eviction replaces the key's open observation rather than labelling it
+      if (e.kind == Event::Access) learn(it->second.x, e.ts_us <= it->second.ts_us + horizon_us);
+      pending_.erase(it);
+    }
+    if (e.kind == Event::Evict || unit_(rng_) < cfg_.sample_rate) observe(e);
+  }
+
+  void observe(const Event& e) {
+    while (pending_.size() >= cfg_.shadow_keys && !order_.empty()) {
+      auto [h, seq] = order_.front();
+      order_.pop_front();
+      auto it = pending_.find(h);
+      if (it != pending_.end() && it->second.seq == seq) {
+        pending_.erase(it);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    const uint64_t seq = ++seq_;
+    pending_[e.hash] = Observation{e.x, e.ts_us, seq};
+    order_.emplace_back(e.hash, seq);
+    // compact order entries of observations already labelled or replaced
+    if (order_.size() > 2 * pending_.size() + 1024) {
+      std::deque<std::pair<uint64_t, uint64_t>> kept;
+      for (auto& o : order_) {
+        auto it = pending_.find(o.first);
+        if (it != pending_.end() && it->second.seq == o.second) kept.push_back(o);
+      }
+      order_.swap(kept);
+    }
+  }
+
+  // Observations older than the horizon were not reused: label 0
+  void age_out(uint64_t now_us) {
+    const uint64_t horizon_us = uint64_t(cfg_.horizon.count()) * 1000;
+    while (!order_.empty()) {
+      auto [h, seq] = order_.front();
+      auto it = pending_.find(h);
+      if (it == pending_.end() || it->second.seq != seq) { order_.pop_front(); continue; }
+      if (it->second.ts_us + horizon_us >= now_us) break;
+      learn(it->second.x, false);
+      pending_.erase(it);
+      order_.pop_front();
+    }
+  }
+
+  void learn(const Vec& raw, bool label) {
+    const double y = label ? 1.0 : 0.0;
+    ++n_;
+    const double a = std::max(1.0 / double(n_), kSlowAlpha);
+    const double af = std::max(1.0 / double(n_), kFastAlpha);
+    std::array<double, kFeatures> s{};
+    double z = bias_;
+    for (size_t i = 0; i < kFeatures; ++i) {
+      const double x = std::log1p(double(raw[i]));
+      const double d = x - mean_[i];
+      mean_[i] += a * d;
+      var_[i] = (1 - a) * (var_[i] + a * d * d);
+      fast_mean_[i] += af * (x - fast_mean_[i]);
+      s[i] = (x - mean_[i]) / sd(i);
+      z += w_[i] * s[i];
+    }
+
+    // score before learning from it
+    const double p = 1.0 / (1.0 + std::exp(-z));
+    const double hit = (p >= 0.5) == label ? 1.0 : 0.0;
+    const double pc = std::clamp(label ? p : 1 - p, 1e-7, 1.0);
+    acc_ += a * (hit - acc_);
+    recent_acc_ += af * (hit - recent_acc_);
+    loss_ += a * (-std::log(pc) - loss_);
+    pos_ += a * (y - pos_);
+    fast_pos_ += af * (y - fast_pos_);
+
+    const double g = p - y;
+    for (size_t i = 0; i < kFeatures; ++i) w_[i] -= cfg_.learning_rate * (g * s[i] + cfg_.l2 * w_[i]);
+    bias_ -= cfg_.learning_rate * g;
+
+    const uint64_t n = examples_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (n >= cfg_.min_examples && n % std::max<size_t>(1, cfg_.publish_every) == 0) publish_model();
+  }
+
+  double sd(size_t i) const { return std::max(std::sqrt(var_[i]), 1e-3); }
+
+  // Folds the standardization into the weights, as NativeModel::parse does
+  void publish_model() {
+    NativeModel m;
+    m.log1p = true;
+    double b = bias_;
+    for (size_t i = 0; i < kFeatures; ++i) {
+      m.w[i] = static_cast<float>(w_[i] / sd(i));
+      b -= w_[i] * mean_[i] / sd(i);
+    }
+    m.bias = static_cast<float>(b);
+    std::atomic_store(&model_, std::make_shared<const NativeModel>(m));
+    if (publish_) publish_(m);
+    published_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void publish_stats() {
+    double drift = 0;
+    for (size_t i = 0; i < kFeatures; ++i) drift = std::max(drift, std::abs(fast_mean_[i] - mean_[i]) / sd(i));
+    pending_count_.store(pending_.size(), std::memory_order_relaxed);
+    accuracy_.store(acc_, std::memory_order_relaxed);
+    recent_accuracy_.store(recent_acc_, std::memory_order_relaxed);
+    log_loss_.store(loss_, std::memory_order_relaxed);
+    positive_rate_.store(pos_, std::memory_order_relaxed);
+    feature_drift_.store(drift, std::memory_order_relaxed);
+    label_drift_.store(std::abs(fast_pos_ - pos_), std::memory_order_relaxed);
+  }
+
+  LearnerConfig cfg_;
+  Publish publish_;
+  std::array<Stripe, kStripes> stripes_;
+
+  // trainer thread only
+  std::unordered_map<uint64_t, Observation> pending_;
+  std::deque<std::pair<uint64_t, uint64_t>> order_;   // FIFO of (hash, seq)
+  uint64_t seq_ = 0;
+  std::mt19937_64 rng_{0x9e3779b97f4a7c15ULL};
+  std::uniform_real_distribution<double> unit_{0.0, 1.0};
+  uint64_t n_ = 0;
+  std::array<double, kFeatures> w_{}, mean_{}, var_{}, fast_mean_{};
+  double bias_ = 0, acc_ = 0, recent_acc_ = 0, loss_ = 0, pos_ = 0, fast_pos_ = 0;
+
+  std::shared_ptr<const NativeModel> model_;
+  std::atomic<uint64_t> examples_{0}, dropped_{0}, published_{0};
+  std::atomic<size_t> pending_count_{0};
+  std::atomic<double> accuracy_{0}, recent_accuracy_{0}, log_loss_{0}, positive_rate_{0},
+                      feature_drift_{0}, label_drift_{0};
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::thread thread_;
+};
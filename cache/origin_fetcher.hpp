@@ -0,0 +1,278 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "../third_party/json.hpp"
+#include "metrics.hpp"
+#include "value_buffer.hpp"
+
+struct OriginConfig {
+  // e.g. http://127.0.0.1:7000/content/{key}?delay_ms=120
+  std::string url_template;
+  size_t max_inflight = 32;                    // concurrent origin requests
+  std::chrono::milliseconds timeout{2000};     // per fetch, including queueing
+};
+
+// Read-through origin client with request coalescing: concurrent misses on
+// the same key share one in-flight fetch, and at most max_inflight fetches
+// run at once over a pool of keep-alive connections. Background refreshes
+// run on a few worker threads the fetcher owns and joins.
+class OriginFetcher {
+public:
+  struct Result {
+    int         status = 0;      // origin HTTP status; 0 = transport error, 504 = timed out
+    ValueRef    value;           // shared by the leader, followers and the cache
+    uint64_t    fetch_ms = 0;    // origin latency seen by the leader
+    bool        coalesced = false;
+    bool ok() const { return status == 200; }
+  };
+
+  explicit OriginFetcher(OriginConfig cfg) : cfg_(std::move(cfg)) {
+    if (cfg_.max_inflight == 0) cfg_.max_inflight = 1;
+    // split "scheme://host:port" from the path template
+    const auto scheme_end = cfg_.url_template.find("://");
+    const auto path_start = cfg_.url_template.find('/', scheme_end == std::string::npos ? 0 : scheme_end + 3);
+    base_ = cfg_.url_template.substr(0, path_start);
+    path_template_ = path_start == std::string::npos ? "/{key}" : cfg_.url_template.substr(path_start);
+  }
+
+  // Queued refreshes are dropped; running ones finish first
+  ~OriginFetcher() {
+    {
+      std::lock_guard<std::mutex> lock(refresh_mu_);
+      stopping_ = true;
+      refreshes_.clear();
+    }
+    refresh_cv_.notify_all();
+    for (auto& t : workers_) t.join();
+  }
+
+  OriginFetcher(const OriginFetcher&) = delete;
+  OriginFetcher& operator=(const OriginFetcher&) = delete;
+
+  // fetch(key, on_fill) on a background worker, for refreshes no request
+  // waits on; dropped while kMaxQueuedRefreshes are already waiting.
+  // on_fill must stay valid until the fetcher is destroyed.
+  void refresh(std::string key, std::function<void(const Result&)> on_fill) {
+    {
+      std::lock_guard<std::mutex> lock(refresh_mu_);
+      if (stopping_ || refreshes_.size() >= kMaxQueuedRefreshes) return;
+      refreshes_.emplace_back(std::move(key), std::move(on_fill));
+      if (workers_.empty())
+        for (size_t i = 0; i < std::min(kRefreshThreads, cfg_.max_inflight); ++i)
+          workers_.emplace_back([this] { refresh_loop(); });
+    }
+    refresh_cv_.notify_one();
+  }
+
+  // on_fill runs once, in the leader, before followers are released, so a
+  // cache fill is visible to everyone woken by this fetch.
+  template <typename OnFill>
+  Result fetch(const std::string& key, OnFill&& on_fill) {
+    std::shared_ptr<Call> call;
+    bool leader = false;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      auto it = inflight_.find(key);
+      if (it != inflight_.end()) {
+        call = it->second;
+      } else {
+        call = std::make_shared<Call>();
+        inflight_.emplace(key, call);
+        leader = true;
+      }
+    }
+
+    if (!leader) {
+      Metrics::instance().inc_origin_coalesced();
+      std::unique_lock<std::mutex> lock(call->mu);
+      if (!call->cv.wait_for(lock, cfg_.timeout, [&] { return call->done; })) {
+        Result r; r.status = 504; r.coalesced = true;
+        return r;
+      }
+      Result r = call->result;
+      r.coalesced = true;
+      return r;
+    }
+
+    // the call is finished however the leader leaves; if do_fetch or
+    // on_fill throws, followers get a transport error and the next miss
+    // starts a new fetch
+    Finish finish{*this, key, *call, Result(), false};
+    finish.result = do_fetch(key);
+    if (finish.result.ok()) on_fill(finish.result);
+    finish.completed = true;
+    return finish.result;
+  }
+
+  size_t inflight() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return inflight_.size();
+  }
+
+private:
+  static constexpr size_t kRefreshThreads = 2;
+  static constexpr size_t kMaxQueuedRefreshes = 1024;
+
+  struct Call {
+    std::mutex mu;
+    std::condition_variable cv;
+    bool done = false;
+    Result result;
+  };
+
+  // Leader's guard: leaves inflight_ and wakes followers on every exit
+  struct Finish {
+    OriginFetcher& self;
+    const std::string& key;
+    Call& call;
+    Result result;
+    bool completed = false;
+
+    ~Finish() {
+      if (!completed) result = Result();
+      {
+        std::lock_guard<std::mutex> lock(self.mu_);
+        self.inflight_.erase(key);
+      }
+      {
+        std::lock_guard<std::mutex> lock(call.mu);
+        call.result = result;
+        call.done = true;
+      }
+      call.cv.notify_all();
+    }
+  };
+
+  Result do_fetch(const std::string& key) {
+    using namespace std::chrono;
+    Result r;
+    const auto t0 = steady_clock::now();
+    const auto deadline = t0 + cfg_.timeout;
+
+    const std::string path = path_for(key);   // before taking a pool slot
+    auto cli = acquire(deadline);
+    if (!cli) {
+      r.status = 504;   // every slot busy for the whole timeout
+      Metrics::instance().inc_origin_errors();
+      return r;
+    }
+    // fetch cost is the origin's time only, not the wait for a slot
+    const auto sent = steady_clock::now();
+    const auto left = duration_cast<milliseconds>(deadline - sent);
+    if (left.count() <= 0) {
+      release(std::move(cli), /*healthy=*/true);
+      r.status = 504;   // the slot came too late to send anything
+      Metrics::instance().inc_origin_errors();
+      return r;
+    }
+    // connect, send and read each get what is left of the timeout, and the
+    // max timeout caps them together
+    cli->set_connection_timeout(left);
+    cli->set_read_timeout(left);
+    cli->set_write_timeout(left);
+    cli->set_max_timeout(left);
+
+    auto res = cli->Get(path);
+    r.fetch_ms = static_cast<uint64_t>(duration_cast<milliseconds>(steady_clock::now() - sent).count());
+    if (!res) {
+      r.status = 0;
+      release(std::move(cli), /*healthy=*/false);
+      Metrics::instance().inc_origin_errors();
+      return r;
+    }
+    r.status = res->status;
+    release(std::move(cli), true);
+    if (r.status != 200) {
+      if (r.status != 404) Metrics::instance().inc_origin_errors();
+      return r;
+    }
+
+    // origin/app.py answers {"key":..., "value":...}; anything else is the raw value
+    if (res->get_header_value("Content-Type").find("json") != std::string::npos) {
+      auto body = nlohmann::json::parse(res->body, nullptr, /*allow_exceptions=*/false);
+      if (body.is_object() && body.contains("value") && body["value"].is_string())
+        r.value = ValueRef::copy_of(body["value"].get_ref<const std::string&>());
+    }
+    if (!r.value) r.value = ValueRef::copy_of(res->body);
+    Metrics::instance().observe_origin_fetch_ms(r.fetch_ms);
+    return r;
+  }
+
+  void refresh_loop() {
+    std::unique_lock<std::mutex> lock(refresh_mu_);
+    for (;;) {
+      refresh_cv_.wait(lock, [this] { return stopping_ || !refreshes_.empty(); });
+      if (stopping_) return;
+      auto [key, on_fill] = std::move(refreshes_.front());
+      refreshes_.pop_front();
+      lock.unlock();
+      // nobody waits on a refresh; a failed one leaves the stale entry
+      try {
+        fetch(key, on_fill);
+      } catch (...) {
+        Metrics::instance().inc_origin_errors();
+      }
+      lock.lock();
+    }
+  }
+
+  std::string path_for(const std::string& key) const {
+    std::string p = path_template_;
+    const auto pos = p.find("{key}");
+    if (pos != std::string::npos) p.replace(pos, 5, httplib::encode_path_component(key));
+    return p;
+  }
+
+  // Connection pool; also enforces max_inflight
+  std::unique_ptr<httplib::Client> acquire(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(pool_mu_);
+    if (!pool_cv_.wait_until(lock, deadline, [&] { return busy_ < cfg_.max_inflight; }))
+      return nullptr;
+    ++busy_;
+    if (!idle_.empty()) {
+      auto c = std::move(idle_.back());
+      idle_.pop_back();
+      return c;
+    }
+    lock.unlock();
+    auto c = std::make_unique<httplib::Client>(base_);
+    c->set_keep_alive(true);
+    return c;
+  }
+
+  void release(std::unique_ptr<httplib::Client> c, bool healthy) {
+    {
+      std::lock_guard<std::mutex> lock(pool_mu_);
+      --busy_;
+      if (healthy) idle_.push_back(std::move(c));
+    }
+    pool_cv_.notify_one();
+  }
+
+  OriginConfig cfg_;
+  std::string base_, path_template_;
+
+  mutable std::mutex mu_;
+  std::unordered_map<std::string, std::shared_ptr<Call>> inflight_;
+
+  std::mutex pool_mu_;
+  std::condition_variable pool_cv_;
+  size_t busy_ = 0;
+  std::vector<std::unique_ptr<httplib::Client>> idle_;
+
+  std::mutex refresh_mu_;
+  std::condition_variable refresh_cv_;
+  bool stopping_ = false;
+  std::deque<std::pair<std::string, std::function<void(const Result&)>>> refreshes_;
+  std::vector<std::thread> workers_;
+};
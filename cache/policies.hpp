@@ -0,0 +1,438 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "eviction.hpp"
+
+// Scan-resistant policies that own their metadata: W-TinyLFU, S3-FIFO and
+// ARC. They are driven by the EvictionStrategy tracking hooks under the
+// cache's lock, so one instance serves exactly one cache (shard) and needs
+// no locking of its own.
+//
+// Sizes are in the weights the cache reports (1 per entry, or bytes when the
+// cache has a byte budget). Segment targets are fractions of the weight
+// currently tracked, which equals the cache budget once the cache is full.
+
+namespace policy_detail {
+
+struct Node {
+  std::string key;
+  size_t  weight = 1;
+  uint8_t freq = 0;
+  uint8_t seg = 0;
+};
+
+using NodeList = std::list<Node>;
+
+// One recency-ordered queue; front = most recent
+struct Segment {
+  NodeList q;
+  size_t weight = 0;
+
+  bool empty() const { return q.empty(); }
+  NodeList::iterator tail() { return std::prev(q.end()); }
+
+  NodeList::iterator push_front(Node n) {
+    weight += n.weight;
+    q.push_front(std::move(n));
+    return q.begin();
+  }
+  // move a node from `from` (possibly this segment) to our front
+  void take_front(Segment& from, NodeList::iterator it, uint8_t seg) {
+    from.weight -= it->weight;
+    q.splice(q.begin(), from.q, it);
+    weight += it->weight;
+    it->seg = seg;
+  }
+  void erase(NodeList::iterator it) {
+    weight -= it->weight;
+    q.erase(it);
+  }
+};
+
+// Keys (and weights) of recently evicted entries, oldest dropped first
+class GhostList {
+public:
+  size_t weight() const { return weight_; }
+  size_t size() const { return idx_.size(); }
+
+  void push_front(const std::string& key, size_t w) {
+    erase(key);
+    q_.emplace_front(key, w);
+    idx_.emplace(key, q_.begin());
+    weight_ += w;
+  }
+  // true if the key was present (and is now removed)
+  bool erase(const std::string& key) {
+    auto it = idx_.find(key);
+    if (it == idx_.end()) return false;
+    weight_ -= it->second->second;
+    q_.erase(it->second);
+    idx_.erase(it);
+    return true;
+  }
+  bool contains(const std::string& key) const { return idx_.count(key) != 0; }
+  void pop_back() {
+    if (q_.empty()) return;
+    weight_ -= q_.back().second;
+    idx_.erase(q_.back().first);
+    q_.pop_back();
+  }
+  void clear() { q_.clear(); idx_.clear(); weight_ = 0; }
+
+private:
+  std::list<std::pair<std::string, size_t>> q_;
+  std::unordered_map<std::string, std::list<std::pair<std::string, size_t>>::iterator> idx_;
+  size_t weight_ = 0;
+};
+
+// 4-row count-min sketch of 4-bit-range counters with periodic halving, so
+// frequencies reflect recent history. Grows with the number of tracked keys.
+class FrequencySketch {
+public:
+  void ensure_capacity(size_t entries) {
+    size_t want = 1024;
+    while (want < 2 * entries) want <<= 1;
+    if (want <= width_) return;
+    width_ = want;
+    table_.assign(kRows * width_, 0);
+    additions_ = 0;
+  }
+
+  void increment(const std::string& key) {
+    if (table_.empty()) ensure_capacity(0);
+    const uint64_t h = std::hash<std::string>{}(key);
+    bool added = false;
+    for (size_t r = 0; r < kRows; ++r) {
+      uint8_t& c = table_[r * width_ + index(h, r)];
+      if (c < kMax) { ++c; added = true; }
+    }
+    if (added && ++additions_ >= 10 * width_) age();
+  }
+
+  uint8_t estimate(const std::string& key) const {
+    if (table_.empty()) return 0;
+    const uint64_t h = std::hash<std::string>{}(key);
+    uint8_t m = kMax;
+    for (size_t r = 0; r < kRows; ++r) m = std::min(m, table_[r * width_ + index(h, r)]);
+    return m;
+  }
+
+private:
+  static constexpr size_t kRows = 4;
+  static constexpr uint8_t kMax = 15;
+
+  size_t index(uint64_t h, size_t row) const {
+    static constexpr uint64_t seeds[kRows] = {
+      0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL};
+    uint64_t x = (h + seeds[row]) * 0xff51afd7ed558ccdULL;
+    x ^= x >> 32;
+    return static_cast<size_t>(x & (width_ - 1));
+  }
+
+  void age() {
+    for (auto& c : table_) c >>= 1;
+    additions_ /= 2;
+  }
+
+  std::vector<uint8_t> table_;
+  size_t width_ = 0;
+  size_t additions_ = 0;
+};
+
+}  // namespace policy_detail
+
+// W-TinyLFU (Einziger et al.): a small LRU admission window in front of a
+// segmented LRU (probation + protected). When the window overflows, its
+// oldest entries become admission candidates, and a candidate is kept only
+// if the count-min sketch says it is more frequent than the main victim, so
+// one-off scans cannot flush the frequently used set.
+class WTinyLfuStrategy : public EvictionStrategy {
+public:
+  explicit WTinyLfuStrategy(double window_fraction = 0.01, double protected_fraction = 0.8)
+    : window_frac_(window_fraction), protected_frac_(protected_fraction) {}
+
+  std::optional<std::string> choose_victim(const std::vector<std::string>&) override { return std::nullopt; }
+  bool tracks_entries() const override { return true; }
+  const char* name() const override { return "W-TinyLFU"; }
+
+  // Every lookup counts once; a miss is remembered so the insert that
+  // usually follows it is not counted again
+  void on_access(const std::string& key, bool hit) override {
+    sketch_.increment(key);
+    if (!hit) {
+      remember_miss(std::hash<std::string>{}(key));
+      return;
+    }
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    auto n = it->second;
+    switch (n->seg) {
+      case kWindow:    window_.take_front(window_, n, kWindow); break;
+      case kProtected: protected_.take_front(protected_, n, kProtected); break;
+      case kProbation:
+        n->freq = 0;
+        protected_.take_front(probation_, n, kProtected);
+        // keep protected within its share of main; demoted entries get another chance
+        while (protected_.weight > protected_target() && protected_.q.size() > 1) {
+          auto t = protected_.tail();
+          probation_.take_front(protected_, t, kProbation);
+        }
+        break;
+    }
+  }
+
+  void on_insert(const std::string& key, size_t weight) override {
+    auto it = index_.find(key);
+    if (!missed_.erase(std::hash<std::string>{}(key))) sketch_.increment(key);
+    if (it != index_.end()) { reweigh(it->second, weight); return; }
+    index_.emplace(key, window_.push_front(policy_detail::Node{key, weight, 0, kWindow}));
+    total_ += weight;
+    sketch_.ensure_capacity(index_.size());
+    // window overflow moves to probation as admission candidates (freq = 1)
+    while (window_.weight > window_target() && window_.q.size() > 1) {
+      auto t = window_.tail();
+      t->freq = 1;
+      probation_.take_front(window_, t, kProbation);
+    }
+  }
+
+  void on_remove(const std::string& key, bool /*evicted*/) override {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    total_ -= it->second->weight;
+    segment(it->second->seg).erase(it->second);
+    index_.erase(it);
+  }
+
+  // May return the newest entry: that is TinyLFU declining to admit it
+  std::optional<std::string> victim() override {
+    if (index_.empty()) return std::nullopt;
+    if (probation_.empty() && protected_.empty()) return window_.tail()->key;
+    policy_detail::Segment& main = !probation_.empty() ? probation_ : protected_;
+    auto mv = main.tail();
+    // the newest candidate out of the window must beat the main victim's frequency
+    if (!probation_.empty()) {
+      auto cand = probation_.q.begin();
+      if (cand->freq == 1 && cand != mv) {
+        if (sketch_.estimate(cand->key) <= sketch_.estimate(mv->key)) return cand->key;
+        cand->freq = 0;
+      }
+    }
+    return mv->key;
+  }
+
+private:
+  enum : uint8_t { kWindow, kProbation, kProtected };
+  static constexpr size_t kMaxMissed = 4096;
+
+  // When full, the oldest remembered miss is forgotten
+  void remember_miss(uint64_t h) {
+    if (missed_order_.size() < kMaxMissed) missed_order_.push_back(h);
+    else { missed_.erase(missed_order_[missed_next_]); missed_order_[missed_next_] = h; }
+    missed_next_ = (missed_next_ + 1) % kMaxMissed;
+    missed_.insert(h);
+  }
+
+  policy_detail::Segment& segment(uint8_t s) {
+    return s == kWindow ? window_ : (s == kProbation ? probation_ : protected_);
+  }
+
+  void reweigh(policy_detail::NodeList::iterator n, size_t weight) {
+    auto& seg = segment(n->seg);
+    seg.weight = seg.weight - n->weight + weight;
+    total_ = total_ - n->weight + weight;
+    n->weight = weight;
+  }
+
+  size_t window_target() const {
+    return std::max<size_t>(1, static_cast<size_t>(window_frac_ * static_cast<double>(total_)));
+  }
+  size_t protected_target() const {
+    return static_cast<size_t>(protected_frac_ * static_cast<double>(total_ - window_.weight));
+  }
+
+  double window_frac_, protected_frac_;
+  policy_detail::Segment window_, probation_, protected_;
+  std::unordered_map<std::string, policy_detail::NodeList::iterator> index_;
+  policy_detail::FrequencySketch sketch_;
+  // hashes of counted misses not yet inserted, bounded FIFO
+  std::unordered_set<uint64_t> missed_;
+  std::vector<uint64_t> missed_order_;
+  size_t missed_next_ = 0;
+  size_t total_ = 0;
+};
+
+// S3-FIFO (Yang et al., SOSP'23): a small FIFO filters one-hit wonders, a
+// main FIFO with lazy second-chance keeps the rest, and a ghost FIFO of
+// recently filtered keys sends returning keys straight to main.
+class S3FifoStrategy : public EvictionStrategy {
+public:
+  explicit S3FifoStrategy(double small_fraction = 0.1) : small_frac_(small_fraction) {}
+
+  std::optional<std::string> choose_victim(const std::vector<std::string>&) override { return std::nullopt; }
+  bool tracks_entries() const override { return true; }
+  const char* name() const override { return "S3-FIFO"; }
+
+  void on_access(const std::string& key, bool hit) override {
+    if (!hit) return;
+    auto it = index_.find(key);
+    if (it != index_.end() && it->second->freq < 3) ++it->second->freq;
+  }
+
+  void on_insert(const std::string& key, size_t weight) override {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      auto n = it->second;
+      auto& seg = n->seg == kSmall ? small_ : main_;
+      seg.weight = seg.weight - n->weight + weight;
+      total_ = total_ - n->weight + weight;
+      n->weight = weight;
+      return;
+    }
+    policy_detail::Node n{key, weight, 0, kSmall};
+    if (ghost_.erase(key)) { n.seg = kMain; index_.emplace(key, main_.push_front(std::move(n))); }
+    else index_.emplace(key, small_.push_front(std::move(n)));
+    total_ += weight;
+  }
+
+  void on_remove(const std::string& key, bool evicted) override {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    auto n = it->second;
+    if (evicted && n->seg == kSmall) {
+      ghost_.push_front(key, n->weight);
+      // ghost remembers about as much as main holds
+      while (ghost_.weight() > std::max(main_.weight, size_t{1})) ghost_.pop_back();
+    }
+    total_ -= n->weight;
+    (n->seg == kSmall ? small_ : main_).erase(n);
+    index_.erase(it);
+  }
+
+  std::optional<std::string> victim() override {
+    if (index_.empty()) return std::nullopt;
+    const size_t small_target =
+      std::max<size_t>(1, static_cast<size_t>(small_frac_ * static_cast<double>(total_)));
+    // terminates: every pass either returns or lowers a frequency / moves S → M
+    for (;;) {
+      if (!small_.empty() && (small_.weight >= small_target || main_.empty())) {
+        auto t = small_.tail();
+        if (t->freq == 0) return t->key;
+        t->freq = 0;
+        main_.take_front(small_, t, kMain);
+        continue;
+      }
+      if (main_.empty()) return small_.tail()->key;
+      auto t = main_.tail();
+      if (t->freq == 0) return t->key;
+      --t->freq;
+      main_.take_front(main_, t, kMain);
+    }
+  }
+
+private:
+  enum : uint8_t { kSmall, kMain };
+
+  double small_frac_;
+  policy_detail::Segment small_, main_;
+  policy_detail::GhostList ghost_;
+  std::unordered_map<std::string, policy_detail::NodeList::iterator> index_;
+  size_t total_ = 0;
+};
+
+// ARC (Megiddo & Modha): recency (T1) and frequency (T2) lists with ghost
+// lists B1/B2 whose hits adapt the target size p of T1.
+class ArcStrategy : public EvictionStrategy {
+public:
+  std::optional<std::string> choose_victim(const std::vector<std::string>&) override { return std::nullopt; }
+  bool tracks_entries() const override { return true; }
+  const char* name() const override { return "ARC"; }
+
+  void on_access(const std::string& key, bool hit) override {
+    if (!hit) return;
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    auto n = it->second;
+    t2_.take_front(n->seg == kT1 ? t1_ : t2_, n, kT2);
+  }
+
+  void on_insert(const std::string& key, size_t weight) override {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      auto n = it->second;
+      auto& seg = n->seg == kT1 ? t1_ : t2_;
+      seg.weight = seg.weight - n->weight + weight;
+      n->weight = weight;
+      return;
+    }
+    const size_t c = std::max<size_t>(1, t1_.weight + t2_.weight);
+    policy_detail::Node n{key, weight, 0, kT2};
+    last_from_b2_ = false;
+    if (b1_.contains(key)) {
+      const size_t delta = std::max<size_t>(weight, weight * b2_.weight() / std::max<size_t>(1, b1_.weight()));
+      p_ = std::min(c, p_ + delta);
+      b1_.erase(key);
+    } else if (b2_.contains(key)) {
+      const size_t delta = std::max<size_t>(weight, weight * b1_.weight() / std::max<size_t>(1, b2_.weight()));
+      p_ = p_ > delta ? p_ - delta : 0;
+      b2_.erase(key);
+      last_from_b2_ = true;
+    } else {
+      n.seg = kT1;
+    }
+    index_.emplace(key, (n.seg == kT1 ? t1_ : t2_).push_front(std::move(n)));
+  }
+
+  void on_remove(const std::string& key, bool evicted) override {
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    auto n = it->second;
+    if (evicted) {
+      (n->seg == kT1 ? b1_ : b2_).push_front(key, n->weight);
+    }
+    (n->seg == kT1 ? t1_ : t2_).erase(n);
+    index_.erase(it);
+    trim_ghosts();
+  }
+
+  std::optional<std::string> victim() override {
+    if (index_.empty()) return std::nullopt;
+    const bool from_t1 = !t1_.empty() &&
+      (t2_.empty() || t1_.weight > p_ || (last_from_b2_ && t1_.weight >= p_));
+    return (from_t1 ? t1_ : t2_).tail()->key;
+  }
+
+private:
+  enum : uint8_t { kT1, kT2 };
+
+  // |T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c
+  void trim_ghosts() {
+    const size_t c = std::max<size_t>(1, t1_.weight + t2_.weight);
+    while (b1_.size() && t1_.weight + b1_.weight() > c) b1_.pop_back();
+    while (b2_.size() && t1_.weight + t2_.weight + b1_.weight() + b2_.weight() > 2 * c) b2_.pop_back();
+  }
+
+  policy_detail::Segment t1_, t2_;
+  policy_detail::GhostList b1_, b2_;
+  std::unordered_map<std::string, policy_detail::NodeList::iterator> index_;
+  size_t p_ = 0;
+  bool last_from_b2_ = false;
+};
+
+// EVICTION_MODE names for the policies above; nullptr if not one of them
+inline std::shared_ptr<EvictionStrategy> make_builtin_policy(const std::string& mode) {
+  if (mode == "TINYLFU" || mode == "W-TINYLFU") return std::make_shared<WTinyLfuStrategy>();
+  if (mode == "S3FIFO" || mode == "S3-FIFO")    return std::make_shared<S3FifoStrategy>();
+  if (mode == "ARC")                            return std::make_shared<ArcStrategy>();
+  if (mode == "LRU")                            return std::make_shared<LRUStrategy>();
+  return nullptr;
+}
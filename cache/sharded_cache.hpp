@@ -0,0 +1,248 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include "compression.hpp"
+#include "hot_keys.hpp"
+#include "lru_cache.hpp"
+
+// N independent LruCache shards selected by key hash. Each shard owns its
+// recency list, capacity slice, lock and eviction strategy, so GET/PUT on
+// different shards never contend.
+class ShardedLruCache {
+public:
+    using StrategyFactory = std::function<std::shared_ptr<EvictionStrategy>()>;
+
+    ShardedLruCache(size_t capacity, size_t shards)
+      : ShardedLruCache(CacheLimits{capacity, 0, 1.0}, shards) {}
+
+    // Item and byte budgets are split evenly; max_object_fraction applies
+    // to the shard slice an object lands in.
+    ShardedLruCache(CacheLimits limits, size_t shards) {
+        if (shards == 0) shards = 1;
+        if (limits.max_items > 0 && shards > limits.max_items) shards = limits.max_items;
+        shards_.reserve(shards);
+        for (size_t i = 0; i < shards; ++i) {
+            CacheLimits slice = limits;
+            // spread the remainder over the first shards
+            slice.max_items = split(limits.max_items, shards, i);
+            slice.max_bytes = split(limits.max_bytes, shards, i);
+            shards_.push_back(std::make_unique<LruCache>(slice));
+        }
+    }
+
+    std::optional<std::string> get(const std::string& key) {
+        auto v = get_ref(key);
+        if (!v) return std::nullopt;
+        return std::string(v.view());
+    }
+
+    bool put(const std::string& key, const std::string& value) {
+        return put(key, ValueRef::copy_of(value));
+    }
+
+    // Uncompressed value; a compressed entry is inflated for this caller
+    ValueRef get_ref(const std::string& key, Freshness* freshness = nullptr, bool claim_refresh = false) {
+        return compression::decode(get_stored(key, freshness, claim_refresh));
+    }
+
+    // Value as stored, possibly gzip-encoded (see ValueRef::encoding). Hot
+    // keys are served from the replica without the shard lock; a RAM miss is
+    // looked up in the spill tier, and a hit there moves back to RAM.
+    ValueRef get_stored(const std::string& key, Freshness* freshness = nullptr, bool claim_refresh = false) {
+        auto& shard = shard_for(key);
+        if (hot_) {
+            hot_->record(key);
+            bool touch = false;
+            if (auto v = hot_->find(key, &touch)) {
+                if (touch) shard.get_ref(key);   // sampled recency update
+                if (freshness) *freshness = Freshness::Fresh;
+                return v;
+            }
+        }
+        auto v = shard.get_ref(key, freshness, claim_refresh);
+        uint64_t gen = 0;
+        if (!v && spill_)
+            if (auto spilled = spill_->find(key, &gen)) v = shard.promote(key, std::move(spilled), gen);
+        return v;
+    }
+
+    // Compression, if enabled, runs here, outside the shard lock
+    bool put(const std::string& key, ValueRef value, Expiry expiry = {}, PutResult* result = nullptr) {
+        const bool ok =
+            shard_for(key).put(key, compression::compress(std::move(value), compression_), expiry, result);
+        if (hot_) hot_->on_write(key);
+        return ok;
+    }
+
+    Expiry expiry_of(const std::string& key) const { return shard_for(key).expiry_of(key); }
+
+    // One reaper pass over every shard; returns entries expired
+    size_t reap_expired() {
+        ScopedLatency timer(Metrics::instance().reap_latency());
+        Metrics::instance().inc_reaper_runs();
+        size_t n = 0;
+        for (auto& s : shards_) n += s->reap_expired();
+        return n;
+    }
+
+    // Values for keys in the same order (empty on a miss). Keys are grouped
+    // by shard so each shard's lock is taken once per call.
+    std::vector<ValueRef> get_many(const std::vector<std::string>& keys) {
+        std::vector<ValueRef> out(keys.size());
+        if (hot_)
+            for (const auto& k : keys) hot_->record(k);
+        for_each_shard_group(keys.size(), [&](size_t i) -> const std::string& { return keys[i]; },
+                             [&](LruCache& s, const uint32_t* idx, size_t n) {
+                                 s.get_batch(keys.data(), idx, n, out.data());
+                             });
+        // spill lookups and inflating happen after every shard lock is released
+        for (size_t i = 0; i < out.size(); ++i) {
+            uint64_t gen = 0;
+            if (!out[i] && spill_)
+                if (auto spilled = spill_->find(keys[i], &gen))
+                    out[i] = shard_for(keys[i]).promote(keys[i], std::move(spilled), gen);
+            out[i] = compression::decode(std::move(out[i]));
+        }
+        return out;
+    }
+
+    // Stores every item, one lock acquisition per shard; returns each
+    // item's outcome in the same order. A repeated key keeps its last value.
+    std::vector<PutResult> put_many(const std::vector<std::pair<std::string, ValueRef>>& items) {
+        std::vector<PutResult> results(items.size(), PutResult::Stored);
+        std::vector<std::pair<std::string, ValueRef>> compressed;
+        if (compression_.enabled()) {
+            compressed.reserve(items.size());
+            for (const auto& [key, value] : items)
+                compressed.emplace_back(key, compression::compress(value, compression_));
+        }
+        const auto& stored = compression_.enabled() ? compressed : items;
+        for_each_shard_group(stored.size(), [&](size_t i) -> const std::string& { return stored[i].first; },
+                             [&](LruCache& s, const uint32_t* idx, size_t n) {
+                                 s.put_batch(stored.data(), idx, n, results.data());
+                             });
+        if (hot_)
+            for (const auto& item : stored) hot_->on_write(item.first);
+        return results;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& s : shards_) n += s->size();
+        return n;
+    }
+
+    size_t resident_bytes() const {
+        size_t n = 0;
+        for (const auto& s : shards_) n += s->resident_bytes();
+        return n;
+    }
+
+    size_t shard_count() const { return shards_.size(); }
+
+    std::vector<SavedEntry> shard_entries(size_t i) const {
+        return shards_[i]->entries();
+    }
+
+    // Every shard gets its own strategy instance from the factory
+    void set_strategy(const StrategyFactory& make) {
+        for (auto& s : shards_) s->set_strategy(make());
+    }
+
+    // Set before serving; applies to values stored afterwards
+    void set_compression(CompressionConfig cfg) { compression_ = cfg; }
+    const CompressionConfig& compression() const { return compression_; }
+
+    // Second tier for RAM evictions (see SpillTier); set before serving
+    void set_spill_tier(std::shared_ptr<SpillTier> spill) {
+        spill_ = spill;
+        for (auto& s : shards_) s->set_spill_tier(spill);
+    }
+
+    // Lock-free replica of detected hot keys (see HotKeys); set before serving
+    void set_hot_keys(HotKeyConfig cfg) {
+        hot_.reset();
+        if (!cfg.enabled()) return;
+        hot_ = std::make_unique<HotKeys>(cfg, [this](const std::string& key, uint32_t* expires) {
+            return shard_for(key).peek(key, expires);
+        });
+    }
+
+    // Detector's top keys; empty when hot keys are off
+    std::vector<HotKeyStat> hot_keys() const {
+        return hot_ ? hot_->top() : std::vector<HotKeyStat>{};
+    }
+
+    void set_default_expiry(Expiry e) {
+        for (auto& s : shards_) s->set_default_expiry(e);
+    }
+
+    void set_removal_listener(const RemovalListener& fn) {
+        for (auto& s : shards_) s->set_removal_listener(fn);
+    }
+
+    void set_async_eviction(bool on, EvictionEngineConfig cfg = {}) {
+        for (auto& s : shards_) s->set_async_eviction(on, cfg);
+    }
+
+    std::vector<ShardStats> shard_stats() const {
+        std::vector<ShardStats> out;
+        out.reserve(shards_.size());
+        for (const auto& s : shards_) out.push_back(s->stats());
+        return out;
+    }
+
+    size_t shard_index(const std::string& key) const {
+        // std::hash is identity-like on some platforms; mix before reducing.
+        // Salted, so the shard says nothing about the bits a shard's
+        // EntryTable indexes by.
+        uint64_t h = std::hash<std::string>{}(key) ^ 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return static_cast<size_t>(h % shards_.size());
+    }
+
+private:
+    static size_t split(size_t total, size_t n, size_t i) {
+        return total / n + (i < total % n ? 1 : 0);
+    }
+
+    LruCache& shard_for(const std::string& key) { return *shards_[shard_index(key)]; }
+    const LruCache& shard_for(const std::string& key) const { return *shards_[shard_index(key)]; }
+
+    // Counting sort of item indices by shard (stable, so request order is
+    // kept within a shard), then fn(shard, indices, count) per non-empty shard
+    template <typename KeyOf, typename Fn>
+    void for_each_shard_group(size_t n, KeyOf&& key_of, Fn&& fn) {
+        if (shards_.size() == 1) {
+            std::vector<uint32_t> idx(n);
+            for (size_t i = 0; i < n; ++i) idx[i] = static_cast<uint32_t>(i);
+            if (n) fn(*shards_[0], idx.data(), n);
+            return;
+        }
+        std::vector<uint32_t> shard_of(n);
+        std::vector<size_t> start(shards_.size() + 1, 0);
+        for (size_t i = 0; i < n; ++i) {
+            shard_of[i] = static_cast<uint32_t>(shard_index(key_of(i)));
+            ++start[shard_of[i] + 1];
+        }
+        for (size_t s = 0; s < shards_.size(); ++s) start[s + 1] += start[s];
+        std::vector<uint32_t> order(n);
+        std::vector<size_t> fill(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < n; ++i) order[fill[shard_of[i]]++] = static_cast<uint32_t>(i);
+        for (size_t s = 0; s < shards_.size(); ++s)
+            if (start[s + 1] > start[s]) fn(*shards_[s], order.data() + start[s], start[s + 1] - start[s]);
+    }
+
+    std::vector<std::unique_ptr<LruCache>> shards_;
+    CompressionConfig compression_;
+    std::shared_ptr<SpillTier> spill_;
+    std::unique_ptr<HotKeys> hot_;   // last, so its worker stops before the shards go
+};
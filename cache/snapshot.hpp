@@ -0,0 +1,382 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "key_stats.hpp"
+#include "metrics.hpp"
+#include "sharded_cache.hpp"
+
+// On-disk snapshot of the cache: entries in recency order plus their
+// KeyStats, so a restarted server comes back warm.
+//
+// Layout (little-endian, everything 8-byte aligned):
+//   header   "GCSN" u32 version u32 sections u32 reserved
+//            u64 entries u64 created_unix_ms u64 table_checksum u64 header_checksum
+//   table    per section: u64 offset u64 bytes u64 entries u64 checksum
+//   sections one per shard, entries oldest first:
+//            u32 key_len u32 encoding u64 value_len
+//            u64 access_count u64 idle_us u64 size_bytes u64 fetch_cost_ms
+//            u64 ttl_ms u64 stale_ms                      (version 2 on)
+//            key, value, zero padding to 8 bytes
+// ttl_ms is what was left of the entry's ttl when it was saved (0 = none);
+// the time the server was down is taken off it on load. Version 1 files,
+// without expiry, still load.
+// Each section carries its own checksum, so a damaged section is skipped and
+// the rest still load; a bad header or table skips the whole file.
+namespace snapshot {
+
+constexpr uint32_t kMagic = 0x4e534347;   // "GCSN"
+constexpr uint32_t kVersion = 2;
+
+struct Header {
+  uint32_t magic, version, sections, reserved;
+  uint64_t entries, created_unix_ms, table_checksum, header_checksum;
+};
+struct SectionInfo { uint64_t offset, bytes, entries, checksum; };
+struct Record {
+  uint32_t key_len, encoding;   // ValueEncoding; values are saved as stored
+  uint64_t value_len, access_count, idle_us, size_bytes, fetch_cost_ms;
+  uint64_t ttl_ms, stale_ms;
+};
+constexpr size_t kRecordV1 = 48;   // Record without ttl_ms and stale_ms
+static_assert(sizeof(Header) == 48 && sizeof(SectionInfo) == 32 && sizeof(Record) == 64,
+              "snapshot structs are written as-is");
+
+// XXH64-style checksum over whole 8-byte words, so it can be fed
+// incrementally as records (always padded to 8) are written.
+class Checksum {
+public:
+  void update(const void* data, size_t n) {
+    const char* p = static_cast<const char*>(data);
+    for (size_t i = 0; i + 8 <= n; i += 8) {
+      uint64_t w;
+      std::memcpy(&w, p + i, 8);
+      uint64_t& lane = lanes_[words_++ & 3];
+      lane = rotl(lane + w * kP2, 31) * kP1;
+    }
+  }
+  uint64_t digest() const {
+    uint64_t h = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) + rotl(lanes_[2], 12) + rotl(lanes_[3], 18);
+    h += words_ * 8;
+    h ^= h >> 33; h *= kP2; h ^= h >> 29; h *= kP3; h ^= h >> 32;
+    return h;
+  }
+  static uint64_t of(const void* data, size_t n) { Checksum c; c.update(data, n); return c.digest(); }
+
+private:
+  static constexpr uint64_t kP1 = 0x9E3779B185EBCA87ULL, kP2 = 0xC2B2AE3D27D4EB4FULL,
+                            kP3 = 0x165667B19E3779F9ULL;
+  static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+  uint64_t lanes_[4] = {kP1 + kP2, kP2, 0, 0 - kP1};
+  uint64_t words_ = 0;
+};
+
+struct SaveResult {
+  bool ok = false;
+  uint64_t entries = 0, bytes = 0, ms = 0;
+  std::string error;
+};
+
+struct LoadResult {
+  bool ok = false;            // header and table were valid
+  uint64_t entries = 0, ms = 0;
+  uint32_t sections = 0, skipped_sections = 0;
+  std::string error;
+};
+
+namespace detail {
+
+inline uint64_t unix_ms() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+inline size_t pad8(size_t n) { return (8 - (n & 7)) & 7; }
+
+// Buffered appender that also checksums what it writes
+class Writer {
+public:
+  explicit Writer(int fd, uint64_t offset) : fd_(fd), offset_(offset) { buf_.reserve(kBuf); }
+
+  bool append(const void* p, size_t n) {
+    sum_.update(p, n);   // callers keep n a multiple of 8
+    const char* c = static_cast<const char*>(p);
+    if (buf_.size() + n > kBuf && !flush()) return false;
+    if (n >= kBuf) return write_all(c, n);
+    buf_.append(c, n);
+    return true;
+  }
+  // key or value bytes followed by padding; large values bypass the buffer
+  bool append_padded(const char* p, size_t n) {
+    const size_t whole = n & ~size_t{7};
+    if (whole && !append(p, whole)) return false;
+    if (n == whole) return true;
+    char tail[8] = {};
+    std::memcpy(tail, p + whole, n - whole);
+    return append(tail, 8);
+  }
+  bool flush() {
+    if (buf_.empty()) return true;
+    const bool ok = write_all(buf_.data(), buf_.size());
+    buf_.clear();
+    return ok;
+  }
+  uint64_t offset() const { return offset_ + buf_.size(); }
+  uint64_t take_checksum() { uint64_t d = sum_.digest(); sum_ = Checksum(); return d; }
+
+private:
+  static constexpr size_t kBuf = 1 << 20;
+
+  bool write_all(const char* p, size_t n) {
+    while (n) {
+      ssize_t w = ::pwrite(fd_, p, n, static_cast<off_t>(offset_));
+      if (w < 0) { if (errno == EINTR) continue; return false; }
+      p += w; n -= static_cast<size_t>(w); offset_ += static_cast<uint64_t>(w);
+    }
+    return true;
+  }
+
+  int fd_;
+  uint64_t offset_;
+  std::string buf_;
+  Checksum sum_;
+};
+
+// Parses one verified section into the cache; returns entries restored.
+// record_size depends on the file version; down_ms is the time since save.
+inline uint64_t load_section(ShardedLruCache& cache, const char* p, uint64_t bytes, uint64_t now_us,
+                             size_t record_size, uint64_t down_ms) {
+  uint64_t restored = 0;
+  const char* end = p + bytes;
+  auto& stats = KeyStatsStore::instance();
+  while (end - p >= static_cast<ptrdiff_t>(record_size)) {
+    Record r{};
+    std::memcpy(&r, p, record_size);
+    p += record_size;
+    const uint64_t key_span = r.key_len + pad8(r.key_len);
+    const uint64_t value_span = r.value_len + pad8(r.value_len);
+    if (key_span > static_cast<uint64_t>(end - p) || value_span > static_cast<uint64_t>(end - p) - key_span) break;
+    std::string key(p, r.key_len);
+    p += key_span;
+    const char* value = p;
+    p += value_span;
+    // an encoding this build does not know is skipped rather than misread
+    if (r.encoding > static_cast<uint32_t>(ValueEncoding::Gzip)) continue;
+    const auto enc = static_cast<ValueEncoding>(r.encoding);
+    Expiry e;
+    if (r.ttl_ms) {
+      if (r.ttl_ms <= down_ms) continue;   // ran out while the server was down
+      e.ttl = std::chrono::milliseconds(r.ttl_ms - down_ms);
+      e.stale = std::chrono::milliseconds(r.stale_ms);
+    }
+    if (!cache.put(key, ValueRef::copy_of(std::string_view(value, r.value_len), enc), e)) continue;
+    KeyStats st;
+    st.access_count = r.access_count;
+    st.last_access_us = now_us > r.idle_us ? now_us - r.idle_us : 0;
+    st.size_bytes = r.size_bytes;
+    st.fetch_cost_ms = r.fetch_cost_ms;
+    stats.restore(key, st);
+    ++restored;
+  }
+  return restored;
+}
+
+}  // namespace detail
+
+// Writes to path.tmp and renames over path. Request threads wait only while
+// a shard's entries are collected (refcount bumps, no value copies).
+inline SaveResult save(const ShardedLruCache& cache, const std::string& path) {
+  SaveResult res;
+  const auto t0 = std::chrono::steady_clock::now();
+  const std::string tmp = path + ".tmp";
+  const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) { res.error = "cannot open " + tmp + ": " + std::strerror(errno); return res; }
+
+  const uint32_t nsec = static_cast<uint32_t>(cache.shard_count());
+  std::vector<SectionInfo> table(nsec);
+  const uint64_t data_start = sizeof(Header) + nsec * sizeof(SectionInfo);
+  detail::Writer w(fd, data_start);
+  const uint64_t now_us = KeyStatsStore::nowMicros();
+  bool ok = true;
+
+  for (uint32_t s = 0; s < nsec && ok; ++s) {
+    auto entries = cache.shard_entries(s);
+    std::vector<std::string> keys;
+    keys.reserve(entries.size());
+    for (const auto& e : entries) keys.push_back(e.key);
+    auto stats = KeyStatsStore::instance().snapshot_of(keys);
+
+    table[s].offset = w.offset();
+    for (const auto& [key, value, expiry] : entries) {
+      Record r{};
+      r.ttl_ms = static_cast<uint64_t>(expiry.ttl.count());
+      r.stale_ms = static_cast<uint64_t>(expiry.stale.count());
+      r.key_len = static_cast<uint32_t>(key.size());
+      r.encoding = static_cast<uint32_t>(value.encoding());
+      r.value_len = value.size();
+      auto it = stats.find(key);
+      if (it != stats.end()) {
+        r.access_count = it->second.access_count;
+        r.idle_us = now_us > it->second.last_access_us ? now_us - it->second.last_access_us : 0;
+        r.size_bytes = it->second.size_bytes;
+        r.fetch_cost_ms = it->second.fetch_cost_ms;
+      } else {
+        r.size_bytes = compression::decoded_size(value);
+        r.fetch_cost_ms = KeyStats{}.fetch_cost_ms;
+      }
+      ok = w.append(&r, sizeof(r)) && w.append_padded(key.data(), key.size()) &&
+           w.append_padded(value.data(), value.size());
+      if (!ok) break;
+    }
+    table[s].bytes = w.offset() - table[s].offset;
+    table[s].entries = entries.size();
+    table[s].checksum = w.take_checksum();
+    res.entries += entries.size();
+  }
+  ok = ok && w.flush();
+
+  Header h{kMagic, kVersion, nsec, 0, res.entries, detail::unix_ms(), 0, 0};
+  h.table_checksum = Checksum::of(table.data(), table.size() * sizeof(SectionInfo));
+  h.header_checksum = Checksum::of(&h, offsetof(Header, header_checksum));
+  ok = ok && ::pwrite(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)) &&
+       ::pwrite(fd, table.data(), table.size() * sizeof(SectionInfo), sizeof(h)) ==
+         static_cast<ssize_t>(table.size() * sizeof(SectionInfo));
+  res.bytes = w.offset();
+  ok = ok && ::fsync(fd) == 0;
+  ::close(fd);
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    res.error = "write failed: " + std::string(std::strerror(errno));
+    ::unlink(tmp.c_str());
+    Metrics::instance().inc_snapshot_failures();
+    return res;
+  }
+  res.ok = true;
+  res.ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - t0).count());
+  Metrics::instance().observe_snapshot(res.ms, res.bytes, res.entries);
+  return res;
+}
+
+// Maps the file and restores sections in parallel (one thread per section,
+// up to `threads`). Missing files are not an error: ok stays false and
+// error is empty.
+inline LoadResult load(ShardedLruCache& cache, const std::string& path,
+                       size_t threads = std::thread::hardware_concurrency()) {
+  LoadResult res;
+  const auto t0 = std::chrono::steady_clock::now();
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { if (errno != ENOENT) res.error = std::strerror(errno); return res; }
+  struct stat sb{};
+  if (::fstat(fd, &sb) != 0 || static_cast<size_t>(sb.st_size) < sizeof(Header)) {
+    ::close(fd);
+    res.error = "truncated header";
+    return res;
+  }
+  const size_t size = static_cast<size_t>(sb.st_size);
+  void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) { res.error = std::strerror(errno); return res; }
+  ::madvise(map, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+  const char* base = static_cast<const char*>(map);
+
+  Header h;
+  std::memcpy(&h, base, sizeof(h));
+  const uint64_t table_bytes = uint64_t{h.sections} * sizeof(SectionInfo);
+  if (h.magic != kMagic) res.error = "not a snapshot";
+  else if (h.version != kVersion && h.version != 1) res.error = "unsupported version " + std::to_string(h.version);
+  else if (h.header_checksum != Checksum::of(&h, offsetof(Header, header_checksum))) res.error = "header checksum mismatch";
+  else if (sizeof(Header) + table_bytes > size) res.error = "truncated section table";
+  else if (h.table_checksum != Checksum::of(base + sizeof(Header), table_bytes)) res.error = "table checksum mismatch";
+  if (!res.error.empty()) { ::munmap(map, size); return res; }
+
+  std::vector<SectionInfo> table(h.sections);
+  std::memcpy(table.data(), base + sizeof(Header), table_bytes);
+  res.ok = true;
+  res.sections = h.sections;
+
+  const uint64_t now_us = KeyStatsStore::nowMicros();
+  const size_t record_size = h.version == 1 ? kRecordV1 : sizeof(Record);
+  const uint64_t unix_now = detail::unix_ms();
+  const uint64_t down_ms = unix_now > h.created_unix_ms ? unix_now - h.created_unix_ms : 0;
+  std::atomic<uint32_t> next{0}, skipped{0};
+  std::atomic<uint64_t> restored{0};
+  auto worker = [&] {
+    for (uint32_t s; (s = next.fetch_add(1)) < table.size();) {
+      const auto& sec = table[s];
+      if (sec.offset > size || sec.bytes > size - sec.offset ||
+          Checksum::of(base + sec.offset, sec.bytes) != sec.checksum) {
+        skipped.fetch_add(1);
+        continue;
+      }
+      restored.fetch_add(detail::load_section(cache, base + sec.offset, sec.bytes, now_us, record_size, down_ms));
+    }
+  };
+  std::vector<std::thread> pool;
+  const size_t n = std::max<size_t>(1, std::min<size_t>(threads, table.size()));
+  for (size_t i = 1; i < n; ++i) pool.emplace_back(worker);
+  worker();
+  for (auto& t : pool) t.join();
+  ::munmap(map, size);
+
+  res.entries = restored.load();
+  res.skipped_sections = skipped.load();
+  res.ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - t0).count());
+  Metrics::instance().observe_restore(res.ms, res.entries, res.skipped_sections);
+  return res;
+}
+
+// Saves every `interval` in the background (0 = never) and once more on stop()
+class Scheduler {
+public:
+  Scheduler(const ShardedLruCache& cache, std::string path, std::chrono::seconds interval)
+    : cache_(cache), path_(std::move(path)), interval_(interval) {
+    if (interval_.count() > 0) thread_ = std::thread([this] { run(); });
+  }
+  ~Scheduler() { stop(); }
+
+  // Final snapshot; call after the server has stopped taking requests
+  SaveResult stop() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (stopped_) return {};
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    return save(cache_, path_);
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!cv_.wait_for(lock, interval_, [this] { return stopped_; })) {
+      lock.unlock();
+      save(cache_, path_);
+      lock.lock();
+    }
+  }
+
+  const ShardedLruCache& cache_;
+  std::string path_;
+  std::chrono::seconds interval_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stopped_ = false;
+  std::thread thread_;
+};
+
+}  // namespace snapshot
@@ -0,0 +1,541 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "metrics.hpp"
+#include "value_buffer.hpp"
+
+struct SpillConfig {
+  std::string dir;
+  size_t max_bytes = size_t{1} << 30;      // disk budget; the oldest segment is dropped past it
+  size_t segment_bytes = size_t{64} << 20;
+  double compact_below = 0.5;              // sealed segments with less live data are rewritten
+  size_t max_pending_bytes = size_t{64} << 20;   // demotions past this are dropped while the writer lags
+};
+
+// Second cache tier on local disk. RAM evictions are handed to demote()
+// under the shard lock, which only queues a reference; a background thread
+// appends them to a log of segment files and indexes key -> (segment,
+// offset) in memory. Pending entries and the index are split over
+// kStripes independently locked stripes by key hash, so the calls made
+// under shard locks contend only per stripe, and the writer and compaction
+// lock one stripe at a time. find() reads an entry back with pread; the caller
+// then claim()s it under the shard lock to move it to RAM, so a value
+// written to RAM in between is never overwritten by the older spilled copy.
+// Overwritten and promoted entries leave dead bytes behind: the same thread
+// rewrites the live records of sealed segments that fall below
+// compact_below (reading them through mmap) and drops the oldest segment
+// when the disk budget is exceeded.
+// The tier is a cache, not a store: segment files are removed on start and
+// exit, and warm restarts come from the snapshot.
+class SpillTier {
+public:
+  explicit SpillTier(SpillConfig cfg) : cfg_(std::move(cfg)) {
+    ::mkdir(cfg_.dir.c_str(), 0755);
+    remove_old_segments();
+    ok_ = roll();
+    if (ok_) register_gauges();
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~SpillTier() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mu_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+  }
+
+  // False if the directory or first segment could not be created
+  bool ok() const { return ok_; }
+
+  // Queues an evicted entry; cheap enough to call under a shard lock
+  void demote(const std::string& key, const ValueRef& value) {
+    if (!ok_) return;
+    Stripe& s = stripe(key);
+    std::lock_guard<std::mutex> lock(s.mu);
+    unindex_unlocked(s, key);
+    auto it = s.pending.find(key);
+    const size_t old = it == s.pending.end() ? 0 : it->second.value.size();
+    if (pending_bytes_.load(std::memory_order_relaxed) - old + value.size() > cfg_.max_pending_bytes) {
+      if (it != s.pending.end()) { pending_bytes_.fetch_sub(old, std::memory_order_relaxed); s.pending.erase(it); }
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    pending_bytes_.fetch_add(value.size(), std::memory_order_relaxed);
+    pending_bytes_.fetch_sub(old, std::memory_order_relaxed);
+    s.pending[key] = Pending{value, generation_.fetch_add(1, std::memory_order_relaxed) + 1};
+    if (pending_bytes_.load(std::memory_order_relaxed) >= kFlushBytes) wake_.notify_one();
+  }
+
+  // Forgets any copy of key (it was overwritten in RAM)
+  void erase(const std::string& key) {
+    Stripe& s = stripe(key);
+    std::lock_guard<std::mutex> lock(s.mu);
+    erase_unlocked(s, key);
+  }
+
+  // Reads the entry for key (empty ref if absent); *generation identifies
+  // this copy for claim()
+  ValueRef find(const std::string& key, uint64_t* generation) {
+    Loc loc;
+    {
+      Stripe& s = stripe(key);
+      std::lock_guard<std::mutex> lock(s.mu);
+      auto p = s.pending.find(key);
+      if (p != s.pending.end()) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        *generation = p->second.generation;
+        return p->second.value;
+      }
+      auto it = s.index.find(key);
+      if (it == s.index.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return ValueRef();
+      }
+      loc = it->second;
+    }
+    ScopedLatency timer(Metrics::instance().spill_read_latency());
+    // header and key into a small buffer, value straight into its ValueRef
+    std::string head(sizeof(RecordHeader) + loc.key_len, '\0');
+    char* dst = nullptr;
+    ValueRef v = ValueRef::allocate(loc.value_len, &dst, loc.encoding);
+    iovec iov[2] = {{head.data(), head.size()}, {dst, loc.value_len}};
+    const ssize_t n = ::preadv(loc.seg->fd, iov, 2, static_cast<off_t>(loc.offset));
+    RecordHeader h;
+    std::memcpy(&h, head.data(), sizeof(h));
+    if (n != static_cast<ssize_t>(loc.bytes()) || h.key_len != loc.key_len || h.value_len != loc.value_len ||
+        std::string_view(head.data() + sizeof(h), h.key_len) != key) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return ValueRef();
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    *generation = loc.generation;
+    return v;
+  }
+
+  // Removes key if it still holds the copy find() returned; false if that
+  // copy was erased or replaced since
+  bool claim(const std::string& key, uint64_t generation) {
+    Stripe& s = stripe(key);
+    std::lock_guard<std::mutex> lock(s.mu);
+    auto p = s.pending.find(key);
+    if (p != s.pending.end()) {
+      if (p->second.generation != generation) return false;
+    } else {
+      auto it = s.index.find(key);
+      if (it == s.index.end() || it->second.generation != generation) return false;
+    }
+    erase_unlocked(s, key);
+    return true;
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (const auto& s : stripes_) {
+      std::lock_guard<std::mutex> lock(s.mu);
+      n += s.index.size() + s.pending.size();
+    }
+    return n;
+  }
+
+  size_t disk_bytes() const { return disk_bytes_.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr size_t kFlushBytes = size_t{1} << 20;
+  static constexpr size_t kStripes = 32;
+
+  // Only a tier that started registers its series: main drops a failed one
+  void register_gauges() {
+    auto& m = Metrics::instance();
+    m.register_gauge("cache_spill_entries", "Entries in the disk tier",
+                     [this] { return double(size()); });
+    m.register_gauge("cache_spill_disk_bytes", "Bytes of disk tier segment files, live or dead",
+                     [this] { return double(disk_bytes_.load(std::memory_order_relaxed)); });
+    m.register_gauge("cache_spill_hits_total", "RAM misses served from the disk tier",
+                     [this] { return double(hits_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_spill_misses_total", "RAM misses not found in the disk tier either",
+                     [this] { return double(misses_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_spill_hit_ratio", "Disk tier hits over disk tier lookups", [this] {
+      const double h = double(hits_.load(std::memory_order_relaxed));
+      const double n = h + double(misses_.load(std::memory_order_relaxed));
+      return n > 0 ? h / n : 0.0;
+    });
+    m.register_gauge("cache_spill_demotions_total", "RAM evictions written to the disk tier",
+                     [this] { return double(demotions_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_spill_dropped_total", "Entries lost from the disk tier (writer backlog or disk budget)",
+                     [this] { return double(dropped_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_spill_compactions_total", "Disk tier segments compacted",
+                     [this] { return double(compactions_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_spill_errors_total", "Disk tier reads or writes that failed",
+                     [this] { return double(errors_.load(std::memory_order_relaxed)); }, "counter");
+  }
+
+  struct RecordHeader {
+    uint32_t key_len;
+    uint8_t encoding;
+    uint8_t unused[3];
+    uint64_t value_len;
+  };
+  static_assert(sizeof(RecordHeader) == 16, "record header is written as-is");
+
+  struct Pending {
+    ValueRef value;
+    uint64_t generation = 0;
+  };
+
+  // Readers hold a reference while they pread, so a dropped segment's file
+  // is closed and unlinked only after the last read finishes
+  struct Segment {
+    uint32_t id = 0;
+    int fd = -1;
+    std::string path;
+    uint64_t size = 0;                 // writer thread only
+    std::atomic<uint64_t> live{0};     // bytes of indexed records
+    ~Segment() {
+      if (fd >= 0) ::close(fd);
+      ::unlink(path.c_str());
+    }
+  };
+
+  struct Loc {
+    std::shared_ptr<Segment> seg;
+    uint32_t key_len = 0;
+    uint64_t offset = 0;
+    uint64_t value_len = 0;
+    uint64_t generation = 0;   // of the demote that wrote it; kept across compaction
+    ValueEncoding encoding = ValueEncoding::Identity;
+    uint64_t bytes() const { return sizeof(RecordHeader) + key_len + value_len; }
+  };
+
+  struct Stripe {
+    mutable std::mutex mu;
+    std::unordered_map<std::string, Pending> pending;   // demoted, not yet written
+    std::unordered_map<std::string, Loc> index;
+  };
+
+  // A record to append: key and value bytes must outlive the call
+  struct Out {
+    std::string_view key, value;
+    ValueEncoding encoding;
+  };
+
+  static size_t stripe_of(std::string_view key) {
+    // top bits of a multiplicative mix; the shard index uses the low ones
+    return static_cast<size_t>((std::hash<std::string_view>{}(key) * 0x9e3779b97f4a7c15ULL) >> 59) % kStripes;
+  }
+  Stripe& stripe(std::string_view key) { return stripes_[stripe_of(key)]; }
+
+  // Indices 0..n-1 grouped by the stripe of key_of(i)
+  template <typename KeyOf>
+  static std::array<std::vector<size_t>, kStripes> by_stripe(size_t n, KeyOf&& key_of) {
+    std::array<std::vector<size_t>, kStripes> groups;
+    for (size_t i = 0; i < n; ++i) groups[stripe_of(key_of(i))].push_back(i);
+    return groups;
+  }
+
+  std::string segment_path(uint32_t id) const { return cfg_.dir + "/spill-" + std::to_string(id) + ".log"; }
+
+  void remove_old_segments() {
+    DIR* d = ::opendir(cfg_.dir.c_str());
+    if (!d) return;
+    while (dirent* e = ::readdir(d)) {
+      const std::string name = e->d_name;
+      if (name.rfind("spill-", 0) == 0 && name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0)
+        ::unlink((cfg_.dir + "/" + name).c_str());
+    }
+    ::closedir(d);
+  }
+
+  // Opens a new active segment
+  bool roll() {
+    auto seg = std::make_shared<Segment>();
+    seg->id = next_id_++;
+    seg->path = segment_path(seg->id);
+    seg->fd = ::open(seg->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (seg->fd < 0) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      seg->path.clear();
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(seg_mu_);
+    segments_[seg->id] = seg;
+    active_ = std::move(seg);
+    return true;
+  }
+
+  // s.mu held
+  void erase_unlocked(Stripe& s, const std::string& key) {
+    auto it = s.pending.find(key);
+    if (it != s.pending.end()) {
+      pending_bytes_.fetch_sub(it->second.value.size(), std::memory_order_relaxed);
+      s.pending.erase(it);
+    }
+    unindex_unlocked(s, key);
+  }
+
+  // s.mu held; the on-disk copy of key, if any, becomes dead bytes
+  void unindex_unlocked(Stripe& s, const std::string& key) {
+    auto it = s.index.find(key);
+    if (it == s.index.end()) return;
+    it->second.seg->live.fetch_sub(it->second.bytes(), std::memory_order_relaxed);
+    s.index.erase(it);
+  }
+
+  // Appends records to the active segment in one write; returns their
+  // locations, or an empty vector if the write failed
+  std::vector<Loc> append(const std::vector<Out>& recs) {
+    if (active_->size >= cfg_.segment_bytes && !roll()) return {};
+    std::vector<Loc> locs;
+    locs.reserve(recs.size());
+    std::string buf;
+    for (const auto& r : recs) {
+      Loc l;
+      l.seg = active_;
+      l.key_len = static_cast<uint32_t>(r.key.size());
+      l.offset = active_->size + buf.size();
+      l.value_len = r.value.size();
+      l.encoding = r.encoding;
+      RecordHeader h{l.key_len, static_cast<uint8_t>(r.encoding), {0, 0, 0}, l.value_len};
+      buf.append(reinterpret_cast<const char*>(&h), sizeof(h));
+      buf.append(r.key.data(), r.key.size());
+      buf.append(r.value.data(), r.value.size());
+      locs.push_back(std::move(l));
+    }
+    size_t done = 0;
+    while (done < buf.size()) {
+      const ssize_t w = ::pwrite(active_->fd, buf.data() + done, buf.size() - done,
+                                 static_cast<off_t>(active_->size + done));
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        return {};
+      }
+      done += static_cast<size_t>(w);
+    }
+    active_->size += buf.size();
+    disk_bytes_.fetch_add(buf.size(), std::memory_order_relaxed);
+    return locs;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(wake_mu_);
+    while (!stop_) {
+      wake_.wait_for(lock, std::chrono::milliseconds(50), [this] {
+        return stop_ || pending_bytes_.load(std::memory_order_relaxed) >= kFlushBytes;
+      });
+      if (stop_) break;
+      lock.unlock();
+      std::vector<std::pair<std::string, Pending>> batch;
+      for (auto& s : stripes_) {
+        std::lock_guard<std::mutex> l(s.mu);
+        batch.insert(batch.end(), s.pending.begin(), s.pending.end());
+      }
+      if (!batch.empty()) write_batch(batch);
+      batch.clear();
+      enforce_budget();
+      compact_one();
+      lock.lock();
+    }
+  }
+
+  // Indexes each written entry unless it was taken, erased or demoted
+  // again while the write was in flight
+  void write_batch(const std::vector<std::pair<std::string, Pending>>& batch) {
+    std::vector<Out> recs;
+    recs.reserve(batch.size());
+    for (const auto& [key, p] : batch) recs.push_back({key, p.value.view(), p.value.encoding()});
+    auto locs = append(recs);
+    const auto groups = by_stripe(batch.size(), [&](size_t i) -> std::string_view { return batch[i].first; });
+    for (size_t g = 0; g < kStripes; ++g) {
+      if (groups[g].empty()) continue;
+      Stripe& s = stripes_[g];
+      std::lock_guard<std::mutex> lock(s.mu);
+      for (size_t i : groups[g]) {
+        auto it = s.pending.find(batch[i].first);
+        if (it == s.pending.end() || it->second.generation != batch[i].second.generation) continue;
+        pending_bytes_.fetch_sub(it->second.value.size(), std::memory_order_relaxed);
+        s.pending.erase(it);
+        if (locs.empty()) continue;   // write failed; the entry is lost
+        locs[i].generation = batch[i].second.generation;
+        locs[i].seg->live.fetch_add(locs[i].bytes(), std::memory_order_relaxed);
+        s.index[batch[i].first] = locs[i];
+        demotions_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Calls fn(key, value, encoding, offset) for each record of a sealed segment
+  template <typename Fn>
+  bool scan(const Segment& seg, Fn&& fn) {
+    if (seg.size == 0) return true;
+    void* map = ::mmap(nullptr, seg.size, PROT_READ, MAP_PRIVATE, seg.fd, 0);
+    if (map == MAP_FAILED) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    ::madvise(map, seg.size, MADV_SEQUENTIAL);
+    const char* p = static_cast<const char*>(map);
+    uint64_t off = 0;
+    while (off + sizeof(RecordHeader) <= seg.size) {
+      RecordHeader h;
+      std::memcpy(&h, p + off, sizeof(h));
+      const uint64_t n = sizeof(h) + h.key_len + h.value_len;
+      if (n > seg.size - off) break;
+      fn(std::string_view(p + off + sizeof(h), h.key_len),
+         std::string_view(p + off + sizeof(h) + h.key_len, h.value_len),
+         static_cast<ValueEncoding>(h.encoding), off);
+      off += n;
+    }
+    ::munmap(map, seg.size);
+    return true;
+  }
+
+  // (key, offset) of every record in seg that the index still points at.
+  // The segment's own records are looked up, one stripe lock at a time,
+  // rather than walking the whole index.
+  std::vector<std::pair<std::string, uint64_t>> live_records(const Segment& seg) {
+    std::vector<std::pair<std::string, uint64_t>> recs;
+    scan(seg, [&](std::string_view key, std::string_view, ValueEncoding, uint64_t off) {
+      recs.emplace_back(key, off);
+    });
+    std::vector<std::pair<std::string, uint64_t>> live;
+    const auto groups = by_stripe(recs.size(), [&](size_t i) -> std::string_view { return recs[i].first; });
+    for (size_t g = 0; g < kStripes; ++g) {
+      if (groups[g].empty()) continue;
+      Stripe& s = stripes_[g];
+      std::lock_guard<std::mutex> lock(s.mu);
+      for (size_t i : groups[g]) {
+        auto it = s.index.find(recs[i].first);
+        if (it != s.index.end() && it->second.seg.get() == &seg && it->second.offset == recs[i].second)
+          live.push_back(std::move(recs[i]));
+      }
+    }
+    return live;
+  }
+
+  // Removes a sealed segment; entries still indexed in it are lost
+  void drop(const std::shared_ptr<Segment>& seg) {
+    const auto keys = live_records(*seg);
+    const auto groups = by_stripe(keys.size(), [&](size_t i) -> std::string_view { return keys[i].first; });
+    for (size_t g = 0; g < kStripes; ++g) {
+      if (groups[g].empty()) continue;
+      Stripe& s = stripes_[g];
+      std::lock_guard<std::mutex> lock(s.mu);
+      for (size_t i : groups[g]) {
+        auto it = s.index.find(keys[i].first);
+        if (it == s.index.end() || it->second.seg != seg || it->second.offset != keys[i].second) continue;
+        s.index.erase(it);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    std::lock_guard<std::mutex> lock(seg_mu_);
+    segments_.erase(seg->id);
+    disk_bytes_.fetch_sub(seg->size, std::memory_order_relaxed);
+  }
+
+  // Oldest segments go first once the files outgrow the disk budget
+  void enforce_budget() {
+    for (;;) {
+      std::shared_ptr<Segment> oldest;
+      {
+        std::lock_guard<std::mutex> lock(seg_mu_);
+        if (disk_bytes_.load(std::memory_order_relaxed) <= cfg_.max_bytes || segments_.size() < 2) return;
+        oldest = segments_.begin()->second;
+      }
+      drop(oldest);
+    }
+  }
+
+  // Copies the live records of the emptiest eligible sealed segment to the
+  // active one, then drops it
+  void compact_one() {
+    std::shared_ptr<Segment> victim;
+    {
+      std::lock_guard<std::mutex> lock(seg_mu_);
+      double best = cfg_.compact_below;
+      for (const auto& [id, seg] : segments_) {
+        if (seg == active_ || seg->size == 0) continue;
+        const double share = double(seg->live.load(std::memory_order_relaxed)) / double(seg->size);
+        if (share < best) { best = share; victim = seg; }
+      }
+    }
+    if (!victim) return;
+
+    // live records, copied out of the mapping before it is unmapped
+    const auto keys = live_records(*victim);
+    std::vector<std::string> values(keys.size());
+    std::vector<ValueEncoding> encodings(keys.size());
+    {
+      std::unordered_map<uint64_t, size_t> at;   // offset -> index into keys
+      for (size_t i = 0; i < keys.size(); ++i) at.emplace(keys[i].second, i);
+      scan(*victim, [&](std::string_view, std::string_view value, ValueEncoding enc, uint64_t off) {
+        auto it = at.find(off);
+        if (it == at.end()) return;
+        values[it->second] = std::string(value);
+        encodings[it->second] = enc;
+      });
+    }
+    std::vector<Out> recs;
+    recs.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) recs.push_back({keys[i].first, values[i], encodings[i]});
+    auto locs = recs.empty() ? std::vector<Loc>{} : append(recs);
+    const auto groups = by_stripe(locs.size(), [&](size_t i) -> std::string_view { return keys[i].first; });
+    for (size_t g = 0; g < kStripes; ++g) {
+      if (groups[g].empty()) continue;
+      Stripe& s = stripes_[g];
+      std::lock_guard<std::mutex> lock(s.mu);
+      for (size_t i : groups[g]) {
+        auto it = s.index.find(keys[i].first);
+        // taken or replaced meanwhile: the new copy is dead on arrival
+        if (it == s.index.end() || it->second.seg != victim || it->second.offset != keys[i].second) continue;
+        victim->live.fetch_sub(it->second.bytes(), std::memory_order_relaxed);
+        locs[i].generation = it->second.generation;
+        locs[i].seg->live.fetch_add(locs[i].bytes(), std::memory_order_relaxed);
+        it->second = locs[i];
+      }
+    }
+    compactions_.fetch_add(1, std::memory_order_relaxed);
+    drop(victim);
+  }
+
+  SpillConfig cfg_;
+  bool ok_ = false;
+  std::array<Stripe, kStripes> stripes_;
+  std::atomic<size_t> pending_bytes_{0};
+  std::atomic<uint64_t> generation_{0};
+
+  std::mutex seg_mu_;                                        // segments_
+  std::map<uint32_t, std::shared_ptr<Segment>> segments_;   // oldest first
+  std::shared_ptr<Segment> active_;                         // writer thread only
+  uint32_t next_id_ = 0;
+
+  std::mutex wake_mu_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+
+  std::atomic<uint64_t> disk_bytes_{0};
+  std::atomic<uint64_t> hits_{0}, misses_{0}, demotions_{0}, dropped_{0}, compactions_{0}, errors_{0};
+  std::thread thread_;
+};
@@ -1,15 +1,14 @@
 #pragma once
-#include <chrono>
+#include "latency_histogram.hpp"
 #include "metrics.hpp"
 
-class ScopedGetTimer {
+// Feeds the GET / PUT request latency histograms
+class ScopedGetTimer : public ScopedLatency {
 public:
-  ScopedGetTimer() : start_(std::chrono::high_resolution_clock::now()) {}
-  ~ScopedGetTimer() {
-    auto end   = std::chrono::high_resolution_clock::now();
-    auto us    = std::chrono::duration_cast<std::chrono::microseconds>(end - start_).count();
-    Metrics::instance().observe_get_latency_us(static_cast<uint64_t>(us));
-  }
-private:
-  std::chrono::high_resolution_clock::time_point start_;
+  ScopedGetTimer() : ScopedLatency(Metrics::instance().get_latency()) {}
+};
+
+class ScopedPutTimer : public ScopedLatency {
+public:
+  ScopedPutTimer() : ScopedLatency(Metrics::instance().put_latency()) {}
 };
@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <sys/mman.h>
+
+// Size-classed slab allocator for value buffers. Blocks up to kMaxSlab bytes
+// are carved from 1 MiB chunks, each chunk serving one class and keeping
+// its own free list. A chunk whose blocks are all free goes back to a small
+// shared pool any class can reuse, and past kSpareChunks to the OS, so RSS
+// follows the live values rather than each class's peak. Larger blocks go
+// straight to the heap.
+class ValueSlab {
+public:
+  static constexpr size_t kMaxSlab = 256 * 1024;
+  static constexpr size_t kChunk = 1024 * 1024;
+  static constexpr size_t kSpareChunks = 4;
+  static constexpr uint32_t kHeapClass = UINT16_MAX;   // stored in 16 bits
+
+  // never destroyed: values may outlive other statics at exit
+  static ValueSlab& instance() { static ValueSlab* s = new ValueSlab; return *s; }
+
+  // Smallest class holding n bytes, or kHeapClass
+  static uint32_t class_for(size_t n) {
+    const auto& sizes = class_sizes();
+    auto it = std::lower_bound(sizes.begin(), sizes.end(), n);
+    return it == sizes.end() ? kHeapClass : static_cast<uint32_t>(it - sizes.begin());
+  }
+
+  static size_t class_size(uint32_t c) { return class_sizes()[c]; }
+
+  void* allocate(uint32_t c) {
+    Class& cl = classes_[c];
+    std::lock_guard<std::mutex> lock(cl.mu);
+    Chunk* ch = cl.avail;
+    if (!ch) {
+      ch = take_chunk();
+      ch->block = static_cast<uint32_t>(class_size(c));
+      ch->capacity = static_cast<uint32_t>(kChunk / ch->block);
+      link(cl, ch);
+    }
+    void* p;
+    if (ch->free) {
+      p = ch->free;
+      ch->free = ch->free->next;
+    } else {
+      // blocks never handed out yet are taken in order, so a reused chunk
+      // needs no free list built up front
+      p = ch->data() + size_t(ch->carved++) * ch->block;
+    }
+    if (++ch->used == ch->capacity) unlink(cl, ch);
+    return p;
+  }
+
+  void release(uint32_t c, void* p) {
+    Class& cl = classes_[c];
+    Chunk* ch = Chunk::of(p);
+    std::lock_guard<std::mutex> lock(cl.mu);
+    if (ch->used == ch->capacity) link(cl, ch);
+    ch->free = new (p) FreeBlock{ch->free};
+    if (--ch->used == 0) {
+      unlink(cl, ch);
+      give_back(ch);
+    }
+  }
+
+  // bytes held in slab chunks, whether in use or free
+  size_t reserved_bytes() const { return reserved_.load(std::memory_order_relaxed); }
+
+private:
+  // 64 B .. 256 KiB, four classes per power of two, so rounding wastes < 25%
+  static constexpr uint32_t kClasses = 49;
+  // A chunk is a header page and kChunk bytes of blocks, mapped at a kAlign
+  // boundary so a block finds its chunk by masking its address
+  static constexpr size_t kHeaderBytes = 4096;
+  static constexpr size_t kAlign = 2 * kChunk;
+
+  struct FreeBlock { FreeBlock* next; };
+
+  struct Chunk {
+    Chunk* prev = nullptr;   // in its class's list of chunks with free blocks
+    Chunk* next = nullptr;
+    FreeBlock* free = nullptr;
+    uint32_t block = 0, capacity = 0;
+    uint32_t used = 0;       // blocks handed out and not released
+    uint32_t carved = 0;     // blocks ever handed out from this use of the chunk
+
+    char* data() { return reinterpret_cast<char*>(this) + kHeaderBytes; }
+    static Chunk* of(void* p) {
+      return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(kAlign - 1));
+    }
+  };
+  static_assert(sizeof(Chunk) <= kHeaderBytes, "chunk header fits its page");
+
+  struct alignas(64) Class {
+    std::mutex mu;
+    Chunk* avail = nullptr;   // chunks with a free or uncarved block
+  };
+
+  ValueSlab() = default;
+
+  static const std::array<size_t, kClasses>& class_sizes() {
+    static const std::array<size_t, kClasses> sizes = [] {
+      std::array<size_t, kClasses> s{};
+      size_t base = 64;
+      uint32_t i = 0;
+      // four classes per power of two: base, 1.25, 1.5, 1.75
+      while (i < kClasses) {
+        for (size_t q = 4; q < 8 && i < kClasses; ++q) s[i++] = base * q / 4;
+        base *= 2;
+      }
+      return s;
+    }();
+    return sizes;
+  }
+
+  // cl.mu held
+  static void link(Class& cl, Chunk* ch) {
+    ch->prev = nullptr;
+    ch->next = cl.avail;
+    if (cl.avail) cl.avail->prev = ch;
+    cl.avail = ch;
+  }
+
+  static void unlink(Class& cl, Chunk* ch) {
+    if (ch->prev) ch->prev->next = ch->next;
+    else cl.avail = ch->next;
+    if (ch->next) ch->next->prev = ch->prev;
+    ch->prev = ch->next = nullptr;
+  }
+
+  // An empty chunk from the spare pool, or a new mapping
+  Chunk* take_chunk() {
+    {
+      std::lock_guard<std::mutex> lock(spare_mu_);
+      if (spare_count_) return new (spare_[--spare_count_]) Chunk;
+    }
+    void* m = ::mmap(nullptr, 2 * kAlign, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) throw std::bad_alloc();
+    // keep the kAlign-aligned part, unmap the slack on either side
+    char* raw = static_cast<char*>(m);
+    char* base = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + kAlign - 1) & ~uintptr_t(kAlign - 1));
+    if (base > raw) ::munmap(raw, static_cast<size_t>(base - raw));
+    char* tail = base + kHeaderBytes + kChunk;
+    ::munmap(tail, static_cast<size_t>(raw + 2 * kAlign - tail));
+    reserved_.fetch_add(kChunk, std::memory_order_relaxed);
+    return new (base) Chunk;
+  }
+
+  void give_back(Chunk* ch) {
+    {
+      std::lock_guard<std::mutex> lock(spare_mu_);
+      if (spare_count_ < kSpareChunks) { spare_[spare_count_++] = ch; return; }
+    }
+    ::munmap(ch, kHeaderBytes + kChunk);
+    reserved_.fetch_sub(kChunk, std::memory_order_relaxed);
+  }
+
+  std::array<Class, kClasses> classes_;
+  std::mutex spare_mu_;
+  std::array<Chunk*, kSpareChunks> spare_{};
+  size_t spare_count_ = 0;
+  std::atomic<size_t> reserved_{0};
+};
+
+// How a value's bytes are stored. Gzip values are complete gzip members, so
+// they can be sent as-is with Content-Encoding: gzip (see compression.hpp).
+enum class ValueEncoding : uint8_t { Identity = 0, Gzip = 1 };
+
+// Immutable, reference-counted value bytes. The refcount, length and
+// payload share one slab block, so handing a value to a reader is an atomic
+// increment rather than a copy. The bytes stay valid while any ValueRef to
+// them exists, even after the cache has evicted the entry.
+class ValueRef {
+public:
+  ValueRef() = default;
+  ValueRef(const ValueRef& o) noexcept : h_(o.h_) { retain(); }
+  ValueRef(ValueRef&& o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+  ValueRef& operator=(ValueRef o) noexcept { std::swap(h_, o.h_); return *this; }
+  ~ValueRef() { reset(); }
+
+  static ValueRef copy_of(std::string_view s, ValueEncoding enc = ValueEncoding::Identity) {
+    char* dst = nullptr;
+    ValueRef v = allocate(s.size(), &dst, enc);
+    if (!s.empty()) std::memcpy(dst, s.data(), s.size());
+    return v;
+  }
+
+  // Uninitialised buffer of n bytes for the caller to fill before sharing it
+  static ValueRef allocate(size_t n, char** data, ValueEncoding enc = ValueEncoding::Identity) {
+    const size_t need = sizeof(Header) + n;
+    const uint32_t cls = ValueSlab::class_for(need);
+    void* mem = cls == ValueSlab::kHeapClass ? ::operator new(need)
+                                             : ValueSlab::instance().allocate(cls);
+    ValueRef v;
+    v.h_ = new (mem) Header{{1}, static_cast<uint16_t>(cls), enc, 0, n};
+    *data = v.h_->bytes();
+    return v;
+  }
+
+  const char* data() const { return h_ ? h_->bytes() : nullptr; }
+  size_t size() const { return h_ ? h_->size : 0; }
+  ValueEncoding encoding() const { return h_ ? h_->encoding : ValueEncoding::Identity; }
+  std::string_view view() const { return h_ ? std::string_view(h_->bytes(), h_->size) : std::string_view(); }
+  explicit operator bool() const { return h_ != nullptr; }
+
+  // Bytes this value actually occupies, including header and slab rounding
+  size_t footprint() const { return h_ ? footprint_for(h_->size) : 0; }
+
+  static size_t footprint_for(size_t n) {
+    const uint32_t cls = ValueSlab::class_for(sizeof(Header) + n);
+    return cls == ValueSlab::kHeapClass ? sizeof(Header) + n : ValueSlab::class_size(cls);
+  }
+
+  void reset() {
+    if (h_ && h_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      const uint32_t cls = h_->cls;
+      h_->~Header();
+      if (cls == ValueSlab::kHeapClass) ::operator delete(h_);
+      else ValueSlab::instance().release(cls, h_);
+    }
+    h_ = nullptr;
+  }
+
+private:
+  struct Header {
+    std::atomic<uint32_t> refs;
+    uint16_t cls;
+    ValueEncoding encoding;
+    uint8_t unused;
+    size_t size;
+    char* bytes() const { return reinterpret_cast<char*>(const_cast<Header*>(this) + 1); }
+  };
+  static_assert(sizeof(Header) == 16, "payload follows a 16-byte header");
+
+  void retain() { if (h_) h_->refs.fetch_add(1, std::memory_order_relaxed); }
+
+  Header* h_ = nullptr;
+};
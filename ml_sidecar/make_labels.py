@@ -0,0 +1,79 @@
+"""Turn the cache access log into supervised rows for train.py.
+
+Reads data/access_log.csv (or .bin written with LOG_FORMAT=binary, plus any
+rotated siblings) and writes tmp/train.csv with the four model features and a
+reuse label: 1 if the key is requested again within HORIZON_MS.
+"""
+import glob, os, struct, sys
+import numpy as np
+import pandas as pd
+
+HORIZON_MS = 60_000
+DEFAULT_FETCH_COST_MS = 50
+OPS = ["GET", "PUT", "OTHER", "FETCH", "MGET", "MPUT"]   # CsvLogger::kOpNames
+OUT = os.path.join("tmp", "train.csv")
+
+def read_binary(path):
+  # column blocks: "GCLB" u16 ver u16 pad u32 rows u32 key_bytes, then columns
+  buf = open(path, "rb").read()
+  frames, off = [], 0
+  while off + 16 <= len(buf):
+    magic, ver, _, rows, key_bytes = struct.unpack_from("<4sHHII", buf, off)
+    if magic != b"GCLB" or ver != 1:
+      raise ValueError(f"{path}: bad block header at offset {off}")
+    off += 16
+    def col(dtype, n=rows):
+      nonlocal off
+      a = np.frombuffer(buf, dtype=dtype, count=n, offset=off)
+      off += a.nbytes
+      return a
+    ts, lat, size = col("<u8"), col("<u8"), col("<u8")
+    op, hit, klen = col("u1"), col("u1"), col("<u2")
+    keys_raw = buf[off:off + key_bytes]; off += key_bytes
+    ends = np.cumsum(klen)
+    starts = ends - klen
+    keys = [keys_raw[s:e].decode("utf-8", "replace") for s, e in zip(starts, ends)]
+    frames.append(pd.DataFrame({
+      "ts_ms": ts, "op": [OPS[o] for o in op], "key": keys,
+      "hit": hit, "lat_us": lat, "size_bytes": size}))
+  return pd.concat(frames, ignore_index=True) if frames else pd.DataFrame()
+
+def read_log(path):
+  stem, ext = os.path.splitext(path)
+  paths = sorted(glob.glob(f"{stem}.*{ext}")) + [path]   # rotated files first
+  reader = read_binary if ext == ".bin" else pd.read_csv
+  frames = [reader(p) for p in paths if os.path.exists(p) and os.path.getsize(p) > 0]
+  if not frames:
+    return pd.DataFrame()
+  return pd.concat(frames, ignore_index=True).sort_values("ts_ms", kind="stable")
+
+def label(df):
+  # one row per access, features as seen at that moment
+  # a FETCH record is the origin read behind a GET miss, not another access
+  df = df[df["op"].isin(["GET", "PUT", "MGET", "MPUT"])].reset_index(drop=True)
+  g = df.groupby("key", sort=False)
+  prev_ts = g["ts_ms"].shift(1)
+  next_ts = g["ts_ms"].shift(-1)
+  out = pd.DataFrame({
+    "recency_us": ((df["ts_ms"] - prev_ts).fillna(1e9) * 1000).astype("int64"),
+    "access_count": g.cumcount(),
+    "size_bytes": df["size_bytes"],
+    "fetch_cost_ms": DEFAULT_FETCH_COST_MS,
+    "label": ((next_ts - df["ts_ms"]) <= HORIZON_MS).astype(int),
+  })
+  return out
+
+def main():
+  path = sys.argv[1] if len(sys.argv) > 1 else os.path.join("..", "data", "access_log.csv")
+  df = read_log(path)
+  if df.empty:
+    print(f"no access records in {path}")
+    return 1
+  rows = label(df)
+  os.makedirs("tmp", exist_ok=True)
+  rows.to_csv(OUT, index=False)
+  print(f"wrote {len(rows)} rows to {OUT} (reuse rate {rows['label'].mean():.2f})")
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -5,6 +5,7 @@ from sklearn.model_selection import train_test_split
 import joblib, os
 
 REAL_DERIVED = "tmp/train.csv"
+NATIVE_MODEL = "models/model.txt"   # read by the C++ NativeModelStrategy
 FEATS = ["recency_us", "access_count", "size_bytes", "fetch_cost_ms"]
 
 def synthetic_df(n=2000, seed=0):
@@ -27,8 +28,21 @@ def train_from_csv(path):
   acc = clf.score(Xte, yte)
   os.makedirs("models", exist_ok=True)
   joblib.dump(clf, "models/model.joblib")
+  export_native(clf)
   return acc
 
+def export_native(clf, path=NATIVE_MODEL):
+  # written to a temp file and renamed so the server never reads a partial model
+  coef = " ".join(repr(float(c)) for c in clf.coef_[0])
+  tmp = path + ".tmp"
+  with open(tmp, "w") as f:
+    f.write("geocache-model 1\n")
+    f.write("type logreg\n")
+    f.write("transform none\n")
+    f.write(f"coef {coef}\n")
+    f.write(f"intercept {float(clf.intercept_[0])!r}\n")
+  os.replace(tmp, path)
+
 def train_auto():
   if os.path.exists(REAL_DERIVED):
     return train_from_csv(REAL_DERIVED)
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Length-prefixed binary protocol for the second listener (BINARY_PORT).
+// All integers little-endian. A connection carries any number of requests
+// back to back; responses come back in request order, so clients may
+// pipeline without waiting.
+//
+//   request  u8 magic=0xC7  u8 op  u16 key_len  u32 value_len  u32 ttl_ms  key  value
+//   response u8 magic=0xC8  u8 op  u8 status  u8 flags  u32 value_len  value
+//
+// GET carries no value; PUT's ttl_ms of 0 uses the server default. A
+// response's op echoes the request's.
+namespace binproto {
+
+constexpr uint8_t kRequestMagic = 0xC7;
+constexpr uint8_t kResponseMagic = 0xC8;
+constexpr size_t kRequestHeader = 12;
+constexpr size_t kResponseHeader = 8;
+constexpr uint32_t kMaxValue = 64u << 20;   // larger frames close the connection
+
+enum Op : uint8_t { kNoop = 0, kGet = 1, kPut = 2 };
+// kRejected: value above the size limit; kNotAdmitted: the eviction policy
+// declined a new key (not an error)
+enum Status : uint8_t { kOk = 0, kMiss = 1, kRejected = 2, kBadRequest = 3, kNotAdmitted = 4 };
+enum Flags : uint8_t { kStale = 1 };
+
+struct RequestHeader {
+  uint8_t op = kNoop;
+  uint16_t key_len = 0;
+  uint32_t value_len = 0;
+  uint32_t ttl_ms = 0;
+};
+
+inline void put_u16(char* p, uint16_t v) { std::memcpy(p, &v, 2); }
+inline void put_u32(char* p, uint32_t v) { std::memcpy(p, &v, 4); }
+inline uint16_t get_u16(const char* p) { uint16_t v; std::memcpy(&v, p, 2); return v; }
+inline uint32_t get_u32(const char* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+// Parses a header from at least kRequestHeader bytes; false on a bad magic
+inline bool parse_request(const char* p, RequestHeader& h) {
+  if (static_cast<uint8_t>(p[0]) != kRequestMagic) return false;
+  h.op = static_cast<uint8_t>(p[1]);
+  h.key_len = get_u16(p + 2);
+  h.value_len = get_u32(p + 4);
+  h.ttl_ms = get_u32(p + 8);
+  return true;
+}
+
+inline void append_request(std::string& out, Op op, std::string_view key,
+                           std::string_view value = {}, uint32_t ttl_ms = 0) {
+  char h[kRequestHeader];
+  h[0] = static_cast<char>(kRequestMagic);
+  h[1] = static_cast<char>(op);
+  put_u16(h + 2, static_cast<uint16_t>(key.size()));
+  put_u32(h + 4, static_cast<uint32_t>(value.size()));
+  put_u32(h + 8, ttl_ms);
+  out.append(h, sizeof(h));
+  out.append(key.data(), key.size());
+  out.append(value.data(), value.size());
+}
+
+inline void append_response_header(std::string& out, uint8_t op, Status status, uint8_t flags,
+                                   uint32_t value_len) {
+  char h[kResponseHeader];
+  h[0] = static_cast<char>(kResponseMagic);
+  h[1] = static_cast<char>(op);
+  h[2] = static_cast<char>(status);
+  h[3] = static_cast<char>(flags);
+  put_u32(h + 4, value_len);
+  out.append(h, sizeof(h));
+}
+
+}  // namespace binproto
@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../cache/expiry.hpp"
+#include "../cache/key_stats.hpp"
+#include "../cache/logger.hpp"
+#include "../cache/metrics.hpp"
+#include "../cache/sharded_cache.hpp"
+#include "binary_protocol.hpp"
+
+struct BinaryServerConfig {
+  int port = 8081;
+  size_t threads = 1;   // event loops, each with its own SO_REUSEPORT socket
+};
+
+// Second listener speaking binproto over plain TCP. Each event loop owns an
+// epoll set, a listening socket and its connections, so loops share nothing
+// but the cache. A readable event reads what the socket has, answers the
+// complete frames in it and sends the answers with one write, so pipelined
+// requests cost one syscall pair per batch rather than per request. Misses
+// are answered as misses (no read-through: an origin fetch would stall the
+// loop), and stale hits are flagged but left for /get to refresh.
+//
+// Backpressure: one event reads at most kReadBudget bytes and answers at
+// most kFrameBudget frames, and nothing more is read while complete frames
+// are still queued. A connection with kOutHighWater bytes unsent stops
+// being answered and read from until the peer takes its replies, so a
+// client that pipelines without reading holds a bounded amount of memory.
+class BinaryServer {
+public:
+  BinaryServer(ShardedLruCache& cache, BinaryServerConfig cfg) : cache_(cache), cfg_(cfg) {
+    if (cfg_.threads == 0) cfg_.threads = 1;
+    auto& m = Metrics::instance();
+    m.register_gauge("cache_binary_connections", "Open binary protocol connections",
+                     [this] { return double(connections_.load(std::memory_order_relaxed)); });
+    m.register_gauge("cache_binary_requests_total", "Binary protocol requests served",
+                     [this] { return double(requests_.load(std::memory_order_relaxed)); }, "counter");
+    m.register_gauge("cache_binary_protocol_errors_total", "Binary connections closed for a malformed frame",
+                     [this] { return double(errors_.load(std::memory_order_relaxed)); }, "counter");
+  }
+
+  ~BinaryServer() { stop(); }
+
+  // Opens the listeners; false if the port cannot be bound
+  bool start() {
+    for (size_t i = 0; i < cfg_.threads; ++i) {
+      auto loop = std::make_unique<Loop>();
+      loop->listen_fd = listen_socket(cfg_.port);
+      if (loop->listen_fd < 0) { stop(); return false; }
+      loop->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+      loop->wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      watch(*loop, loop->listen_fd, EPOLLIN, EPOLL_CTL_ADD);
+      watch(*loop, loop->wake_fd, EPOLLIN, EPOLL_CTL_ADD);
+      loops_.push_back(std::move(loop));
+    }
+    for (auto& l : loops_) l->thread = std::thread([this, lp = l.get()] { run(*lp); });
+    return true;
+  }
+
+  void stop() {
+    stopping_.store(true, std::memory_order_release);
+    for (auto& l : loops_) {
+      if (l->wake_fd >= 0) { uint64_t one = 1; (void)!::write(l->wake_fd, &one, sizeof(one)); }
+    }
+    for (auto& l : loops_) {
+      if (l->thread.joinable()) l->thread.join();
+      for (auto& c : l->conns) ::close(c.first);
+      for (int fd : {l->listen_fd, l->epoll_fd, l->wake_fd}) if (fd >= 0) ::close(fd);
+    }
+    loops_.clear();
+  }
+
+private:
+  static constexpr size_t kReadBudget = 1 << 20;
+  static constexpr size_t kFrameBudget = 1024;
+  static constexpr size_t kOutHighWater = 8 << 20;
+  // the budgets keep buffers below these; past them the connection is closed
+  static constexpr size_t kMaxIn = kReadBudget + binproto::kRequestHeader + 0xffff + binproto::kMaxValue;
+  static constexpr size_t kMaxOut = kOutHighWater + binproto::kResponseHeader + binproto::kMaxValue;
+
+  struct Conn {
+    std::string in;
+    size_t in_off = 0;     // parsed prefix of in
+    std::string out;
+    size_t out_off = 0;    // written prefix of out
+    uint32_t events = EPOLLIN;   // current epoll interest
+    bool queued = false;         // in Loop::backlog
+
+    size_t unsent() const { return out.size() - out_off; }
+  };
+
+  struct Loop {
+    int listen_fd = -1, epoll_fd = -1, wake_fd = -1;
+    std::unordered_map<int, Conn> conns;
+    std::vector<int> backlog;   // connections left with complete frames by kFrameBudget
+    std::thread thread;
+  };
+
+  static int listen_socket(int port) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 1024) != 0) {
+      ::close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  static void watch(Loop& l, int fd, uint32_t events, int op) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    ::epoll_ctl(l.epoll_fd, op, fd, &ev);
+  }
+
+  void run(Loop& l) {
+    epoll_event events[256];
+    while (!stopping_.load(std::memory_order_acquire)) {
+      // queued frames are answered without waiting for new events
+      const int n = ::epoll_wait(l.epoll_fd, events, 256, l.backlog.empty() ? -1 : 0);
+      for (int i = 0; i < n; ++i) {
+        const int fd = events[i].data.fd;
+        if (fd == l.wake_fd) continue;
+        if (fd == l.listen_fd) { accept_all(l); continue; }
+        auto it = l.conns.find(fd);
+        if (it == l.conns.end()) continue;
+        bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP)) || (events[i].events & EPOLLIN);
+        if (ok && (events[i].events & EPOLLIN)) ok = on_readable(fd, it->second);
+        // a drained output may unblock queued frames
+        if (ok && (events[i].events & EPOLLOUT)) ok = flush(fd, it->second) && serve(fd, it->second);
+        if (ok) ok = settle(l, fd, it->second);
+        if (!ok) close_conn(l, fd);
+      }
+      std::vector<int> backlog;
+      backlog.swap(l.backlog);
+      for (int fd : backlog) {
+        auto it = l.conns.find(fd);
+        if (it == l.conns.end() || !it->second.queued) continue;
+        it->second.queued = false;
+        if (!(serve(fd, it->second) && settle(l, fd, it->second))) close_conn(l, fd);
+      }
+    }
+  }
+
+  void accept_all(Loop& l) {
+    for (;;) {
+      const int fd = ::accept4(l.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) return;
+      int one = 1;
+      ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      l.conns.emplace(fd, Conn{});
+      watch(l, fd, EPOLLIN, EPOLL_CTL_ADD);
+      connections_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void close_conn(Loop& l, int fd) {
+    ::epoll_ctl(l.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    l.conns.erase(fd);
+    connections_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Sets the epoll interest after an event: EPOLLIN only while the
+  // connection may read more, EPOLLOUT only while a write is pending.
+  // Connections with frames left by the frame budget go on the backlog.
+  bool settle(Loop& l, int fd, Conn& c) {
+    if (c.in.size() - c.in_off > kMaxIn || c.unsent() > kMaxOut) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    const bool blocked = c.unsent() >= kOutHighWater;
+    const bool pending = has_frame(c);
+    const uint32_t want = (blocked || pending ? 0u : uint32_t(EPOLLIN)) | (c.unsent() ? uint32_t(EPOLLOUT) : 0u);
+    if (want != c.events) {
+      watch(l, fd, want, EPOLL_CTL_MOD);
+      c.events = want;
+    }
+    if (pending && !blocked && !c.queued) {
+      c.queued = true;
+      l.backlog.push_back(fd);
+    }
+    return true;
+  }
+
+  // True if c.in holds a complete frame, or a malformed header to report
+  static bool has_frame(const Conn& c) {
+    if (c.in.size() - c.in_off < binproto::kRequestHeader) return false;
+    binproto::RequestHeader h;
+    if (!binproto::parse_request(c.in.data() + c.in_off, h) || h.value_len > binproto::kMaxValue) return true;
+    return c.in.size() - c.in_off >= binproto::kRequestHeader + h.key_len + h.value_len;
+  }
+
+  bool on_readable(int fd, Conn& c) {
+    char buf[64 * 1024];
+    size_t got = 0;
+    while (got < kReadBudget) {
+      const ssize_t n = ::read(fd, buf, std::min(sizeof(buf), kReadBudget - got));
+      if (n > 0) { c.in.append(buf, static_cast<size_t>(n)); got += static_cast<size_t>(n); continue; }
+      if (n == 0) return false;
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return false;
+    }
+    return serve(fd, c);
+  }
+
+  // Answers queued frames within the budgets and sends what it can
+  bool serve(int fd, Conn& c) {
+    const bool ok = handle_frames(c);
+    if (!ok) errors_.fetch_add(1, std::memory_order_relaxed);
+    // frames before a malformed one are still answered
+    return flush(fd, c) && ok;
+  }
+
+  // Answers up to kFrameBudget complete frames in c.in, stopping early at
+  // kOutHighWater unsent bytes; false on a malformed frame
+  bool handle_frames(Conn& c) {
+    uint64_t gets = 0, hits = 0, puts = 0, rejected = 0, not_admitted = 0;
+    bool ok = true;
+    // drop the sent prefix of a partly written output before appending
+    if (c.out_off > kReadBudget) { c.out.erase(0, c.out_off); c.out_off = 0; }
+    for (size_t frames = 0; frames < kFrameBudget && c.unsent() < kOutHighWater &&
+                            c.in.size() - c.in_off >= binproto::kRequestHeader; ++frames) {
+      const char* p = c.in.data() + c.in_off;
+      binproto::RequestHeader h;
+      if (!binproto::parse_request(p, h) || h.value_len > binproto::kMaxValue) { ok = false; break; }
+      const size_t frame = binproto::kRequestHeader + h.key_len + h.value_len;
+      if (c.in.size() - c.in_off < frame) break;
+      const std::string key(p + binproto::kRequestHeader, h.key_len);
+      const char* value = p + binproto::kRequestHeader + h.key_len;
+      const auto t0 = std::chrono::steady_clock::now();
+
+      switch (h.op) {
+        case binproto::kGet: {
+          ++gets;
+          // reported as kStale, never claimed: this listener cannot refresh,
+          // so the refresh is left to an HTTP reader with an origin
+          Freshness fr = Freshness::Fresh;
+          auto v = cache_.get_ref(key, &fr, /*claim_refresh=*/false);
+          if (v) {
+            ++hits;
+            KeyStatsStore::instance().touch(key, v.size());
+            binproto::append_response_header(c.out, h.op, binproto::kOk,
+                                             fr == Freshness::Fresh ? 0 : binproto::kStale,
+                                             static_cast<uint32_t>(v.size()));
+            c.out.append(v.data(), v.size());
+          } else {
+            binproto::append_response_header(c.out, h.op, binproto::kMiss, 0, 0);
+          }
+          CsvLogger::instance().write("GET", key, static_cast<bool>(v), since_us(t0), v.size());
+          break;
+        }
+        case binproto::kPut: {
+          ++puts;
+          Expiry e;
+          e.ttl = std::chrono::milliseconds(h.ttl_ms);
+          PutResult r = PutResult::Stored;
+          const bool ok = cache_.put(key, ValueRef::copy_of(std::string_view(value, h.value_len)), e, &r);
+          binproto::Status status = binproto::kOk;
+          if (ok) KeyStatsStore::instance().touch(key, h.value_len);
+          else if (r == PutResult::TooLarge) { ++rejected; status = binproto::kRejected; }
+          else { ++not_admitted; status = binproto::kNotAdmitted; }
+          binproto::append_response_header(c.out, h.op, status, 0, 0);
+          CsvLogger::instance().write("PUT", key, ok, since_us(t0), h.value_len);
+          break;
+        }
+        case binproto::kNoop:
+          binproto::append_response_header(c.out, h.op, binproto::kOk, 0, 0);
+          break;
+        default:
+          binproto::append_response_header(c.out, h.op, binproto::kBadRequest, 0, 0);
+      }
+      c.in_off += frame;
+    }
+    // keep only the unparsed tail
+    if (c.in_off == c.in.size()) { c.in.clear(); c.in_off = 0; }
+    else if (c.in_off > 64 * 1024) { c.in.erase(0, c.in_off); c.in_off = 0; }
+
+    if (gets + puts == 0) return ok;
+    auto& m = Metrics::instance();
+    requests_.fetch_add(gets + puts, std::memory_order_relaxed);
+    if (gets) { m.add_get_requests(gets); m.add_hits(hits); m.add_misses(gets - hits); }
+    if (puts) {
+      m.add_put_requests(puts);
+      m.add_put_rejected(rejected);
+      m.add_put_not_admitted(not_admitted);
+      m.set_current_size(cache_.size());
+      m.set_resident_bytes(cache_.resident_bytes());
+    }
+    return ok;
+  }
+
+  static bool flush(int fd, Conn& c) {
+    while (c.out_off < c.out.size()) {
+      const ssize_t n = ::send(fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+      if (n > 0) { c.out_off += static_cast<size_t>(n); continue; }
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+      return false;
+    }
+    c.out.clear();
+    c.out_off = 0;
+    return true;
+  }
+
+  static uint64_t since_us(std::chrono::steady_clock::time_point t0) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - t0).count());
+  }
+
+  ShardedLruCache& cache_;
+  BinaryServerConfig cfg_;
+  std::vector<std::unique_ptr<Loop>> loops_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<uint64_t> connections_{0}, requests_{0}, errors_{0};
+};
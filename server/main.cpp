@@ -1,17 +1,36 @@
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <cstdlib>
 #include <chrono>
+#include <unordered_set>
+#include <csignal>
+#include <thread>
 
 #include "../third_party/httplib.h"
 #include "../third_party/json.hpp"
 
 #include "../cache/lru_cache.hpp"
+#include "../cache/sharded_cache.hpp"
 #include "../cache/metrics.hpp"
 #include "../cache/timer.hpp"
 #include "../cache/key_stats.hpp"
 #include "../cache/eviction.hpp"
 #include "../cache/logger.hpp"
+#include "../cache/eviction_engine.hpp"
+#include "../cache/native_scorer.hpp"
+#include "../cache/policies.hpp"
+#include "../cache/origin_fetcher.hpp"
+#include "../cache/value_buffer.hpp"
+#include "../cache/snapshot.hpp"
+#include "../cache/expiry.hpp"
+#include "../cache/compression.hpp"
+#include "../cache/spill_tier.hpp"
+#include "../cache/online_learner.hpp"
+#include "../cache/cluster.hpp"
+#include "value_response.hpp"
+#include "binary_server.hpp"
 
 using json = nlohmann::json;
 
@@ -21,65 +40,449 @@ static inline uint64_t since_us(std::chrono::high_resolution_clock::time_point t
     return static_cast<uint64_t>(us);
 }
 
+// Parses sizes like "4096", "512K", "64M", "2G" (binary units)
+static size_t parse_bytes(const char* s) {
+    char* end = nullptr;
+    double v = std::strtod(s, &end);
+    switch (end && *end ? *end : ' ') {
+        case 'k': case 'K': v *= 1024.0; break;
+        case 'm': case 'M': v *= 1024.0 * 1024.0; break;
+        case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; break;
+        default: break;
+    }
+    return v > 0 ? static_cast<size_t>(v) : 0;
+}
+
 int main() {
-    // Cache with capacity 100 items
-    LruCache cache(100);
+    // Snapshots (SNAPSHOT_PATH) need a clean shutdown: SIGINT/SIGTERM are
+    // blocked here, before any thread starts, and taken by sigwait below.
+    const char* snapshot_path = std::getenv("SNAPSHOT_PATH");
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    if (snapshot_path) pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    // Cache limits via env:
+    //   CACHE_MAX_BYTES (e.g. 512M) and/or CACHE_MAX_ITEMS; 100 items if neither is set
+    //   CACHE_MAX_OBJECT_FRACTION rejects values above this share of a shard's bytes (0.5)
+    //   CACHE_SHARDS splits the budget over N lock-striped shards
+    CacheLimits limits;
+    if (const char* b = std::getenv("CACHE_MAX_BYTES")) limits.max_bytes = parse_bytes(b);
+    if (const char* n = std::getenv("CACHE_MAX_ITEMS")) limits.max_items = std::strtoul(n, nullptr, 10);
+    if (const char* f = std::getenv("CACHE_MAX_OBJECT_FRACTION")) limits.max_object_fraction = std::atof(f);
+    if (limits.max_bytes == 0 && limits.max_items == 0) limits.max_items = 100;
+    size_t shards = 1;
+    if (const char* n = std::getenv("CACHE_SHARDS")) shards = std::strtoul(n, nullptr, 10);
+    ShardedLruCache cache(limits, shards);
+    // Value compression, off unless CACHE_COMPRESS_MIN_BYTES is set:
+    //   CACHE_COMPRESS_MIN_BYTES gzips values at least this large (e.g. 4K)
+    //   CACHE_COMPRESS_MAX_RATIO keeps a value compressed only at or below this ratio (0.8)
+    //   CACHE_COMPRESS_LEVEL is the zlib level (1, fastest)
+    {
+        CompressionConfig ccfg;
+        if (const char* b = std::getenv("CACHE_COMPRESS_MIN_BYTES")) ccfg.min_bytes = parse_bytes(b);
+        if (const char* r = std::getenv("CACHE_COMPRESS_MAX_RATIO")) ccfg.max_ratio = std::atof(r);
+        if (const char* l = std::getenv("CACHE_COMPRESS_LEVEL")) ccfg.level = std::atoi(l);
+        cache.set_compression(ccfg);
+        if (ccfg.enabled())
+            std::cout << "Compressing values >= " << ccfg.min_bytes << " bytes (zlib level " << ccfg.level
+                      << ", kept at ratio <= " << ccfg.max_ratio << ")\n";
+    }
+    // Disk tier for RAM evictions, off unless SPILL_DIR is set:
+    //   SPILL_MAX_BYTES disk budget (1G), SPILL_SEGMENT_BYTES log segment size (64M)
+    if (const char* dir = std::getenv("SPILL_DIR")) {
+        SpillConfig scfg;
+        scfg.dir = dir;
+        if (const char* b = std::getenv("SPILL_MAX_BYTES")) scfg.max_bytes = parse_bytes(b);
+        if (const char* b = std::getenv("SPILL_SEGMENT_BYTES")) scfg.segment_bytes = parse_bytes(b);
+        auto spill = std::make_shared<SpillTier>(scfg);
+        if (spill->ok()) {
+            cache.set_spill_tier(spill);
+            std::cout << "Spill tier in " << scfg.dir << ", " << scfg.max_bytes << " bytes\n";
+        } else {
+            std::cerr << "Spill tier: cannot write to " << scfg.dir << "\n";
+        }
+    }
+    // Hot-key replica, off unless HOT_KEYS is set:
+    //   HOT_KEYS=K replicates up to K heavy hitters for lock-free GETs (top K on /stats)
+    //   HOT_KEY_MIN_SHARE share of sampled lookups a key needs (0.01)
+    //   HOT_KEY_SAMPLE feeds 1 in N lookups to the detector (16)
+    //   HOT_KEY_TOUCH refreshes shard recency on 1 in N replica hits (64)
+    if (const char* k = std::getenv("HOT_KEYS")) {
+        HotKeyConfig hcfg;
+        hcfg.top_k = std::strtoul(k, nullptr, 10);
+        if (const char* s = std::getenv("HOT_KEY_MIN_SHARE")) hcfg.min_share = std::atof(s);
+        if (const char* n = std::getenv("HOT_KEY_SAMPLE")) hcfg.sample_every = std::strtoul(n, nullptr, 10);
+        if (const char* n = std::getenv("HOT_KEY_TOUCH")) hcfg.touch_every = std::strtoul(n, nullptr, 10);
+        cache.set_hot_keys(hcfg);
+        if (hcfg.enabled()) {
+            Metrics::instance().set_hot_keys_source([&cache] { return cache.hot_keys(); });
+            std::cout << "Hot-key replica: top " << hcfg.top_k << " keys above " << hcfg.min_share
+                      << " of lookups\n";
+        }
+    }
+    Metrics::instance().set_shard_stats_source([&cache] { return cache.shard_stats(); });
+    Metrics::instance().register_gauge("cache_ram_hit_ratio", "RAM tier hits over RAM tier lookups", [&cache] {
+        double hits = 0, lookups = 0;
+        for (const auto& st : cache.shard_stats()) { hits += double(st.hits); lookups += double(st.hits + st.misses); }
+        return lookups > 0 ? hits / lookups : 0.0;
+    });
+    Metrics::instance().register_gauge("cache_value_slab_bytes", "Bytes reserved by the value slab allocator",
+                                       [] { return double(ValueSlab::instance().reserved_bytes()); });
+    std::cout << "Cache shards: " << cache.shard_count()
+              << ", max items: " << limits.max_items
+              << ", max bytes: " << limits.max_bytes << " (0 = unlimited)\n";
+
+    // Online trainer, created below once the scorer exists; fed from here on
+    std::unique_ptr<OnlineLearner> learner;
+    std::shared_ptr<NativeModelStrategy> native;
+
+    // Per-key feature stats follow the cache: evicted keys are forgotten.
+    //   KEYSTATS_GHOSTS=N keeps a decayed history of N recently evicted keys
+    //   (KEYSTATS_GHOST_HALF_LIFE_S, default 600, at least 1) that re-admitted keys inherit
+    {
+        size_t ghosts = 0;
+        long half_life = 600;
+        if (const char* g = std::getenv("KEYSTATS_GHOSTS")) ghosts = std::strtoul(g, nullptr, 10);
+        if (const char* h = std::getenv("KEYSTATS_GHOST_HALF_LIFE_S")) half_life = std::atol(h);
+        // live entries mirror the cache; the bound only matters for racing touches
+        const size_t bound = limits.max_items ? 2 * limits.max_items + 1024 : size_t{1} << 22;
+        KeyStatsStore::instance().configure(bound, ghosts, std::chrono::seconds(half_life));
+        cache.set_removal_listener([&learner](const std::string& key, std::string_view, RemovalCause cause) {
+            auto st = KeyStatsStore::instance().forget(key);
+            if (learner && cause == RemovalCause::Evicted) {
+                const uint64_t now_us = KeyStatsStore::nowMicros();
+                learner->on_evict(key, features_of(st ? &*st : nullptr, now_us), now_us);
+            }
+        });
+        auto& m = Metrics::instance();
+        m.register_gauge("cache_key_stats_entries", "Live per-key stats entries",
+                         [] { return double(KeyStatsStore::instance().size()); });
+        m.register_gauge("cache_key_stats_ghosts", "Ghost stats kept for evicted keys",
+                         [] { return double(KeyStatsStore::instance().ghost_size()); });
+        m.register_gauge("cache_key_stats_ghost_hits_total", "Re-admitted keys that inherited ghost stats",
+                         [] { return double(KeyStatsStore::instance().ghost_hits()); }, "counter");
+    }
 
-    // CSV logger (writes to ../data/access_log.csv)
-    CsvLogger::instance().init();
+    // Access logger (../data/access_log.csv by default), written by a background thread:
+    //   LOG_PATH, LOG_FORMAT=csv|binary, LOG_ROTATE_BYTES (e.g. 64M), LOG_ROTATE_SECONDS
+    {
+        LoggerConfig lcfg;
+        const char* fmt = std::getenv("LOG_FORMAT");
+        const bool binary = fmt && std::string(fmt) == "binary";
+        if (binary) lcfg.format = LogFormat::Binary;
+        if (const char* b = std::getenv("LOG_ROTATE_BYTES")) lcfg.rotate_bytes = parse_bytes(b);
+        if (const char* t = std::getenv("LOG_ROTATE_SECONDS")) lcfg.rotate_age = std::chrono::seconds(std::atol(t));
+        const char* path = std::getenv("LOG_PATH");
+        CsvLogger::instance().init(path ? path : (binary ? "../data/access_log.bin" : "../data/access_log.csv"), lcfg);
+    }
 
     // Choose eviction policy via env:
     //   EVICTION_MODE=ML (optional ML_HOST, ML_PORT), otherwise LRU
+    //   EVICTION_MODE=NATIVE scores in-process from MODEL_PATH (exported by train.py)
+    //   EVICTION_MODE=TINYLFU|S3FIFO|ARC selects a built-in scan-resistant policy
+    //   ML_ASYNC=0 scores victims inline on put instead of in the background
+    //   ML_BATCH / ML_POOL size the background scoring batch and victim pool
+    //   ML_TIMEOUT_MS overrides the sidecar timeout (30 inline, 250 async)
     const char* mode = std::getenv("EVICTION_MODE");
     if (mode && std::string(mode) == "ML") {
         const char* host = std::getenv("ML_HOST"); if (!host) host = "127.0.0.1";
         int port = 5000; if (const char* p = std::getenv("ML_PORT")) port = std::atoi(p);
-        cache.set_strategy(std::make_shared<MLEvictionStrategy>(host, port));
-        std::cout << "Eviction policy: ML (" << host << ":" << port << ")\n";
+        const char* async_env = std::getenv("ML_ASYNC");
+        const bool async = !async_env || std::string(async_env) != "0";
+        // off the request path, so a slower sidecar is tolerable
+        int timeout_ms = async ? 250 : 30;
+        if (const char* t = std::getenv("ML_TIMEOUT_MS")) timeout_ms = std::atoi(t);
+        if (async) {
+            EvictionEngineConfig ecfg;
+            if (const char* b = std::getenv("ML_BATCH")) ecfg.batch_size = std::strtoul(b, nullptr, 10);
+            if (const char* p = std::getenv("ML_POOL")) ecfg.pool_target = std::strtoul(p, nullptr, 10);
+            cache.set_async_eviction(true, ecfg);
+        }
+        // one strategy (and sidecar connection) per shard
+        cache.set_strategy([&] {
+            auto ml = std::make_shared<MLEvictionStrategy>(host, port);
+            ml->timeout_ms = timeout_ms;
+            return ml;
+        });
+        std::cout << "Eviction policy: ML (" << host << ":" << port << ", "
+                  << (async ? "async" : "inline") << " scoring)\n";
+    } else if (mode && std::string(mode) == "NATIVE") {
+        // In-process scoring of the exported model; hot-reloads on file change
+        const char* path = std::getenv("MODEL_PATH");
+        if (!path) path = "../ml_sidecar/models/model.txt";
+        native = std::make_shared<NativeModelStrategy>(path);
+        cache.set_strategy([native] { return native; });
+        std::cout << "Eviction policy: NATIVE (" << path
+                  << (native->model() ? "" : ", not loaded yet: LRU until a model appears") << ")\n";
+    } else if (mode && make_builtin_policy(mode)) {
+        // policies keep per-shard metadata, so each shard gets its own
+        const std::string name = mode;
+        cache.set_strategy([&name] { return make_builtin_policy(name); });
+        std::cout << "Eviction policy: " << make_builtin_policy(name)->name() << "\n";
     } else {
-        cache.set_strategy(std::make_shared<LRUStrategy>());
+        cache.set_strategy([] { return std::make_shared<LRUStrategy>(); });
         std::cout << "Eviction policy: LRU (default)\n";
     }
 
+    // Online training, off unless ONLINE_LEARNING=1: reuse labels come from
+    // sampled accesses and a shadow window of evicted keys, and an SGD
+    // logistic model is retrained in the background. With EVICTION_MODE=NATIVE
+    // every new model is swapped into the scorer (a changed MODEL_PATH file
+    // still replaces it until the next swap); otherwise it only reports.
+    //   LEARN_HORIZON_S (60), LEARN_SAMPLE_RATE (0.1), LEARN_SHADOW_KEYS (100000),
+    //   LEARN_RATE (0.01), LEARN_PUBLISH_EVERY (1000 examples)
+    if (const char* l = std::getenv("ONLINE_LEARNING"); l && std::string(l) == "1") {
+        LearnerConfig lc;
+        if (const char* h = std::getenv("LEARN_HORIZON_S"))
+            lc.horizon = std::chrono::milliseconds(static_cast<int64_t>(std::atof(h) * 1000));
+        if (const char* r = std::getenv("LEARN_SAMPLE_RATE")) lc.sample_rate = std::atof(r);
+        if (const char* n = std::getenv("LEARN_SHADOW_KEYS")) lc.shadow_keys = std::strtoul(n, nullptr, 10);
+        if (const char* r = std::getenv("LEARN_RATE")) lc.learning_rate = std::atof(r);
+        if (const char* n = std::getenv("LEARN_PUBLISH_EVERY")) lc.publish_every = lc.min_examples = std::strtoul(n, nullptr, 10);
+        OnlineLearner::Publish publish;
+        if (native) publish = [native](const NativeModel& m) { native->set_model(m); };
+        learner = std::make_unique<OnlineLearner>(lc, std::move(publish));
+        KeyStatsStore::instance().set_access_hook([&learner](const std::string& key, const KeyStats& seen, uint64_t now_us) {
+            learner->on_access(key, features_of(&seen, now_us), now_us);
+        });
+        std::cout << "Online learning: horizon " << lc.horizon.count() << " ms, sampling " << lc.sample_rate
+                  << (native ? ", models swapped into the NATIVE scorer" : ", report only (EVICTION_MODE is not NATIVE)") << "\n";
+    }
+
+    // Optional read-through on misses:
+    //   ORIGIN_URL_TEMPLATE, e.g. http://127.0.0.1:7000/content/{key}?delay_ms=120
+    //   ORIGIN_MAX_INFLIGHT (32) bounds concurrent fetches, ORIGIN_TIMEOUT_MS (2000)
+    std::unique_ptr<OriginFetcher> origin;
+    if (const char* tpl = std::getenv("ORIGIN_URL_TEMPLATE")) {
+        OriginConfig ocfg;
+        ocfg.url_template = tpl;
+        if (const char* n = std::getenv("ORIGIN_MAX_INFLIGHT")) ocfg.max_inflight = std::strtoul(n, nullptr, 10);
+        if (const char* t = std::getenv("ORIGIN_TIMEOUT_MS")) ocfg.timeout = std::chrono::milliseconds(std::atol(t));
+        origin = std::make_unique<OriginFetcher>(ocfg);
+        std::cout << "Read-through origin: " << tpl << "\n";
+    }
+
+    // Expiry: /put may carry ttl_ms and stale_ms; otherwise CACHE_DEFAULT_TTL_S
+    // (0 = never) and CACHE_DEFAULT_STALE_S apply. Stale entries are served
+    // with X-Cache: STALE while one reader refreshes them from the origin.
+    // A timer wheel per shard is turned every 100 ms by the reaper thread.
+    {
+        Expiry def;
+        if (const char* t = std::getenv("CACHE_DEFAULT_TTL_S"))
+            def.ttl = std::chrono::milliseconds(static_cast<int64_t>(std::atof(t) * 1000));
+        if (const char* t = std::getenv("CACHE_DEFAULT_STALE_S"))
+            def.stale = std::chrono::milliseconds(static_cast<int64_t>(std::atof(t) * 1000));
+        cache.set_default_expiry(def);
+        if (def.enabled())
+            std::cout << "Default ttl: " << def.ttl.count() << " ms, stale window: " << def.stale.count() << " ms\n";
+    }
+    ExpiryReaper reaper([&cache] {
+        if (cache.reap_expired() == 0) return;
+        Metrics::instance().set_current_size(cache.size());
+        Metrics::instance().set_resident_bytes(cache.resident_bytes());
+    });
+
+    // Warm restart: SNAPSHOT_PATH is restored before serving, rewritten every
+    // SNAPSHOT_INTERVAL_S (300; 0 = only at shutdown) and once on SIGINT/SIGTERM.
+    // Loaded after the policy is set so tracking policies see the entries.
+    std::unique_ptr<snapshot::Scheduler> snapshots;
+    if (snapshot_path) {
+        auto r = snapshot::load(cache, snapshot_path);
+        if (r.ok)
+            std::cout << "Snapshot restored: " << r.entries << " entries in " << r.ms << " ms"
+                      << (r.skipped_sections ? ", " + std::to_string(r.skipped_sections) + " corrupt sections skipped" : "")
+                      << "\n";
+        else if (!r.error.empty())
+            std::cerr << "Snapshot " << snapshot_path << " skipped: " << r.error << "\n";
+        long interval = 300;
+        if (const char* i = std::getenv("SNAPSHOT_INTERVAL_S")) interval = std::atol(i);
+        snapshots = std::make_unique<snapshot::Scheduler>(cache, snapshot_path, std::chrono::seconds(interval));
+    }
+
+    // HTTP port (8080); the binary protocol has its own BINARY_PORT
+    int port = 8080;
+    if (const char* p = std::getenv("PORT")) port = std::atoi(p);
+
+    // Cluster mode: CLUSTER_NODES lists every node as host:port, e.g.
+    // 127.0.0.1:8080,127.0.0.1:8082,127.0.0.1:8084, identically on each node.
+    // GET and PUT for keys owned by another node are proxied to it.
+    //   CLUSTER_SELF this node's entry (127.0.0.1:PORT), CLUSTER_VNODES ring points per node (128)
+    //   CLUSTER_TIMEOUT_MS per forwarded request (500)
+    //   CLUSTER_NEAR_ITEMS keeps up to N hot remote values locally (0 = off) for
+    //   CLUSTER_NEAR_TTL_MS (1000), once requested CLUSTER_NEAR_MIN_HITS times (4)
+    std::unique_ptr<Cluster> cluster;
+    if (const char* nodes = std::getenv("CLUSTER_NODES")) {
+        ClusterConfig ccfg;
+        std::stringstream list(nodes);
+        for (std::string n; std::getline(list, n, ',');)
+            if (!n.empty()) ccfg.nodes.push_back(n);
+        const char* self = std::getenv("CLUSTER_SELF");
+        ccfg.self = self ? self : "127.0.0.1:" + std::to_string(port);
+        if (const char* v = std::getenv("CLUSTER_VNODES")) ccfg.vnodes = std::strtoul(v, nullptr, 10);
+        if (const char* t = std::getenv("CLUSTER_TIMEOUT_MS")) ccfg.timeout = std::chrono::milliseconds(std::atol(t));
+        if (const char* n = std::getenv("CLUSTER_NEAR_ITEMS")) ccfg.near_items = std::strtoul(n, nullptr, 10);
+        if (const char* t = std::getenv("CLUSTER_NEAR_TTL_MS")) ccfg.near_ttl = std::chrono::milliseconds(std::atol(t));
+        if (const char* h = std::getenv("CLUSTER_NEAR_MIN_HITS"))
+            ccfg.near_min_hits = static_cast<uint8_t>(std::clamp(std::atoi(h), 1, 15));
+        cluster = std::make_unique<Cluster>(ccfg);
+        if (!cluster->ok()) {
+            std::cerr << "Cluster: " << ccfg.self << " is not in CLUSTER_NODES\n";
+            return 1;
+        }
+        std::cout << "Cluster node " << ccfg.self << " of " << cluster->size() << " (" << ccfg.vnodes
+                  << " vnodes each" << (ccfg.near_items ? ", near-cache " + std::to_string(ccfg.near_items) + " items" : "")
+                  << ")\n";
+    }
+
     httplib::Server svr;
+    // headers and body go out as separate writes; without this a keep-alive
+    // client waits out its delayed ACK (~40 ms) on every response
+    svr.set_tcp_nodelay(true);
 
     // Health
     svr.Get("/health", [&](const httplib::Request&, httplib::Response& res) {
         res.set_content("OK", "text/plain");
     });
 
-    // GET value
-    svr.Get("/get", [&](const httplib::Request& req, httplib::Response& res) {
+    // Stores an origin response and records its fetch cost. Captures only
+    // the cache, which outlives the origin's refresh workers.
+    auto store_fetched = [&cache](const std::string& key, const OriginFetcher::Result& f, Expiry expiry = {}) {
+        if (!cache.put(key, f.value, expiry)) return;
+        KeyStatsStore::instance().touch(key, f.value.size());
+        KeyStatsStore::instance().set_fetch_cost_ms(key, f.fetch_ms);
+        Metrics::instance().set_current_size(cache.size());
+        Metrics::instance().set_resident_bytes(cache.resident_bytes());
+    };
+
+    // Looks up a key, reading through to the origin on a miss. Returns an
+    // empty ref after filling in an error response if there is nothing to serve.
+    auto lookup = [&](const httplib::Request& req, httplib::Response& res) -> ValueRef {
         Metrics::instance().inc_get_requests();
-        ScopedGetTimer _timer; // feeds latency histogram
         auto t0 = std::chrono::high_resolution_clock::now();
 
         if (!req.has_param("key")) {
             res.status = 400;
             res.set_content("missing key", "text/plain");
-            return;
+            return ValueRef();
         }
 
         const auto key = req.get_param_value("key");
-        auto val = cache.get(key);
+        Freshness freshness = Freshness::Fresh;
+        // as stored: handlers decide whether a compressed value is inflated;
+        // only a node with an origin takes on refreshing stale entries
+        auto val = cache.get_stored(key, &freshness, /*claim_refresh=*/origin != nullptr);
         if (!val) {
             Metrics::instance().inc_misses();
             CsvLogger::instance().write("GET", key, /*hit=*/false, since_us(t0), /*size_bytes=*/0);
-            res.status = 404;
-            res.set_content("not found", "text/plain");
-            return;
+            if (!origin) {
+                res.status = 404;
+                res.set_content("not found", "text/plain");
+                return ValueRef();
+            }
+
+            // read-through: one origin fetch per key, shared by concurrent misses
+            auto r = origin->fetch(key, [&](const OriginFetcher::Result& f) { store_fetched(key, f); });
+            CsvLogger::instance().write("FETCH", key, r.ok(), since_us(t0), r.value.size());
+            if (!r.ok()) {
+                res.status = r.status == 404 ? 404 : (r.status == 504 ? 504 : 502);
+                res.set_content(r.status == 404 ? "not found" : "origin fetch failed", "text/plain");
+                return ValueRef();
+            }
+            res.set_header("X-Cache", r.coalesced ? "MISS-COALESCED" : "MISS");
+            return std::move(r.value);
         }
 
         Metrics::instance().inc_hits();
-        KeyStatsStore::instance().touch(key, val->size());
-        CsvLogger::instance().write("GET", key, /*hit=*/true, since_us(t0), val->size());
+        const size_t size = compression::decoded_size(val);
+        KeyStatsStore::instance().touch(key, size);
+        CsvLogger::instance().write("GET", key, /*hit=*/true, since_us(t0), size);
+        if (freshness != Freshness::Fresh) {
+            res.set_header("X-Cache", "STALE");
+            // the first stale reader refreshes in the background, with the
+            // ttl and stale window the entry had; the stale copy is served
+            // until the new value lands
+            if (freshness == Freshness::Revalidate && origin)
+                origin->refresh(key, [store_fetched, key, expiry = cache.expiry_of(key)](const OriginFetcher::Result& f) {
+                    store_fetched(key, f, expiry);
+                });
+        }
+        return val;
+    };
 
-        json out = { {"key", key}, {"value", *val} };
-        res.set_content(out.dump(), "application/json");
+    // Uncompressed bytes of a looked-up value; a 500 if they cannot be recovered
+    auto inflate = [](ValueRef val, httplib::Response& res) {
+        auto out = compression::decode(std::move(val));
+        if (!out) {
+            res.status = 500;
+            res.set_content("stored value is corrupt", "text/plain");
+        }
+        return out;
+    };
+
+    // Cluster mode: answers a GET for a key owned by another node, from the
+    // near-cache or the owner. False if this node should serve it (its own
+    // key, a forwarded request, or the owner is unreachable).
+    auto route_get = [&](const httplib::Request& req, httplib::Response& res, bool raw) {
+        if (!cluster || !req.has_param("key")) return false;
+        const auto key = req.get_param_value("key");
+        if (cluster->serves(req, key)) return false;
+        const size_t owner = cluster->owner(key);
+        auto serve = [&](ValueRef v) {
+            res.set_header("X-Cache", "NEAR");
+            res.set_header("X-Cache-Node", cluster->node(owner));
+            if (raw) value_response::set_raw(res, std::move(v));
+            else value_response::set_json(res, key, std::move(v));
+        };
+        auto& near = cluster->near();
+        if (near.enabled()) {
+            if (auto v = near.get(key)) { serve(std::move(v)); return true; }
+            if (near.note(key)) {
+                // hot: fetch the plain bytes once and keep a local copy
+                auto r = cluster->send(owner, "GET", httplib::append_query_params("/get/raw", {{"key", key}}));
+                if (r && r->status == 200) {
+                    auto v = ValueRef::copy_of(r->body);
+                    near.put(key, v);
+                    serve(std::move(v));
+                    return true;
+                }
+            }
+        }
+        return cluster->proxy(owner, req, res);
+    };
+
+    // GET value as {"key":...,"value":...}, streamed from the cached buffer
+    svr.Get("/get", [&](const httplib::Request& req, httplib::Response& res) {
+        ScopedGetTimer _timer; // feeds latency histogram
+        if (route_get(req, res, /*raw=*/false)) return;
+        if (auto val = lookup(req, res))
+            if (auto plain = inflate(std::move(val), res))
+                value_response::set_json(res, req.get_param_value("key"), std::move(plain));
+    });
+
+    // GET raw value bytes, no JSON wrapping or escaping. A compressed entry
+    // goes out as stored to clients that accept gzip.
+    svr.Get("/get/raw", [&](const httplib::Request& req, httplib::Response& res) {
+        ScopedGetTimer _timer;
+        if (route_get(req, res, /*raw=*/true)) return;
+        auto val = lookup(req, res);
+        if (!val) return;
+        if (val.encoding() == ValueEncoding::Gzip) {
+            res.set_header("Vary", "Accept-Encoding");
+            if (value_response::accepts_gzip(req)) {
+                res.set_header("Content-Encoding", "gzip");
+                Metrics::instance().inc_served_encoded();
+            } else if (!(val = inflate(std::move(val), res))) {
+                return;
+            }
+        }
+        value_response::set_raw(res, std::move(val));
     });
 
     // PUT (insert/update)
     svr.Put("/put", [&](const httplib::Request& req, httplib::Response& res) {
+        ScopedPutTimer _timer;
         Metrics::instance().inc_put_requests();
         auto t0 = std::chrono::high_resolution_clock::now();
 
@@ -91,11 +494,39 @@ int main() {
                 return;
             }
             std::string key = body["key"].get<std::string>();
-            std::string value = body["value"].get<std::string>();
+            if (cluster && !cluster->serves(req, key)) {
+                cluster->near().erase(key);
+                if (!cluster->proxy(cluster->owner(key), req, res)) {
+                    res.status = 502;
+                    res.set_content("owner node unreachable", "text/plain");
+                }
+                return;
+            }
+            // stored straight from the parsed body into a value buffer
+            auto value = ValueRef::copy_of(body["value"].get_ref<const std::string&>());
+            // optional per-key lifetime; otherwise the CACHE_DEFAULT_TTL_S default
+            Expiry expiry;
+            expiry.ttl = std::chrono::milliseconds(body.value("ttl_ms", int64_t{0}));
+            expiry.stale = std::chrono::milliseconds(body.value("stale_ms", int64_t{0}));
 
-            cache.put(key, value);
+            PutResult result = PutResult::Stored;
+            if (!cache.put(key, value, expiry, &result)) {
+                CsvLogger::instance().write("PUT", key, /*hit=*/false, since_us(t0), value.size());
+                if (result == PutResult::TooLarge) {
+                    Metrics::instance().inc_put_rejected();
+                    res.status = 413;
+                    res.set_content("value exceeds cache admission limit", "text/plain");
+                    return;
+                }
+                // the eviction policy kept what it had; not an error
+                Metrics::instance().inc_put_not_admitted();
+                json out = { {"status", "not_admitted"}, {"size", cache.size()} };
+                res.set_content(out.dump(), "application/json");
+                return;
+            }
             KeyStatsStore::instance().touch(key, value.size());
             Metrics::instance().set_current_size(cache.size());
+            Metrics::instance().set_resident_bytes(cache.resident_bytes());
             CsvLogger::instance().write("PUT", key, /*hit=*/true, since_us(t0), value.size());
 
             json out = { {"status", "ok"}, {"size", cache.size()} };
@@ -106,6 +537,167 @@ int main() {
         }
     });
 
+    // Batch GET: /mget?key=a&key=b or POST {"keys":[...]}. Each cache shard
+    // is locked once for all of its keys; metrics and access-log records are
+    // published once per request. Misses are listed, not read through.
+    auto mget = [&](const httplib::Request& req, httplib::Response& res) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        std::vector<std::string> keys;
+        try {
+            if (req.method == "POST") {
+                auto body = json::parse(req.body);
+                for (const auto& k : body.at("keys")) keys.push_back(k.get<std::string>());
+            } else {
+                const size_t n = req.get_param_value_count("key");
+                for (size_t i = 0; i < n; ++i) keys.push_back(req.get_param_value("key", i));
+            }
+        } catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(std::string("invalid request: ") + e.what(), "text/plain");
+            return;
+        }
+        {
+            // answer repeated keys once
+            std::unordered_set<std::string_view> seen;
+            std::vector<std::string> unique;
+            unique.reserve(keys.size());
+            for (auto& k : keys) {
+                if (seen.count(k)) continue;
+                unique.push_back(std::move(k));   // reserved: views stay valid
+                seen.insert(unique.back());
+            }
+            keys.swap(unique);
+        }
+
+        // cluster mode: one POST /mget per owning node; keys whose owner
+        // does not answer are looked up here
+        std::vector<ValueRef> values(keys.size());
+        std::vector<uint8_t> remote(keys.size());
+        if (cluster && !req.has_header(Cluster::kForwardedHeader)) {
+            for (const auto& [node, idx] : cluster->remote_groups(keys)) {
+                json body = {{"keys", json::array()}};
+                for (size_t i : idx) body["keys"].push_back(keys[i]);
+                auto r = cluster->send(node, "POST", "/mget", body.dump(), "application/json");
+                if (!r || r->status != 200) continue;
+                auto reply = json::parse(r->body, nullptr, /*allow_exceptions=*/false);
+                if (!reply.is_object() || !reply["values"].is_object()) continue;
+                const auto& found = reply["values"];
+                for (size_t i : idx) {
+                    remote[i] = 1;
+                    auto it = found.find(keys[i]);
+                    if (it != found.end() && it->is_string()) values[i] = ValueRef::copy_of(it->get_ref<const std::string&>());
+                }
+            }
+        }
+        std::vector<std::string> local;
+        for (size_t i = 0; i < keys.size(); ++i)
+            if (!remote[i]) local.push_back(keys[i]);
+        auto local_values = local.size() == keys.size() ? cache.get_many(keys) : cache.get_many(local);
+
+        std::vector<uint8_t> hits(local.size());
+        std::vector<size_t> sizes(local.size());
+        size_t nhits = 0;
+        for (size_t i = 0, j = 0; i < keys.size(); ++i) {
+            if (remote[i]) continue;
+            values[i] = std::move(local_values[j]);
+            if (values[i]) {
+                hits[j] = 1;
+                sizes[j] = values[i].size();
+                ++nhits;
+                KeyStatsStore::instance().touch(keys[i], sizes[j]);
+            }
+            ++j;
+        }
+        auto& m = Metrics::instance();
+        m.add_get_requests(local.size());
+        m.add_hits(nhits);
+        m.add_misses(local.size() - nhits);
+        CsvLogger::instance().write_many("MGET", local, hits, sizes, since_us(t0));
+        value_response::set_json_many(res, std::move(keys), std::move(values));
+    };
+    svr.Get("/mget", mget);
+    svr.Post("/mget", mget);
+
+    // Batch PUT: {"items":[{"key":...,"value":...},...]}, one lock per shard.
+    // Responds with the keys rejected as too large and the keys the
+    // eviction policy did not admit.
+    auto mput = [&](const httplib::Request& req, httplib::Response& res) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        std::vector<std::pair<std::string, ValueRef>> items;
+        try {
+            auto body = json::parse(req.body);
+            const auto& list = body.at("items");
+            items.reserve(list.size());
+            for (const auto& it : list)
+                items.emplace_back(it.at("key").get<std::string>(),
+                                   ValueRef::copy_of(it.at("value").get_ref<const std::string&>()));
+        } catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(std::string("invalid json: ") + e.what(), "text/plain");
+            return;
+        }
+        const size_t total = items.size();
+
+        // cluster mode: one POST /mput per owning node; keys it could not
+        // reach are reported as failed
+        json rejected = json::array(), not_admitted = json::array(), failed = json::array();
+        if (cluster && !req.has_header(Cluster::kForwardedHeader)) {
+            std::vector<std::string> item_keys;
+            for (const auto& it : items) item_keys.push_back(it.first);
+            std::vector<uint8_t> remote(items.size());
+            for (const auto& [node, idx] : cluster->remote_groups(item_keys)) {
+                json body = {{"items", json::array()}};
+                for (size_t i : idx) {
+                    remote[i] = 1;
+                    cluster->near().erase(items[i].first);
+                    body["items"].push_back({{"key", items[i].first}, {"value", items[i].second.view()}});
+                }
+                auto r = cluster->send(node, "POST", "/mput", body.dump(), "application/json");
+                auto reply = r && r->status == 200 ? json::parse(r->body, nullptr, /*allow_exceptions=*/false) : json();
+                if (!reply.is_object() || !reply["rejected"].is_array()) {
+                    for (size_t i : idx) failed.push_back(items[i].first);
+                    continue;
+                }
+                for (const auto& k : reply["rejected"]) rejected.push_back(k);
+                if (reply["not_admitted"].is_array())
+                    for (const auto& k : reply["not_admitted"]) not_admitted.push_back(k);
+            }
+            std::vector<std::pair<std::string, ValueRef>> local;
+            for (size_t i = 0; i < items.size(); ++i)
+                if (!remote[i]) local.push_back(std::move(items[i]));
+            items.swap(local);
+        }
+
+        const auto results = cache.put_many(items);
+        std::vector<std::string> keys(items.size());
+        std::vector<size_t> sizes(items.size());
+        std::vector<uint8_t> stored(items.size());
+        size_t local_rejected = 0, local_not_admitted = 0;
+        for (size_t i = 0; i < items.size(); ++i) {
+            sizes[i] = items[i].second.size();
+            stored[i] = results[i] == PutResult::Stored;
+            if (stored[i]) KeyStatsStore::instance().touch(items[i].first, sizes[i]);
+            else if (results[i] == PutResult::TooLarge) { rejected.push_back(items[i].first); ++local_rejected; }
+            else { not_admitted.push_back(items[i].first); ++local_not_admitted; }
+            keys[i] = std::move(items[i].first);
+        }
+        auto& m = Metrics::instance();
+        m.add_put_requests(items.size());
+        m.add_put_rejected(local_rejected);
+        m.add_put_not_admitted(local_not_admitted);
+        m.set_current_size(cache.size());
+        m.set_resident_bytes(cache.resident_bytes());
+        CsvLogger::instance().write_many("MPUT", keys, stored, sizes, since_us(t0));
+
+        json out = { {"status", "ok"},
+                     {"stored", total - rejected.size() - not_admitted.size() - failed.size()},
+                     {"rejected", rejected}, {"not_admitted", not_admitted}, {"size", cache.size()} };
+        if (!failed.empty()) out["failed"] = failed;
+        res.set_content(out.dump(), "application/json");
+    };
+    svr.Post("/mput", mput);
+    svr.Put("/mput", mput);
+
     // Human-readable stats (JSON)
     svr.Get("/stats", [&](const httplib::Request&, httplib::Response& res) {
         res.set_content(Metrics::instance().to_json(), "application/json");
@@ -116,7 +708,36 @@ int main() {
         res.set_content(Metrics::instance().to_prom(), "text/plain; version=0.0.4");
     });
 
-    std::cout << "Starting cache server on http://127.0.0.1:8080\n";
-    svr.listen("0.0.0.0", 8080);
+    if (snapshots) {
+        std::thread([&svr, stop_signals] {
+            int sig = 0;
+            sigwait(&stop_signals, &sig);
+            svr.stop();
+        }).detach();
+    }
+
+    // Binary protocol listener (see binary_protocol.hpp): BINARY_PORT enables
+    // it, BINARY_THREADS sets the number of epoll loops (1)
+    std::unique_ptr<BinaryServer> binary;
+    if (const char* p = std::getenv("BINARY_PORT")) {
+        BinaryServerConfig bcfg;
+        bcfg.port = std::atoi(p);
+        if (const char* t = std::getenv("BINARY_THREADS")) bcfg.threads = std::strtoul(t, nullptr, 10);
+        binary = std::make_unique<BinaryServer>(cache, bcfg);
+        if (binary->start())
+            std::cout << "Binary protocol on port " << bcfg.port << " (" << bcfg.threads << " loops)\n";
+        else
+            std::cerr << "Binary protocol: cannot listen on port " << bcfg.port << "\n";
+    }
+
+    std::cout << "Starting cache server on http://127.0.0.1:" << port << "\n";
+    svr.listen("0.0.0.0", port);
+    if (binary) binary->stop();
+    if (snapshots) {
+        auto r = snapshots->stop();
+        if (r.ok) std::cout << "Snapshot written: " << r.entries << " entries, " << r.bytes << " bytes in " << r.ms << " ms\n";
+        else std::cerr << "Snapshot failed: " << r.error << "\n";
+        CsvLogger::instance().flush();
+    }
     return 0;
 }
@@ -0,0 +1,189 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "../cache/value_buffer.hpp"
+
+// Response bodies that are written straight from a cached ValueRef. The
+// response keeps its own reference, so the value survives eviction until the
+// socket write completes, and no per-request copy of the bytes is made.
+
+namespace value_response {
+
+// True if any byte of w is < 0x20, '"' or '\\' (SWAR, 8 bytes at a time)
+inline bool needs_escape8(uint64_t w) {
+  constexpr uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+  auto has_zero = [](uint64_t x) { return (x - ones) & ~x & highs; };
+  return ((w - ones * 0x20) & ~w & highs) ||
+         has_zero(w ^ (ones * '"')) || has_zero(w ^ (ones * '\\'));
+}
+
+// Calls out(ptr, len) with the JSON string encoding of s (without quotes):
+// runs that need no escaping are passed through in place.
+template <typename Out>
+inline void escape_json(std::string_view s, Out&& out) {
+  static const char hex[] = "0123456789abcdef";
+  size_t run = 0;
+  for (size_t i = 0; i < s.size(); ++i) {
+    // skip clean 8-byte words; most values contain nothing to escape
+    while (i + 8 <= s.size()) {
+      uint64_t w;
+      std::memcpy(&w, s.data() + i, 8);
+      if (needs_escape8(w)) break;
+      i += 8;
+    }
+    if (i >= s.size()) break;
+    const unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    if (i > run) out(s.data() + run, i - run);
+    run = i + 1;
+    char esc[6] = {'\\', 0, 0, 0, 0, 0};
+    size_t n = 2;
+    switch (c) {
+      case '"':  esc[1] = '"'; break;
+      case '\\': esc[1] = '\\'; break;
+      case '\b': esc[1] = 'b'; break;
+      case '\f': esc[1] = 'f'; break;
+      case '\n': esc[1] = 'n'; break;
+      case '\r': esc[1] = 'r'; break;
+      case '\t': esc[1] = 't'; break;
+      default:
+        esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+        esc[4] = hex[c >> 4]; esc[5] = hex[c & 0xf];
+        n = 6;
+    }
+    out(esc, n);
+  }
+  if (s.size() > run) out(s.data() + run, s.size() - run);
+}
+
+inline size_t escaped_json_size(std::string_view s) {
+  size_t n = 0;
+  escape_json(s, [&](const char*, size_t len) { n += len; });
+  return n;
+}
+
+// Emits {"key":<key>,"value":<value>}, skipping the first `offset` bytes of
+// the encoding and stopping after `length` (httplib may resume mid-body).
+template <typename Out>
+inline void write_json_body(const std::string& key, const ValueRef& v,
+                            size_t offset, size_t length, Out&& out) {
+  size_t pos = 0;
+  const size_t end = offset + length;
+  auto clip = [&](const char* p, size_t n) {
+    const size_t lo = std::max(pos, offset), hi = std::min(pos + n, end);
+    if (lo < hi) out(p + (lo - pos), hi - lo);
+    pos += n;
+  };
+  auto lit = [&](std::string_view s) { clip(s.data(), s.size()); };
+  lit("{\"key\":\"");
+  escape_json(key, clip);
+  lit("\",\"value\":\"");
+  escape_json(v.view(), clip);
+  lit("\"}");
+}
+
+inline size_t json_body_size(const std::string& key, const ValueRef& v) {
+  return sizeof("{\"key\":\"\",\"value\":\"\"}") - 1 +
+         escaped_json_size(key) + escaped_json_size(v.view());
+}
+
+// True if the client's Accept-Encoding allows gzip (a q of 0 refuses it)
+inline bool accepts_gzip(const httplib::Request& req) {
+  const std::string ae = req.get_header_value("Accept-Encoding");
+  size_t pos = 0;
+  while (pos < ae.size()) {
+    size_t end = ae.find(',', pos);
+    if (end == std::string::npos) end = ae.size();
+    std::string_view item(ae.data() + pos, end - pos);
+    pos = end + 1;
+    const size_t semi = item.find(';');
+    std::string_view coding = item.substr(0, semi);
+    while (!coding.empty() && coding.front() == ' ') coding.remove_prefix(1);
+    while (!coding.empty() && coding.back() == ' ') coding.remove_suffix(1);
+    if (coding != "gzip" && coding != "*") continue;
+    if (semi == std::string_view::npos) return true;
+    const size_t q = item.find("q=", semi);
+    return q == std::string_view::npos || std::strtod(std::string(item.substr(q + 2)).c_str(), nullptr) > 0;
+  }
+  return false;
+}
+
+// Raw bytes, e.g. a PDF or slide deck
+inline void set_raw(httplib::Response& res, ValueRef v,
+                    const std::string& content_type = "application/octet-stream") {
+  const size_t n = v.size();
+  res.set_content_provider(n, content_type,
+    [v = std::move(v)](size_t offset, size_t length, httplib::DataSink& sink) {
+      return sink.write(v.data() + offset, length);
+    });
+}
+
+// Same JSON shape as before, {"key":...,"value":...}. Value bytes are
+// emitted as-is apart from JSON escaping; binary values belong on /get/raw.
+inline void set_json(httplib::Response& res, const std::string& key, ValueRef v) {
+  const size_t n = json_body_size(key, v);
+  res.set_content_provider(n, "application/json",
+    [key, v = std::move(v)](size_t offset, size_t length, httplib::DataSink& sink) {
+      bool ok = true;
+      write_json_body(key, v, offset, length,
+                      [&](const char* p, size_t len) { if (ok) ok = sink.write(p, len); });
+      return ok;
+    });
+}
+
+// {"values":{<key>:<value>,...},"missing":[<key>,...]} for /mget, hits in
+// request order. Keys must be distinct.
+template <typename Out>
+inline void write_many_body(const std::vector<std::string>& keys, const std::vector<ValueRef>& values,
+                            size_t offset, size_t length, Out&& out) {
+  size_t pos = 0;
+  const size_t end = offset + length;
+  auto clip = [&](const char* p, size_t n) {
+    const size_t lo = std::max(pos, offset), hi = std::min(pos + n, end);
+    if (lo < hi) out(p + (lo - pos), hi - lo);
+    pos += n;
+  };
+  auto lit = [&](std::string_view s) { clip(s.data(), s.size()); };
+  bool first = true;
+  lit("{\"values\":{");
+  for (size_t i = 0; i < keys.size() && pos < end; ++i) {
+    if (!values[i]) continue;
+    lit(first ? "\"" : ",\"");
+    first = false;
+    escape_json(keys[i], clip);
+    lit("\":\"");
+    escape_json(values[i].view(), clip);
+    lit("\"");
+  }
+  first = true;
+  lit("},\"missing\":[");
+  for (size_t i = 0; i < keys.size() && pos < end; ++i) {
+    if (values[i]) continue;
+    lit(first ? "\"" : ",\"");
+    first = false;
+    escape_json(keys[i], clip);
+    lit("\"");
+  }
+  lit("]}");
+}
+
+inline void set_json_many(httplib::Response& res, std::vector<std::string> keys, std::vector<ValueRef> values) {
+  size_t n = 0;
+  write_many_body(keys, values, 0, SIZE_MAX, [&](const char*, size_t len) { n += len; });
+  res.set_content_provider(n, "application/json",
+    [keys = std::move(keys), values = std::move(values)](size_t offset, size_t length, httplib::DataSink& sink) {
+      bool ok = true;
+      write_many_body(keys, values, offset, length,
+                      [&](const char* p, size_t len) { if (ok) ok = sink.write(p, len); });
+      return ok;
+    });
+}
+
+}  // namespace value_response
@@ -0,0 +1,418 @@
+// Offline trace replay: runs a request trace through LruCache with each
+// eviction policy at several capacities in parallel, and against Belady's
+// OPT, to compare hit ratio, byte hit ratio and eviction decision latency
+// without a live server.
+//
+//   cache_sim --trace ../data/access_log.csv --capacities 1K,10K,100K
+//   cache_sim --trace trace.jsonl --bytes 64M,512M --policies LRU,TINYLFU
+//   cache_sim --zipf 5M,0.9,1M --capacities 10K,100K --json out.json
+//
+// Traces: access_log .csv / .bin as written by CsvLogger, or .jsonl with one
+// {"key":..., "size":...} object per line. Reads (GET, MGET) are replayed as
+// demand-filled lookups; other records only contribute object sizes.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../third_party/json.hpp"
+#include "../cache/logger.hpp"
+#include "../cache/lru_cache.hpp"
+#include "../cache/policies.hpp"
+
+namespace {
+
+struct Trace {
+  std::deque<std::string>  keys;      // by id; deque so elements never move
+  std::vector<uint32_t>    sizes;     // by id, largest size seen
+  std::vector<uint32_t>    requests;  // key ids in order
+};
+
+class TraceBuilder {
+public:
+  explicit TraceBuilder(Trace& t) : t_(t) {}
+
+  void record(const char* key, size_t len, uint64_t size, bool is_read) {
+    auto it = ids_.find(std::string_view(key, len));
+    uint32_t id;
+    if (it == ids_.end()) {
+      id = static_cast<uint32_t>(t_.keys.size());
+      t_.keys.emplace_back(key, len);
+      t_.sizes.push_back(0);
+      ids_.emplace(t_.keys.back(), id);
+    } else {
+      id = it->second;
+    }
+    if (size > t_.sizes[id]) t_.sizes[id] = static_cast<uint32_t>(std::min<uint64_t>(size, UINT32_MAX));
+    if (is_read) t_.requests.push_back(id);
+  }
+
+  // keys never seen with a size (e.g. only ever missed) get a default
+  void finish(uint32_t default_size) {
+    for (auto& s : t_.sizes) if (s == 0) s = default_size;
+  }
+
+private:
+  Trace& t_;
+  std::unordered_map<std::string_view, uint32_t> ids_;   // views into t_.keys
+};
+
+bool is_read_op(std::string_view op) { return op == "GET" || op == "MGET"; }
+
+std::string slurp(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) { std::cerr << "cannot open " << path << "\n"; std::exit(1); }
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+// ts_ms,op,key,hit,lat_us,size_bytes
+void load_csv(const std::string& path, TraceBuilder& b) {
+  const std::string buf = slurp(path);
+  const char* p = buf.data();
+  const char* end = p + buf.size();
+  bool header = true;
+  while (p < end) {
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (!eol) eol = end;
+    if (header) { header = false; if (eol > p && (*p < '0' || *p > '9')) { p = eol + 1; continue; } }
+    const char* f[6]; size_t n = 0; f[n++] = p;
+    for (const char* q = p; q < eol && n < 6; ++q) if (*q == ',') f[n++] = q + 1;
+    if (n == 6) {
+      const std::string_view op(f[1], f[2] - f[1] - 1);
+      b.record(f[2], f[3] - f[2] - 1, std::strtoull(f[5], nullptr, 10), is_read_op(op));
+    }
+    p = eol + 1;
+  }
+}
+
+// column blocks, see CsvLogger
+void load_bin(const std::string& path, TraceBuilder& b) {
+  const std::string buf = slurp(path);
+  size_t off = 0;
+  auto bad_block = [&] { std::cerr << "bad block in " << path << "\n"; std::exit(1); };
+  while (off + 16 <= buf.size()) {
+    uint16_t ver; uint32_t rows, key_bytes;
+    std::memcpy(&ver, buf.data() + off + 4, 2);
+    std::memcpy(&rows, buf.data() + off + 8, 4);
+    std::memcpy(&key_bytes, buf.data() + off + 12, 4);
+    if (buf.compare(off, 4, "GCLB") != 0 || ver != 1) bad_block();
+    off += 16;
+    // 28 bytes of columns per row, then the keys
+    if (28 * uint64_t(rows) + key_bytes > buf.size() - off) bad_block();
+    const char* size_col = buf.data() + off + 16 * size_t(rows);
+    const char* op_col   = buf.data() + off + 24 * size_t(rows);
+    const char* klen_col = op_col + 2 * size_t(rows);
+    const char* keys     = klen_col + 2 * size_t(rows);
+    size_t koff = 0;
+    for (uint32_t i = 0; i < rows; ++i) {
+      uint64_t size; uint16_t klen;
+      std::memcpy(&size, size_col + 8 * size_t(i), 8);
+      std::memcpy(&klen, klen_col + 2 * size_t(i), 2);
+      if (klen > key_bytes - koff) bad_block();
+      const uint8_t op = static_cast<uint8_t>(op_col[i]);
+      const bool read = op < CsvLogger::kOpNames.size() && is_read_op(CsvLogger::kOpNames[op]);
+      b.record(keys + koff, klen, size, read);
+      koff += klen;
+    }
+    off = static_cast<size_t>(keys - buf.data()) + key_bytes;
+  }
+}
+
+void load_jsonl(const std::string& path, TraceBuilder& b) {
+  std::ifstream in(path);
+  if (!in) { std::cerr << "cannot open " << path << "\n"; std::exit(1); }
+  std::string line;
+  while (std::getline(in, line)) {
+    auto j = nlohmann::json::parse(line, nullptr, /*allow_exceptions=*/false);
+    if (!j.is_object() || !j.contains("key") || !j["key"].is_string()) continue;
+    const auto& key = j["key"].get_ref<const std::string&>();
+    uint64_t size = j.value("size", j.value("size_bytes", uint64_t{0}));
+    if (!size && j.contains("value") && j["value"].is_string()) size = j["value"].get_ref<const std::string&>().size();
+    b.record(key.data(), key.size(), size, is_read_op(j.value("op", std::string("GET"))));
+  }
+}
+
+// n requests over `keys` keys with Zipf(alpha) popularity and log-normal sizes
+void make_zipf(size_t n, double alpha, size_t keys, TraceBuilder& b) {
+  std::mt19937_64 rng(42);
+  std::vector<double> cdf(keys);
+  double sum = 0;
+  for (size_t i = 0; i < keys; ++i) cdf[i] = (sum += 1.0 / std::pow(double(i + 1), alpha));
+  std::uniform_real_distribution<double> u(0, sum);
+  std::lognormal_distribution<double> size_dist(std::log(4096.0), 1.5);
+  std::vector<uint32_t> sizes(keys);
+  for (auto& s : sizes) s = static_cast<uint32_t>(std::clamp(size_dist(rng), 64.0, 64.0 * 1024 * 1024));
+  char key[32];
+  for (size_t i = 0; i < n; ++i) {
+    const size_t k = std::lower_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin();
+    const int len = std::snprintf(key, sizeof(key), "k%zu", k);
+    b.record(key, static_cast<size_t>(len), sizes[k], true);
+  }
+}
+
+size_t parse_size(const std::string& s) {
+  char* end = nullptr;
+  double v = std::strtod(s.c_str(), &end);
+  switch (end && *end ? *end : ' ') {
+    case 'k': case 'K': v *= 1024.0; break;
+    case 'm': case 'M': v *= 1024.0 * 1024.0; break;
+    case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; break;
+    default: break;
+  }
+  return v > 0 ? static_cast<size_t>(v) : 0;
+}
+
+std::vector<std::string> split(const std::string& s) {
+  std::vector<std::string> out;
+  std::stringstream ss(s);
+  for (std::string item; std::getline(ss, item, ',');) if (!item.empty()) out.push_back(item);
+  return out;
+}
+
+// Times every eviction decision of the wrapped policy
+class TimedStrategy : public EvictionStrategy {
+public:
+  explicit TimedStrategy(std::shared_ptr<EvictionStrategy> s) : s_(std::move(s)) {}
+
+  std::optional<std::string> choose_victim(const std::vector<std::string>& c) override {
+    return timed([&] { return s_->choose_victim(c); });
+  }
+  bool supports_batch_scoring() const override { return false; }
+  bool tracks_entries() const override { return s_->tracks_entries(); }
+  void on_access(const std::string& k, bool hit) override { s_->on_access(k, hit); }
+  void on_insert(const std::string& k, size_t w) override { s_->on_insert(k, w); }
+  void on_remove(const std::string& k, bool evicted) override { s_->on_remove(k, evicted); }
+  std::optional<std::string> victim() override { return timed([&] { return s_->victim(); }); }
+  const char* name() const override { return s_->name(); }
+
+  uint64_t decisions = 0, total_ns = 0;
+  uint64_t log2_ns[40] = {};   // histogram of decision time, bucket = floor(log2(ns))
+
+  uint64_t quantile_ns(double q) const {
+    uint64_t seen = 0;
+    for (int i = 0; i < 40; ++i) {
+      seen += log2_ns[i];
+      if (decisions && double(seen) >= q * double(decisions)) return uint64_t{1} << (i + 1);
+    }
+    return 0;
+  }
+
+private:
+  template <typename Fn>
+  std::optional<std::string> timed(Fn&& fn) {
+    const auto t0 = std::chrono::steady_clock::now();
+    auto v = fn();
+    const uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - t0).count());
+    ++decisions; total_ns += ns;
+    int b = 0;
+    while (b < 39 && (ns >> (b + 1))) ++b;
+    ++log2_ns[b];
+    return v;
+  }
+
+  std::shared_ptr<EvictionStrategy> s_;
+};
+
+struct Job {
+  std::string policy;
+  size_t capacity;      // items, or bytes if by_bytes
+  bool by_bytes;
+};
+
+struct Result {
+  Job job;
+  uint64_t requests = 0, hits = 0, bytes = 0, hit_bytes = 0, evictions = 0;
+  double decision_ns_mean = 0;
+  uint64_t decision_ns_p99 = 0;
+  double seconds = 0;
+};
+
+Result run_policy(const Trace& t, const Job& job) {
+  CacheLimits limits{0, 0, 1.0};
+  (job.by_bytes ? limits.max_bytes : limits.max_items) = job.capacity;
+  LruCache cache(limits);
+  auto timed = std::make_shared<TimedStrategy>(make_builtin_policy(job.policy));
+  cache.set_strategy(timed);
+
+  Result r{job};
+  const auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t id : t.requests) {
+    const std::string& key = t.keys[id];
+    const uint32_t size = t.sizes[id];
+    ++r.requests; r.bytes += size;
+    if (cache.get_ref(key)) { ++r.hits; r.hit_bytes += size; continue; }
+    char* data = nullptr;
+    cache.put(key, ValueRef::allocate(job.by_bytes ? size : 0, &data));
+  }
+  r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  r.evictions = cache.stats().evictions;
+  r.decision_ns_mean = timed->decisions ? double(timed->total_ns) / double(timed->decisions) : 0;
+  r.decision_ns_p99 = timed->quantile_ns(0.99);
+  return r;
+}
+
+// Belady: on a miss evict the resident object re-referenced farthest in the
+// future, and bypass the new object if it is the farthest itself. Exact for
+// unit sizes; a standard heuristic upper bound under a byte budget.
+Result run_opt(const Trace& t, const Job& job) {
+  const size_t n = t.requests.size();
+  std::vector<size_t> next(n);
+  {
+    std::vector<size_t> last(t.keys.size(), SIZE_MAX);
+    for (size_t i = n; i-- > 0;) { next[i] = last[t.requests[i]]; last[t.requests[i]] = i; }
+  }
+  // same charge LruCache applies to the entry
+  auto weight = [&](uint32_t id) -> size_t {
+    if (!job.by_bytes) return 1;
+    return LruCache::charge(t.keys[id], ValueRef()) + ValueRef::footprint_for(t.sizes[id]);
+  };
+
+  Result r{job};
+  const auto t0 = std::chrono::steady_clock::now();
+  std::set<std::pair<size_t, uint32_t>, std::greater<>> resident;   // (next use, id), farthest first
+  std::vector<size_t> resident_next(t.keys.size(), SIZE_MAX - 1);   // SIZE_MAX - 1 = not cached
+  constexpr size_t kAbsent = SIZE_MAX - 1;
+  size_t used = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const uint32_t id = t.requests[i];
+    const uint32_t size = t.sizes[id];
+    ++r.requests; r.bytes += size;
+    if (resident_next[id] != kAbsent) {
+      ++r.hits; r.hit_bytes += size;
+      resident.erase({resident_next[id], id});
+      resident.emplace(next[i], id);
+      resident_next[id] = next[i];
+      continue;
+    }
+    const size_t w = weight(id);
+    if (w > job.capacity || next[i] == SIZE_MAX) continue;   // never reused: bypass
+    while (used + w > job.capacity && !resident.empty() && resident.begin()->first > next[i]) {
+      auto [nu, victim] = *resident.begin();
+      resident.erase(resident.begin());
+      resident_next[victim] = kAbsent;
+      used -= weight(victim);
+      ++r.evictions;
+    }
+    if (used + w > job.capacity) continue;   // everything cached is needed sooner
+    resident.emplace(next[i], id);
+    resident_next[id] = next[i];
+    used += w;
+  }
+  r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return r;
+}
+
+void usage() {
+  std::cerr <<
+    "usage: cache_sim (--trace FILE | --zipf N,ALPHA,KEYS) [options]\n"
+    "  --capacities LIST   item budgets, e.g. 1K,10K,100K\n"
+    "  --bytes LIST        byte budgets, e.g. 64M,1G (sizes from the trace)\n"
+    "  --policies LIST     LRU,TINYLFU,S3FIFO,ARC,OPT (default: all)\n"
+    "  --default-size N    size for keys the trace never sized (4096)\n"
+    "  --threads N         parallel runs (hardware concurrency)\n"
+    "  --json FILE         also write results as JSON\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string trace_path, zipf, json_path;
+  std::vector<std::string> policies = {"LRU", "TINYLFU", "S3FIFO", "ARC", "OPT"};
+  std::vector<size_t> item_caps, byte_caps;
+  uint32_t default_size = 4096;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    auto next = [&]() -> std::string {
+      if (i + 1 >= argc) { usage(); std::exit(2); }
+      return argv[++i];
+    };
+    if (a == "--trace") trace_path = next();
+    else if (a == "--zipf") zipf = next();
+    else if (a == "--capacities") for (auto& c : split(next())) item_caps.push_back(parse_size(c));
+    else if (a == "--bytes") for (auto& c : split(next())) byte_caps.push_back(parse_size(c));
+    else if (a == "--policies") policies = split(next());
+    else if (a == "--default-size") default_size = static_cast<uint32_t>(parse_size(next()));
+    else if (a == "--threads") threads = std::max<size_t>(1, std::strtoul(next().c_str(), nullptr, 10));
+    else if (a == "--json") json_path = next();
+    else { usage(); return 2; }
+  }
+  if (trace_path.empty() == zipf.empty()) { usage(); return 2; }
+  if (item_caps.empty() && byte_caps.empty()) item_caps = {100, 1000, 10000};
+  for (const auto& p : policies) {
+    if (p != "OPT" && !make_builtin_policy(p)) { std::cerr << "unknown policy " << p << "\n"; return 2; }
+  }
+
+  Trace trace;
+  TraceBuilder builder(trace);
+  const auto l0 = std::chrono::steady_clock::now();
+  if (!zipf.empty()) {
+    auto parts = split(zipf);
+    if (parts.size() != 3) { usage(); return 2; }
+    make_zipf(parse_size(parts[0]), std::atof(parts[1].c_str()), parse_size(parts[2]), builder);
+  } else {
+    const auto ext = trace_path.substr(trace_path.find_last_of('.') + 1);
+    if (ext == "bin") load_bin(trace_path, builder);
+    else if (ext == "jsonl") load_jsonl(trace_path, builder);
+    else load_csv(trace_path, builder);
+  }
+  builder.finish(default_size);
+  std::cerr << "trace: " << trace.requests.size() << " reads over " << trace.keys.size() << " keys ("
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - l0).count() << " s to load)\n";
+  if (trace.requests.empty()) { std::cerr << "no read requests in trace\n"; return 1; }
+
+  std::vector<Job> jobs;
+  for (size_t c : item_caps) for (const auto& p : policies) jobs.push_back({p, c, false});
+  for (size_t c : byte_caps) for (const auto& p : policies) jobs.push_back({p, c, true});
+
+  std::vector<Result> results(jobs.size());
+  std::atomic<size_t> next_job{0};
+  std::vector<std::thread> pool;
+  for (size_t w = 0; w < std::min(threads, jobs.size()); ++w) {
+    pool.emplace_back([&] {
+      for (size_t j; (j = next_job.fetch_add(1)) < jobs.size();)
+        results[j] = jobs[j].policy == "OPT" ? run_opt(trace, jobs[j]) : run_policy(trace, jobs[j]);
+    });
+  }
+  for (auto& th : pool) th.join();
+
+  std::printf("%-9s %-12s %10s %10s %12s %14s %14s %10s\n", "policy", "capacity", "hit", "byte_hit",
+              "evictions", "decide_ns_avg", "decide_ns_p99", "Mreq/s");
+  nlohmann::json out = nlohmann::json::array();
+  for (const auto& r : results) {
+    const std::string cap = std::to_string(r.job.capacity) + (r.job.by_bytes ? "B" : "");
+    const double hit = double(r.hits) / double(r.requests);
+    const double byte_hit = r.bytes ? double(r.hit_bytes) / double(r.bytes) : 0.0;
+    const double mrps = r.seconds > 0 ? double(r.requests) / r.seconds / 1e6 : 0.0;
+    std::printf("%-9s %-12s %10.4f %10.4f %12llu %14.0f %14llu %10.2f\n", r.job.policy.c_str(), cap.c_str(),
+                hit, byte_hit, static_cast<unsigned long long>(r.evictions), r.decision_ns_mean,
+                static_cast<unsigned long long>(r.decision_ns_p99), mrps);
+    out.push_back({{"policy", r.job.policy}, {"capacity", r.job.capacity},
+                   {"unit", r.job.by_bytes ? "bytes" : "items"}, {"requests", r.requests},
+                   {"hit_ratio", hit}, {"byte_hit_ratio", byte_hit}, {"evictions", r.evictions},
+                   {"decision_ns_mean", r.decision_ns_mean}, {"decision_ns_p99", r.decision_ns_p99},
+                   {"mreq_per_s", mrps}});
+  }
+  if (!json_path.empty()) std::ofstream(json_path) << out.dump(2) << "\n";
+  return 0;
+}